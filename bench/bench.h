@@ -0,0 +1,314 @@
+#pragma once
+/** @file bench.h shared scaffolding for the opt.h benchmarks.
+ *
+ *  Every benchmark is a single translation unit that #defines
+ *  OPT_IMPLEMENTATION, #includes ../opt.h and then this file. This provides
+ *  the monotonic clock, the sample option tables, the argv scenarios run
+ *  against them and the list of lookup engines each benchmark iterates over.
+ *
+ *  This file is POSIX-only, and is not part of the library.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+/* clock_gettime(2) and CLOCK_MONOTONIC with a strict -std. Feature macros
+ * only count before the first system header, so a benchmark that #includes
+ * opt.h before this file defines it, or _GNU_SOURCE, at its own top */
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#   define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/** @brief Monotonic timestamp in nanoseconds */
+static inline unsigned long long bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull
+         + (unsigned long long)ts.tv_nsec;
+}
+
+
+/** @brief qsort(3) comparison of nanosecond samples */
+static inline int bench_nscmp(const void *p1, const void *p2)
+{
+    const unsigned long long *x1 = (const unsigned long long *)p1;
+    const unsigned long long *x2 = (const unsigned long long *)p2;
+
+    return (*x1 > *x2) - (*x1 < *x2);
+}
+
+
+/** @brief Sort @p n samples in place */
+static inline void bench_sort(unsigned long long *smp, size_t n)
+{
+    qsort(smp, n, sizeof *smp, bench_nscmp);
+}
+
+
+/** @brief Nearest-rank percentile @p pct of @p n sorted samples */
+static inline unsigned long long bench_pct(const unsigned long long *smp,
+                                           size_t                    n,
+                                           double                    pct)
+{
+    size_t rank;
+
+    if (!n) {
+        return 0;
+    }
+    rank = (size_t)(pct / 100.0 * (double)n + 0.999999);
+    rank = rank ? rank - 1 : 0;
+    return smp[rank < n ? rank : n - 1];
+}
+
+
+/** @brief Option callback that does nothing */
+static inline int bench_cb(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)count;
+    (void)args;
+    (void)data;
+    return 0;
+}
+
+
+/** @brief Error callback that does nothing */
+static inline int bench_errcb(int type, char shrt, char *lng, void *data)
+{
+    (void)type;
+    (void)shrt;
+    (void)lng;
+    (void)data;
+    return 0;
+}
+
+
+/** Generate unique long options by pasting base-4 digits onto @p p. The
+ *  table sizes are powers of four so that they compose without a counter */
+#define BENCH_D4(m, p) m(p##0) m(p##1) m(p##2) m(p##3)
+#define BENCH_D16(m, p) \
+    BENCH_D4(m, p##0) BENCH_D4(m, p##1) BENCH_D4(m, p##2) BENCH_D4(m, p##3)
+#define BENCH_D64(m, p) \
+    BENCH_D16(m, p##0) BENCH_D16(m, p##1) BENCH_D16(m, p##2) BENCH_D16(m, p##3)
+#define BENCH_D256(m, p) \
+    BENCH_D64(m, p##0) BENCH_D64(m, p##1) BENCH_D64(m, p##2) BENCH_D64(m, p##3)
+#define BENCH_D1024(m, p) BENCH_D256(m, p##0) BENCH_D256(m, p##1) \
+    BENCH_D256(m, p##2) BENCH_D256(m, p##3)
+#define BENCH_D4096(m, p) BENCH_D1024(m, p##0) BENCH_D1024(m, p##1) \
+    BENCH_D1024(m, p##2) BENCH_D1024(m, p##3)
+
+#define BENCH_LONG(n) { 0, "opt-" #n, 1, bench_cb },
+
+
+/** @brief The table from the opt.h documentation */
+static const struct optspec bench_small[] = {
+    { 's', "seed",      1, bench_cb },
+    { 'n', "count",     1, bench_cb },
+    { 't', "test-mode", 0, bench_cb },
+    { 0,   "dry-run",   0, bench_cb },
+    { 'o', NULL,        1, bench_cb },
+    { 0,   "output",    1, bench_cb },
+    { 'v', "vector",    3, bench_cb }
+};
+
+
+/** @brief A large, long-option heavy table */
+static const struct optspec bench_large[] = {
+    { 'v', "verbose",   0, bench_cb },
+    { 'q', "quiet",     0, bench_cb },
+    { 'j', "jobs",      1, bench_cb },
+    { 'o', "output",    1, bench_cb },
+    BENCH_D256(BENCH_LONG, x)
+};
+
+
+/** @brief A table of response file scale, which with its index and names
+ *      is several times the size of the L1 data cache, for OPT_BATCH_LEN */
+static const struct optspec bench_huge[] = {
+    BENCH_D4096(BENCH_LONG, h)
+};
+
+
+static char *bench_small_argv[] = {
+    "prog", "-s", "42", "--count", "7", "-t", "--dry-run", "-o", "out",
+    "--output", "file", "-v", "1", "2", "3", "input1", "input2"
+};
+
+
+static char *bench_large_argv[] = {
+    "prog", "--opt-x0000", "a", "--opt-x3333", "b", "--opt-x1203", "c",
+    "--opt-x2310", "d", "--opt-x0132", "e", "--opt-x3021", "f",
+    "--opt-x1111", "g", "--opt-x2222", "h", "-vq", "-j", "8",
+    "--output", "out", "--opt-x0301", "i", "--opt-x1032", "j",
+    "--opt-x2103", "k", "--opt-x3210", "l", "input"
+};
+
+
+static char *bench_miss_argv[] = {
+    "prog", "--nope", "--opt-y0000", "--opt-x", "-Z", "--outputs",
+    "--opt-x00000", "--verbos", "-vZq", "--opt-x3333", "m", "input"
+};
+
+
+static char *bench_huge_argv[] = {
+    "prog", "--opt-h201022", "a", "--opt-h211000", "b", "--opt-h032003", "c",
+    "--opt-h210120", "d", "--opt-h131102", "e", "--opt-h311320", "f",
+    "--opt-h011110", "g", "--opt-h213000", "h", "--opt-h102000", "i",
+    "--opt-h133002", "j", "--opt-h010301", "k", "--opt-h212111", "l",
+    "--opt-h310121", "m", "--opt-h322103", "n", "--opt-h012310", "o",
+    "--opt-h332211", "p", "--opt-h333011", "q", "--opt-h003333", "r",
+    "--opt-h232032", "s", "--opt-h200312", "t", "--opt-h023212", "u",
+    "--opt-h133213", "v", "--opt-h301030", "w", "--opt-h333303", "x",
+    "--opt-h113330", "y", "--opt-h131320", "z", "--opt-h102331", "a",
+    "--opt-h301013", "b", "--opt-h001332", "c", "--opt-h101313", "d",
+    "--opt-h230023", "e", "--opt-h102001", "f", "--opt-h201003", "g",
+    "--opt-h103012", "h", "--opt-h121223", "i", "--opt-h131213", "j",
+    "--opt-h312223", "k", "--opt-h212331", "l", "--opt-h312201", "m",
+    "--opt-h300112", "n", "--opt-h113002", "o", "--opt-h020221", "p",
+    "--opt-h232311", "q", "--opt-h103101", "r", "--opt-h102323", "s",
+    "--opt-h223300", "t", "--opt-h322010", "u", "--opt-h003003", "v",
+    "--opt-h", "--opt-h0123", "input"
+};
+
+
+#define BENCH_COUNT(arr) (sizeof (arr) / sizeof *(arr))
+
+
+/** @brief Most cmdargs of any scenario, for scratch copies of their argv */
+#define BENCH_MAXARG 128
+
+/* Every scenario must fit in BENCH_MAXARG */
+typedef char bench_maxarg_check[BENCH_COUNT(bench_small_argv) <= BENCH_MAXARG
+                                && BENCH_COUNT(bench_large_argv) <= BENCH_MAXARG
+                                && BENCH_COUNT(bench_miss_argv) <= BENCH_MAXARG
+                                && BENCH_COUNT(bench_huge_argv) <= BENCH_MAXARG
+                                ? 1 : -1];
+
+
+/** @brief A single argv run against a table */
+struct bench_scenario {
+    const char           *name;
+    unsigned              nopt;
+    const struct optspec *opts;
+    int                   argc;
+    char                **argv;
+};
+
+
+static const struct bench_scenario bench_scenarios[] = {
+    { "small", BENCH_COUNT(bench_small), bench_small,
+      BENCH_COUNT(bench_small_argv), bench_small_argv },
+    { "large", BENCH_COUNT(bench_large), bench_large,
+      BENCH_COUNT(bench_large_argv), bench_large_argv },
+    { "miss",  BENCH_COUNT(bench_large), bench_large,
+      BENCH_COUNT(bench_miss_argv),  bench_miss_argv  },
+    { "huge",  BENCH_COUNT(bench_huge),  bench_huge,
+      BENCH_COUNT(bench_huge_argv),  bench_huge_argv  }
+};
+
+
+/** @brief Find a scenario by name, returning NULL if there is none */
+static inline const struct bench_scenario *bench_scenario(const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < BENCH_COUNT(bench_scenarios); i++) {
+        if (!strcmp(bench_scenarios[i].name, name)) {
+            return &bench_scenarios[i];
+        }
+    }
+    return NULL;
+}
+
+
+/** @brief Parse entry point of an engine, with the signature of opt_parse */
+typedef int bench_parsefn_t(struct optinfo       *info,
+                            unsigned              nopt,
+                            const struct optspec  opts[]);
+
+
+/** @brief A lookup engine under test */
+struct bench_engine {
+    const char      *name;
+    bench_parsefn_t *parse;
+};
+
+
+#define BENCH_MAXOPT 4096
+
+
+/** @brief opt_parse_tbl with the table sorted once, on first use. This is the
+ *      cost of a table generated by tools/optgen.c, or one built at startup */
+static inline int bench_prebuilt(struct optinfo       *info,
+                                 unsigned              nopt,
+                                 const struct optspec  opts[])
+{
+    static const struct optspec *shrt[BENCH_MAXOPT], *lng[BENCH_MAXOPT];
+    static struct opttbl tbl;
+
+    nopt = nopt < BENCH_MAXOPT ? nopt : BENCH_MAXOPT;
+    if (tbl.opts != opts || tbl.nopt != nopt) {
+        opt_tbl_init(&tbl, nopt, opts, shrt, lng);
+    }
+    return opt_parse_tbl(info, &tbl);
+}
+
+
+/* Engines of a parser built with OPT_BATCH_LEN are named for it, e.g.
+ * "prebuilt/batch16", so that the results of both builds can be compared */
+#if OPT_BATCH_LEN > 1
+#   define BENCH_STR2(x) #x
+#   define BENCH_STR(x) BENCH_STR2(x)
+#   define BENCH_BATCH "/batch" BENCH_STR(OPT_BATCH_LEN)
+#else
+#   define BENCH_BATCH ""
+#endif
+
+
+static const struct bench_engine bench_engines[] = {
+    /* Per-call sort, binary search lookup */
+    { "bsearch" BENCH_BATCH,  opt_parse      },
+    /* Sorted once, binary search lookup */
+    { "prebuilt" BENCH_BATCH, bench_prebuilt }
+};
+
+
+/** @brief Find an engine by name, returning NULL if there is none */
+static inline const struct bench_engine *bench_engine(const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < BENCH_COUNT(bench_engines); i++) {
+        if (!strcmp(bench_engines[i].name, name)) {
+            return &bench_engines[i];
+        }
+    }
+    return NULL;
+}
+
+
+/** @brief Prepare @p info for a parse of @p scn, copying its argv into
+ *      @p scratch, which must hold BENCH_MAXARG pointers. The copy keeps
+ *      the scenario intact across iterations whatever the parser does to its
+ *      argv array */
+static inline void bench_info(struct optinfo              *info,
+                              const struct bench_scenario *scn,
+                              char                        *scratch[])
+{
+    memcpy(scratch, scn->argv, sizeof *scratch * (size_t)scn->argc);
+    memset(info, 0, sizeof *info);
+    info->argc = scn->argc;
+    info->argv = scratch;
+    info->fstact = OPT_FIRST_SKIP;
+    info->endact = OPT_END_ALLOW;
+    info->errcb = bench_errcb;
+    info->poscb = bench_cb;
+}
+
+#endif /* BENCH_H */
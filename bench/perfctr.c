@@ -0,0 +1,445 @@
+/** @file perfctr.c hardware performance counter benchmark for opt_parse.
+ *
+ *  Build and run (Linux only):
+ *
+ *      cc -O2 -o perfctr bench/perfctr.c
+ *      ./perfctr [-n ITERATIONS] [-s SCENARIO] [-e ENGINE] [-l]
+ *
+ *  Each scenario from bench.h is parsed repeatedly while a perf_event_open(2)
+ *  counter group (cycles, instructions, branch misses, L1d/LLC read misses and
+ *  dTLB read misses) is sampled at the parser's own probe points. The cost is
+ *  split into the table build phase (absent for engines that sort in advance)
+ *  and one segment per dispatched argument, i.e. from the end of the previous
+ *  dispatch through lookup, argument collection and the (empty) callback.
+ *
+ *  Results are written to stdout as JSON lines, one object per segment, with
+ *  the mean over all iterations. Counters that cannot be opened (common in
+ *  containers and VMs, or with perf_event_paranoid > 2) are reported as null;
+ *  wall time is always available. When the kernel multiplexed the counters,
+ *  the counts are scaled up to the time enabled, as perf stat does, and the
+ *  segment has "multiplexed":true. The cost of sampling itself is reported as
+ *  the "overhead" segment and is *not* subtracted from the others.
+ */
+#define _GNU_SOURCE 1
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/* Route the parser's probe points to the sampler, see opt.h */
+#define OPT_PROBE_NOW() 0
+#define OPT_PROBE1(name, a)          PERF_PROBE_##name(a, 0)
+#define OPT_PROBE2(name, a, b)       PERF_PROBE_##name(a, b)
+#define OPT_PROBE3(name, a, b, c)    PERF_PROBE_##name(a, b)
+#define OPT_PROBE4(name, a, b, c, d) PERF_PROBE_##name(a, b)
+
+#define PERF_PROBE_parse__entry(a, b)   perf_mark(MARK_ENTRY, 0)
+#define PERF_PROBE_parse__return(a, b)  ((void)0)
+#define PERF_PROBE_build__start(a, b)   perf_mark(MARK_BUILD_START, 0)
+#define PERF_PROBE_build__done(a, b)    perf_mark(MARK_BUILD_DONE, 0)
+#define PERF_PROBE_find__hit(a, b)      ((void)0)
+#define PERF_PROBE_find__miss(a, b)     ((void)0)
+#define PERF_PROBE_arg__unget(a, b)     ((void)0)
+#define PERF_PROBE_call__entry(a, b)    ((void)0)
+#define PERF_PROBE_call__return(a, b)   perf_mark(MARK_CALL, (a))
+#define PERF_PROBE_error__entry(a, b)   ((void)0)
+#define PERF_PROBE_error__return(a, b)  perf_mark(MARK_ERROR, 0)
+
+enum markkind {
+    MARK_ENTRY,
+    MARK_BUILD_START,
+    MARK_BUILD_DONE,
+    MARK_CALL,
+    MARK_ERROR
+};
+
+static void perf_mark(enum markkind kind, int idx);
+
+#define OPT_IMPLEMENTATION 1
+#include "../opt.h"
+#include "bench.h"
+
+
+/** @brief A counter we would like to have */
+struct counter {
+    const char        *name;
+    unsigned           type;
+    unsigned long long config;
+};
+
+
+#define PERF_CACHE(id) (PERF_COUNT_HW_CACHE_##id \
+                     | PERF_COUNT_HW_CACHE_OP_READ << 8 \
+                     | PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+static const struct counter counters[] = {
+    { "cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES    },
+    { "instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS  },
+    { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "l1d_misses",    PERF_TYPE_HW_CACHE, PERF_CACHE(L1D)             },
+    { "llc_misses",    PERF_TYPE_HW_CACHE, PERF_CACHE(LL)              },
+    { "dtlb_misses",   PERF_TYPE_HW_CACHE, PERF_CACHE(DTLB)            }
+};
+
+#define NCOUNTER BENCH_COUNT(counters)
+#define MAX_MARKS 256
+
+
+/** @brief One sample of every counter */
+struct sample {
+    enum markkind      kind;
+    int                idx;
+    int                mux;     /* Counters were multiplexed, and scaled */
+    unsigned long long ns;
+    unsigned long long val[NCOUNTER];
+};
+
+
+/** @brief Sampler state */
+static struct {
+    int           leader;           /* Group leader fd or -1 */
+    int           fd[NCOUNTER];     /* Counter fds, -1 if unavailable */
+    unsigned      slot[NCOUNTER];   /* Position of each counter in a read */
+    unsigned      nopen;            /* Counters in the group */
+    unsigned      nmark;            /* Samples taken this iteration */
+    struct sample mark[MAX_MARKS];
+} perf;
+
+
+static long perf_event_open(struct perf_event_attr *attr, int group)
+{
+    return syscall(SYS_perf_event_open, attr, 0, -1, group, 0);
+}
+
+
+/** @brief Open as many counters as the host allows into one group */
+static void perf_open(void)
+{
+    struct perf_event_attr attr;
+    unsigned i;
+    int fd;
+
+    perf.leader = -1;
+    for (i = 0; i < NCOUNTER; i++) {
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = counters[i].type;
+        attr.config = counters[i].config;
+        attr.disabled = perf.leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP
+                         | PERF_FORMAT_TOTAL_TIME_ENABLED
+                         | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fd = (int)perf_event_open(&attr, perf.leader);
+        perf.fd[i] = fd;
+        if (fd < 0) {
+            fprintf(stderr, "perfctr: %s unavailable: %s\n",
+                    counters[i].name, strerror(errno));
+            continue;
+        }
+        if (perf.leader < 0) {
+            perf.leader = fd;
+        }
+        perf.slot[i] = perf.nopen++;
+    }
+    if (perf.leader >= 0) {
+        ioctl(perf.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(perf.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+
+/** @brief Take a sample. Counters that were multiplexed off the PMU for part
+ *      of the time are scaled up to the time enabled, as perf stat does, and
+ *      the sample is flagged. Counters that were off for the whole time are
+ *      lost, so they are marked unavailable */
+static void perf_mark(enum markkind kind, int idx)
+{
+    unsigned long long buf[3 + NCOUNTER];
+    struct sample *smp;
+    unsigned i;
+
+    if (perf.nmark == MAX_MARKS) {
+        return;
+    }
+    smp = &perf.mark[perf.nmark++];
+    smp->kind = kind;
+    smp->idx = idx;
+    smp->mux = 0;
+    if (perf.leader >= 0 && read(perf.leader, buf, sizeof buf) > 0) {
+        /* buf[1] is the time enabled, buf[2] the time running */
+        smp->mux = buf[2] && buf[2] < buf[1];
+        for (i = 0; i < NCOUNTER; i++) {
+            smp->val[i] = perf.fd[i] >= 0 ? buf[3 + perf.slot[i]] : 0;
+            if (smp->mux) {
+                smp->val[i] = (unsigned long long)((double)smp->val[i]
+                                                   * buf[1] / buf[2]);
+            }
+        }
+        if (!buf[2]) {
+            fprintf(stderr, "perfctr: counter group never scheduled\n");
+            for (i = 0; i < NCOUNTER; i++) {
+                perf.fd[i] = -1;
+            }
+        }
+    }
+    smp->ns = bench_now();
+}
+
+
+/** @brief Accumulated deltas for one segment */
+struct segment {
+    enum markkind      kind;
+    int                idx;
+    int                mux;     /* Some sample was multiplexed */
+    unsigned long long ns;
+    unsigned long long val[NCOUNTER];
+};
+
+
+/** @brief Add the difference of @p b and @p a to @p seg */
+static void segment_add(struct segment      *seg,
+                        const struct sample *a,
+                        const struct sample *b)
+{
+    unsigned i;
+
+    seg->kind = b->kind;
+    seg->idx = b->idx;
+    seg->mux |= a->mux | b->mux;
+    seg->ns += b->ns - a->ns;
+    for (i = 0; i < NCOUNTER; i++) {
+        seg->val[i] += b->val[i] - a->val[i];
+    }
+}
+
+
+/** @brief Write one JSON line */
+static void segment_print(const char           *engine,
+                          const char           *scenario,
+                          const char           *phase,
+                          int                   event,
+                          const struct segment *seg,
+                          unsigned long         iters)
+{
+    unsigned i;
+
+    printf("{\"engine\":\"%s\",\"scenario\":\"%s\",\"phase\":\"%s\"",
+           engine, scenario, phase);
+    if (event >= 0) {
+        printf(",\"event\":%d,\"idx\":%d", event, seg->idx);
+    }
+    printf(",\"iterations\":%lu,\"ns\":%.1f", iters, (double)seg->ns / iters);
+    for (i = 0; i < NCOUNTER; i++) {
+        if (perf.fd[i] >= 0) {
+            printf(",\"%s\":%.1f", counters[i].name,
+                   (double)seg->val[i] / iters);
+        } else {
+            printf(",\"%s\":null", counters[i].name);
+        }
+    }
+    if (seg->mux) {
+        printf(",\"multiplexed\":true");
+    }
+    printf("}\n");
+}
+
+
+/** @brief Benchmark the cost of sampling itself */
+static void run_overhead(unsigned long iters)
+{
+    struct segment seg;
+    unsigned long n;
+
+    memset(&seg, 0, sizeof seg);
+    for (n = 0; n < iters; n++) {
+        perf.nmark = 0;
+        perf_mark(MARK_CALL, -1);
+        perf_mark(MARK_CALL, -1);
+        segment_add(&seg, &perf.mark[0], &perf.mark[1]);
+    }
+    segment_print("-", "-", "overhead", -1, &seg, iters);
+}
+
+
+/** @brief Benchmark one engine against one scenario */
+static void run(const struct bench_engine   *eng,
+                const struct bench_scenario *scn,
+                unsigned long                iters)
+{
+    struct segment build, args[MAX_MARKS];
+    char *scratch[BENCH_MAXARG];
+    struct optinfo info;
+    unsigned long n, nbuild = 0;
+    unsigned i, first, nseg = 0;
+
+    memset(&build, 0, sizeof build);
+    memset(args, 0, sizeof args);
+    for (n = 0; n < iters; n++) {
+        bench_info(&info, scn, scratch);
+        perf.nmark = 0;
+        eng->parse(&info, scn->nopt, scn->opts);
+        /* The table is built before the parse (prebuilt), or within it
+         * (opt_parse), and dispatch starts from the end of either */
+        first = 0;
+        if (perf.nmark > 2 && perf.mark[0].kind == MARK_BUILD_START) {
+            segment_add(&build, &perf.mark[0], &perf.mark[1]);
+            nbuild++;
+            first = 2;
+        }
+        if (first >= perf.nmark || perf.mark[first].kind != MARK_ENTRY) {
+            fprintf(stderr, "perfctr: %s: no parse entry\n", eng->name);
+            return;
+        }
+        if (first + 2 < perf.nmark
+         && perf.mark[first + 1].kind == MARK_BUILD_START) {
+            segment_add(&build, &perf.mark[first + 1], &perf.mark[first + 2]);
+            nbuild++;
+            first += 2;
+        }
+        for (i = first + 1; i < perf.nmark; i++) {
+            segment_add(&args[i - first - 1], &perf.mark[i - 1], &perf.mark[i]);
+        }
+        nseg = perf.nmark - first - 1;
+    }
+    if (nbuild) {
+        segment_print(eng->name, scn->name, "build", -1, &build, nbuild);
+    }
+    for (i = 0; i < nseg; i++) {
+        segment_print(eng->name, scn->name,
+                      args[i].kind == MARK_ERROR ? "error" : "dispatch",
+                      (int)i, &args[i], iters);
+    }
+}
+
+
+/** @brief Command line of the harness itself */
+static struct {
+    unsigned long iters;
+    const char   *scenario;
+    const char   *engine;
+    int           list;
+} cfg = { 100000, NULL, NULL, 0 };
+
+
+static int cfg_iters(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    if (count) {
+        cfg.iters = strtoul(args[0], NULL, 10);
+    }
+    return !count || !cfg.iters;
+}
+
+
+static int cfg_scenario(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    cfg.scenario = count ? args[0] : NULL;
+    return !count;
+}
+
+
+static int cfg_engine(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    cfg.engine = count ? args[0] : NULL;
+    return !count;
+}
+
+
+static int cfg_list(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)count;
+    (void)args;
+    (void)data;
+    cfg.list = 1;
+    return 0;
+}
+
+
+static int cfg_error(int type, char shrt, char *lng, void *data)
+{
+    (void)data;
+    if (type) {
+        fprintf(stderr, "perfctr: unknown option --%s\n", lng);
+    } else {
+        fprintf(stderr, "perfctr: unknown option -%c\n", shrt);
+    }
+    return 1;
+}
+
+
+static int cfg_positional(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    if (count) {
+        fprintf(stderr, "perfctr: unexpected argument %s\n", args[0]);
+    }
+    return count != 0;
+}
+
+
+static const struct optspec cfg_opts[] = {
+    { 'n', "iterations", 1, cfg_iters    },
+    { 's', "scenario",   1, cfg_scenario },
+    { 'e', "engine",     1, cfg_engine   },
+    { 'l', "list",       0, cfg_list     }
+};
+
+
+int main(int argc, char *argv[])
+{
+    struct optinfo info = {
+        0, NULL, OPT_FIRST_SKIP, OPT_END_ALLOW, cfg_error, cfg_positional, NULL
+    };
+    unsigned e, s;
+
+    info.argc = argc;
+    info.argv = argv;
+    if (opt_parse(&info, BENCH_COUNT(cfg_opts), cfg_opts)) {
+        fprintf(stderr, "usage: %s [-n ITERATIONS] [-s SCENARIO] "
+                        "[-e ENGINE] [-l]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (cfg.list) {
+        for (e = 0; e < BENCH_COUNT(bench_engines); e++) {
+            printf("engine %s\n", bench_engines[e].name);
+        }
+        for (s = 0; s < BENCH_COUNT(bench_scenarios); s++) {
+            printf("scenario %s\n", bench_scenarios[s].name);
+        }
+        return EXIT_SUCCESS;
+    }
+    if ((cfg.scenario && !bench_scenario(cfg.scenario))
+     || (cfg.engine && !bench_engine(cfg.engine))) {
+        fprintf(stderr, "perfctr: unknown scenario or engine, see -l\n");
+        return EXIT_FAILURE;
+    }
+    perf_open();
+    run_overhead(cfg.iters);
+    for (e = 0; e < BENCH_COUNT(bench_engines); e++) {
+        if (cfg.engine && strcmp(cfg.engine, bench_engines[e].name)) {
+            continue;
+        }
+        for (s = 0; s < BENCH_COUNT(bench_scenarios); s++) {
+            if (cfg.scenario && strcmp(cfg.scenario, bench_scenarios[s].name)) {
+                continue;
+            }
+            run(&bench_engines[e], &bench_scenarios[s], cfg.iters);
+        }
+    }
+    return EXIT_SUCCESS;
+}
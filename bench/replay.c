@@ -0,0 +1,304 @@
+/** @file replay.c replay a captured argv corpus against an option table.
+ *
+ *  Capture a corpus by building a tool with -DOPT_USE_CAPTURE=1 and running it
+ *  with OPT_CAPTURE=/path/to/corpus in its environment, then:
+ *
+ *      cc -O2 -o replay bench/replay.c
+ *      ./replay [-r PASSES] [-e ENGINE] CORPUS
+ *
+ *  The table defaults to the large table from bench.h. To replay against the
+ *  real table of a tool, put it in a header as
+ *
+ *      static const struct optspec replay_opts[] = { ... };
+ *
+ *  with every callback set to bench_cb, and build with
+ *  -DREPLAY_TABLE='"that_header.h"'.
+ *
+ *  Every record is parsed PASSES times under every engine in bench.h. For each
+ *  engine one JSON line reports the throughput of back-to-back parses and the
+ *  distribution of individually timed parses (which include the cost of
+ *  reading the clock, about 20 ns on most hosts).
+ *
+ *  To compare batched long option lookups, build a second replay with
+ *  -DOPT_BATCH_LEN=16 and run both. Its engines are named for it, e.g.
+ *  "prebuilt/batch16".
+ */
+#define _GNU_SOURCE 1
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OPT_IMPLEMENTATION 1
+#include "../opt.h"
+#include "bench.h"
+
+#ifdef REPLAY_TABLE
+#   include REPLAY_TABLE
+#else
+#   define replay_opts bench_large
+#endif
+
+
+/** @brief A loaded corpus */
+struct corpus {
+    char         *buf;      /* The whole file */
+    size_t        nrec;     /* Record count */
+    int          *argc;     /* Cmdarg count of each record */
+    char       ***argv;     /* Cmdargs of each record */
+    unsigned long nargs;    /* Total cmdargs */
+    int           maxargc;  /* Largest record */
+};
+
+
+/** @brief Read the whole of @p path */
+static char *slurp(const char *path, size_t *len)
+{
+    FILE *fp = fopen(path, "rb");
+    char *buf = NULL, *tmp;
+    size_t cap = 0, n;
+
+    *len = 0;
+    if (!fp) {
+        return NULL;
+    }
+    do {
+        if (*len == cap) {
+            cap = cap ? cap * 2 : 1 << 16;
+            if (!(tmp = (char *)realloc(buf, cap))) {
+                free(buf);
+                fclose(fp);
+                return NULL;
+            }
+            buf = tmp;
+        }
+        n = fread(buf + *len, 1, cap - *len, fp);
+        *len += n;
+    } while (n);
+    fclose(fp);
+    return buf;
+}
+
+
+/** @brief Split the records of a capture file. Truncated trailing records
+ *      (from a capture that is still being written) are ignored, and so are
+ *      corrupt records, whose last string is not NUL-terminated */
+static int corpus_load(struct corpus *cp, const char *path)
+{
+    const unsigned char *p;
+    const char *str, *nul;
+    size_t len, pos, reclen, i, rec = 0, bad = 0;
+    char **argv;
+    int argc;
+
+    memset(cp, 0, sizeof *cp);
+    if (!(cp->buf = slurp(path, &len))) {
+        return -1;
+    }
+    /* Count, allocate, then fill */
+    for (pos = 0; pos + 4 <= len; pos += 4 + reclen) {
+        p = (const unsigned char *)cp->buf + pos;
+        reclen = (size_t)p[0] | (size_t)p[1] << 8 | (size_t)p[2] << 16
+               | (size_t)p[3] << 24;
+        if (pos + 4 + reclen > len) {
+            break;
+        } else if (reclen && p[4 + reclen - 1]) {
+            bad++;
+            continue;
+        }
+        cp->nrec++;
+        for (i = 0; i < reclen; i++) {
+            cp->nargs += !p[4 + i];
+        }
+    }
+    cp->argc = (int *)calloc(cp->nrec + 1, sizeof *cp->argc);
+    cp->argv = (char ***)calloc(cp->nrec + 1, sizeof *cp->argv);
+    argv = (char **)calloc(cp->nargs + 1, sizeof *argv);
+    if (!cp->argc || !cp->argv || !argv) {
+        return -1;
+    }
+    if (bad) {
+        fprintf(stderr, "replay: %s: skipped %lu corrupt records\n", path,
+                (unsigned long)bad);
+    }
+    for (pos = 0; rec < cp->nrec; pos += 4 + reclen) {
+        p = (const unsigned char *)cp->buf + pos;
+        reclen = (size_t)p[0] | (size_t)p[1] << 8 | (size_t)p[2] << 16
+               | (size_t)p[3] << 24;
+        if (reclen && p[4 + reclen - 1]) {
+            continue;
+        }
+        cp->argv[rec] = argv;
+        for (argc = 0, i = 0; i < reclen; argc++) {
+            /* Found within the record, as its last byte is a NUL */
+            str = cp->buf + pos + 4 + i;
+            nul = (const char *)memchr(str, '\0', reclen - i);
+            *argv++ = cp->buf + pos + 4 + i;
+            i += (size_t)(nul - str) + 1;
+        }
+        cp->argc[rec++] = argc;
+        cp->maxargc = argc > cp->maxargc ? argc : cp->maxargc;
+    }
+    return 0;
+}
+
+
+/** @brief Prepare @p info for a parse of record @p rec of @p cp */
+static void replay_info(struct optinfo      *info,
+                        const struct corpus *cp,
+                        size_t               rec,
+                        char                *scratch[])
+{
+    memcpy(scratch, cp->argv[rec], sizeof *scratch * (size_t)cp->argc[rec]);
+    memset(info, 0, sizeof *info);
+    info->argc = cp->argc[rec];
+    info->argv = scratch;
+    info->fstact = OPT_FIRST_SKIP;
+    info->endact = OPT_END_ALLOW;
+    info->errcb = bench_errcb;
+    info->poscb = bench_cb;
+}
+
+
+/** @brief Replay @p cp @p passes times through @p eng */
+static int replay(const struct bench_engine *eng,
+                  const struct corpus       *cp,
+                  unsigned long              passes)
+{
+    const unsigned nopt = BENCH_COUNT(replay_opts);
+    unsigned long long t0, t1, *lat;
+    size_t rec, nsmp = 0;
+    unsigned long pass;
+    struct optinfo info;
+    char **scratch;
+
+    lat = (unsigned long long *)calloc(cp->nrec * passes + 1, sizeof *lat);
+    scratch = (char **)calloc((size_t)cp->maxargc + 1, sizeof *scratch);
+    if (!lat || !scratch) {
+        free(lat);
+        free(scratch);
+        return -1;
+    }
+    /* Throughput: back to back */
+    t0 = bench_now();
+    for (pass = 0; pass < passes; pass++) {
+        for (rec = 0; rec < cp->nrec; rec++) {
+            replay_info(&info, cp, rec, scratch);
+            eng->parse(&info, nopt, replay_opts);
+        }
+    }
+    t1 = bench_now();
+    /* Latency: one clock pair per parse */
+    for (pass = 0; pass < passes; pass++) {
+        for (rec = 0; rec < cp->nrec; rec++) {
+            replay_info(&info, cp, rec, scratch);
+            lat[nsmp] = bench_now();
+            eng->parse(&info, nopt, replay_opts);
+            lat[nsmp] = bench_now() - lat[nsmp];
+            nsmp++;
+        }
+    }
+    bench_sort(lat, nsmp);
+    printf("{\"engine\":\"%s\",\"records\":%lu,\"args\":%lu,\"passes\":%lu"
+           ",\"parses_per_s\":%.0f,\"args_per_s\":%.0f",
+           eng->name, (unsigned long)cp->nrec, cp->nargs, passes,
+           nsmp / ((t1 - t0) / 1e9), cp->nargs * passes / ((t1 - t0) / 1e9));
+    printf(",\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu"
+           ",\"p999_ns\":%llu,\"max_ns\":%llu}\n",
+           bench_pct(lat, nsmp, 50.0), bench_pct(lat, nsmp, 90.0),
+           bench_pct(lat, nsmp, 99.0), bench_pct(lat, nsmp, 99.9),
+           nsmp ? lat[nsmp - 1] : 0);
+    free(lat);
+    free(scratch);
+    return 0;
+}
+
+
+/** @brief Command line of the benchmark itself */
+static struct {
+    unsigned long passes;
+    const char   *engine;
+    const char   *corpus;
+} cfg = { 10, NULL, NULL };
+
+
+static int cfg_passes(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    if (count) {
+        cfg.passes = strtoul(args[0], NULL, 10);
+    }
+    return !count || !cfg.passes;
+}
+
+
+static int cfg_engine(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    cfg.engine = count ? args[0] : NULL;
+    return !count;
+}
+
+
+static int cfg_error(int type, char shrt, char *lng, void *data)
+{
+    (void)data;
+    if (type) {
+        fprintf(stderr, "replay: unknown option --%s\n", lng);
+    } else {
+        fprintf(stderr, "replay: unknown option -%c\n", shrt);
+    }
+    return 1;
+}
+
+
+static int cfg_positional(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    cfg.corpus = count == 1 ? args[0] : NULL;
+    return count != 1;
+}
+
+
+static const struct optspec cfg_opts[] = {
+    { 'r', "passes", 1, cfg_passes },
+    { 'e', "engine", 1, cfg_engine }
+};
+
+
+int main(int argc, char *argv[])
+{
+    struct optinfo info = {
+        0, NULL, OPT_FIRST_SKIP, OPT_END_ALLOW, cfg_error, cfg_positional, NULL
+    };
+    struct corpus cp;
+    unsigned e;
+
+    info.argc = argc;
+    info.argv = argv;
+    if (opt_parse(&info, BENCH_COUNT(cfg_opts), cfg_opts) || !cfg.corpus) {
+        fprintf(stderr, "usage: %s [-r PASSES] [-e ENGINE] CORPUS\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (cfg.engine && !bench_engine(cfg.engine)) {
+        fprintf(stderr, "replay: unknown engine %s\n", cfg.engine);
+        return EXIT_FAILURE;
+    }
+    if (corpus_load(&cp, cfg.corpus)) {
+        fprintf(stderr, "replay: %s: %s\n", cfg.corpus, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    for (e = 0; e < BENCH_COUNT(bench_engines); e++) {
+        if (cfg.engine && strcmp(cfg.engine, bench_engines[e].name)) {
+            continue;
+        }
+        if (replay(&bench_engines[e], &cp, cfg.passes)) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#!/bin/sh
+# size.sh: compile-time and binary size budget suite for opt.h.
+#
+#   CC=cc CXX=c++ REPEAT=5 bench/size.sh [-c BUDGET]
+#
+# Builds size_opt.c in each representative configuration, and size_getopt.c
+# as the getopt_long(3) baseline, at -O2 and -Os. For each it reports as
+# tab-separated values:
+#
+#   config      configuration name
+#   opt         optimization level
+#   compile_ms  median wall time of REPEAT compiles to an object
+#   obj_text    text size of the object (size(1), Berkeley format)
+#   bin_text    text size of the linked executable, with unused functions
+#               removed by --gc-sections as in a size-conscious build
+#   vs_getopt   obj_text minus the getopt baseline's at the same level
+#   stack       largest stack frame among the opt_* functions in bytes, with a
+#               trailing + when it is dynamically sized (-fstack-usage)
+#   libc        undefined symbols in the object, i.e. C library dependencies
+#
+# With -c, every row is also checked against the BUDGET file, whose lines are
+# "config opt max_obj_text" (# starts a comment). The script then exits with
+# status 1 if anything is over budget.
+set -eu
+
+CC=${CC:-cc}
+CXX=${CXX:-c++}
+REPEAT=${REPEAT:-5}
+
+budget=
+if [ $# -eq 2 ] && [ "$1" = -c ]; then
+    budget=$2
+elif [ $# -ne 0 ]; then
+    echo "usage: $0 [-c BUDGET]" >&2
+    exit 2
+fi
+
+here=$(cd "$(dirname "$0")" && pwd)
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+# name, compiler, source, flags
+configs="
+getopt|$CC|size_getopt.c|
+include|$CC|size_opt.c|-DSIZE_HEADER_ONLY=1
+alloca|$CC|size_opt.c|
+vla|$CC|size_opt.c|-DOPT_USE_ALLOCA=0
+fixed|$CC|size_opt.c|-DOPT_USE_ALLOCA=0 -DOPT_USE_VLAS=0
+tbl|$CC|size_opt.c|-DOPT_TBL_LEN=16
+capture|$CC|size_opt.c|-DOPT_USE_CAPTURE=1
+free|$CC|size_opt.c|-DOPT_FREESTANDING=1
+rom|$CC|size_opt.c|-DOPT_FREESTANDING=1 -DSIZE_ROM=1
+cxx|$CXX|size_opt.c|-x c++
+"
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+text() {
+    size -B "$1" | awk 'NR == 2 { print $1 }'
+}
+
+stack() {
+    awk -F '\t' '$1 ~ /[: ]opt_[a-z_]*[ (]?/ {
+        if ($2 > max) max = $2
+        if ($3 !~ /^static/) dyn = "+"
+    } END { print (max ? max : 0) dyn }' "$1"
+}
+
+median() {
+    sort -n | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }'
+}
+
+status=0
+printf 'config\topt\tcompile_ms\tobj_text\tbin_text\tvs_getopt\tstack\tlibc\n'
+for opt in -O2 -Os; do
+    base=
+    echo "$configs" | while IFS='|' read -r name cc src flags; do
+        [ -n "$name" ] || continue
+        obj=$out/$name$opt.o
+        i=0
+        while [ $i -lt "$REPEAT" ]; do
+            t0=$(now_ms)
+            # shellcheck disable=SC2086
+            $cc $opt $flags -ffunction-sections -c -o "$obj" "$here/$src"
+            t1=$(now_ms)
+            echo $((t1 - t0))
+            i=$((i + 1))
+        done > "$out/times"
+        ms=$(median < "$out/times")
+        # shellcheck disable=SC2086
+        (cd "$out" && $cc $opt $flags -fstack-usage -c -o su.o "$here/$src")
+        stk=$(stack "$out/su.su")
+        undef=$(nm -u "$obj" | grep -vc '^ *w ' || true)
+        case $cc in
+        "$CXX") $CXX -Wl,--gc-sections -o "$out/$name$opt" "$obj" ;;
+        *)      $CC -Wl,--gc-sections -o "$out/$name$opt" "$obj" ;;
+        esac
+        otext=$(text "$obj")
+        btext=$(text "$out/$name$opt")
+        if [ "$name" = getopt ]; then
+            base=$otext
+        fi
+        printf '%s\t%s\t%s\t%s\t%s\t%+d\t%s\t%s\n' "$name" "$opt" "$ms" \
+               "$otext" "$btext" $((otext - base)) "$stk" "$undef"
+        if [ -n "$budget" ]; then
+            max=$(awk -v c="$name" -v o="$opt" \
+                  '!/^#/ && $1 == c && $2 == o { print $3 }' "$budget")
+            if [ -n "$max" ] && [ "$otext" -gt "$max" ]; then
+                echo "size.sh: $name $opt: $otext > $max bytes" >&2
+                echo over >> "$out/over"
+            fi
+        fi
+    done
+done
+if [ -s "$out/over" ]; then
+    status=1
+fi
+exit $status
@@ -0,0 +1,58 @@
+/** @file size_getopt.c the size_opt.c tool written with getopt_long(3).
+ *
+ *  Baseline for the size budget suite, see size.sh.
+ */
+#define _GNU_SOURCE 1
+
+#include <getopt.h>
+#include <stddef.h>
+
+
+static struct {
+    const char *output;
+    const char *seed;
+    const char *count;
+    int         verbose;
+    int         dry_run;
+    unsigned    npos;
+} cfg;
+
+
+static const struct option opts[] = {
+    { "output",  required_argument, NULL, 'o' },
+    { "seed",    required_argument, NULL, 's' },
+    { "count",   required_argument, NULL, 'n' },
+    { "verbose", no_argument,       NULL, 'v' },
+    { "dry-run", no_argument,       NULL, 'D' },
+    { NULL,      0,                 NULL, 0   }
+};
+
+
+int main(int argc, char *argv[])
+{
+    int c;
+
+    while ((c = getopt_long(argc, argv, "+o:s:n:v", opts, NULL)) != -1) {
+        switch (c) {
+        case 'o':
+            cfg.output = optarg;
+            break;
+        case 's':
+            cfg.seed = optarg;
+            break;
+        case 'n':
+            cfg.count = optarg;
+            break;
+        case 'v':
+            cfg.verbose++;
+            break;
+        case 'D':
+            cfg.dry_run = 1;
+            break;
+        default:
+            return 2;
+        }
+    }
+    cfg.npos = (unsigned)(argc - optind);
+    return (int)cfg.npos + cfg.verbose;
+}
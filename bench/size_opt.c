@@ -0,0 +1,139 @@
+/** @file size_opt.c representative small tool for the size budget suite.
+ *
+ *  A typical table of a handful of options whose callbacks only store their
+ *  arguments. See size.sh, and size_getopt.c for the same tool written with
+ *  getopt_long(3). With -DSIZE_HEADER_ONLY=1 this only #includes opt.h, which
+ *  is the cost paid by every translation unit that uses the declarations. With
+ *  -DSIZE_ROM=1 it uses a constant index, as generated by tools/optgen.c, and
+ *  opt_parse_tbl.
+ */
+#if !defined(SIZE_HEADER_ONLY) || !SIZE_HEADER_ONLY
+#   define OPT_IMPLEMENTATION 1
+#endif
+#include "../opt.h"
+
+#if !defined(SIZE_HEADER_ONLY) || !SIZE_HEADER_ONLY
+
+static struct {
+    const char *output;
+    const char *seed;
+    const char *count;
+    int         verbose;
+    int         dry_run;
+    unsigned    npos;
+} cfg;
+
+
+static int set_output(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    cfg.output = count ? args[0] : NULL;
+    return !count;
+}
+
+
+static int set_seed(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    cfg.seed = count ? args[0] : NULL;
+    return !count;
+}
+
+
+static int set_count(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    cfg.count = count ? args[0] : NULL;
+    return !count;
+}
+
+
+static int set_flag(int idx, unsigned count, char *args[], void *data)
+{
+    (void)count;
+    (void)args;
+    (void)data;
+    if (idx == 3) {
+        cfg.verbose++;
+    } else {
+        cfg.dry_run = 1;
+    }
+    return 0;
+}
+
+
+static int positional(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)args;
+    (void)data;
+    cfg.npos = count;
+    return 0;
+}
+
+
+static int error(int type, char shrt, char *lng, void *data)
+{
+    (void)type;
+    (void)shrt;
+    (void)lng;
+    (void)data;
+    return 1;
+}
+
+
+static const struct optspec opts[] = {
+    { 'o', "output",  1, set_output },
+    { 's', "seed",    1, set_seed   },
+    { 'n', "count",   1, set_count  },
+    { 'v', "verbose", 0, set_flag   },
+    { 0,   "dry-run", 0, set_flag   }
+};
+
+
+#if defined(SIZE_ROM) && SIZE_ROM
+static const struct optspec *const opts_shrt[] = {
+    &opts[2], &opts[0], &opts[1], &opts[3]
+};
+
+static const struct optspec *const opts_lng[] = {
+    &opts[2], &opts[4], &opts[0], &opts[1], &opts[3]
+};
+
+static const struct opttbl opts_tbl = {
+    5, 4, 5, opts, opts_shrt, opts_lng
+};
+#endif
+
+
+int main(int argc, char *argv[])
+{
+    struct optinfo info = {
+        0, NULL, OPT_FIRST_SKIP, OPT_END_ALLOW, error, positional, NULL
+    };
+
+    info.argc = argc;
+    info.argv = argv;
+#if defined(SIZE_ROM) && SIZE_ROM
+    if (opt_parse_tbl(&info, &opts_tbl)) {
+        return 2;
+    }
+#else
+    if (opt_parse(&info, sizeof opts / sizeof *opts, opts)) {
+        return 2;
+    }
+#endif
+    return (int)cfg.npos + cfg.verbose;
+}
+
+#else
+
+int main(void)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,242 @@
+/** @file startup.c process-level startup latency benchmark.
+ *
+ *  Build and run (POSIX):
+ *
+ *      cc -O2 -o startup bench/startup.c
+ *      ./startup [-n RUNS] BINARY... [-- ARG...]
+ *
+ *  Each BINARY (normally a build of startup_child.c, see startup.sh) is
+ *  posix_spawn(3)ed RUNS times, round-robin so that drift affects every binary
+ *  alike. The child writes a CLOCK_MONOTONIC timestamp to fd 3 as soon as
+ *  opt_parse returns. The latency is measured from just before posix_spawn(3)
+ *  to that timestamp, so it covers exec, dynamic linking, libc start-up and the
+ *  parse itself. Page faults and peak RSS come from wait4(2) and cover the
+ *  whole life of the child.
+ *
+ *  The children are given the ARGs after "--", or a short default command
+ *  line. Results are written to stdout as one JSON line per binary. Runs
+ *  whose child failed are counted as "failed" and left out of the latency
+ *  and fault statistics.
+ */
+#define _GNU_SOURCE 1
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define OPT_IMPLEMENTATION 1
+#include "../opt.h"
+#include "bench.h"
+
+
+extern char **environ;
+
+
+/** @brief Measurements of one binary */
+struct child {
+    char               *path;
+    unsigned long long *lat;    /* Latency samples (ns) */
+    unsigned long long *minflt; /* Minor faults per run */
+    unsigned long long  majflt; /* Total major faults */
+    long                maxrss; /* Largest peak RSS (KiB) */
+    unsigned long       nok;    /* Successful runs, and samples */
+    unsigned long       fail;   /* Failed runs, which have no samples */
+};
+
+
+/** @brief Spawn @p ch once and record the result as its next sample */
+static int child_run(struct child *ch, char *argv[])
+{
+    posix_spawn_file_actions_t fa;
+    unsigned long long t0, t1;
+    struct rusage ru;
+    int fd[2], status, res;
+    pid_t pid;
+    ssize_t len;
+
+    if (pipe(fd)) {
+        return -1;
+    }
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addclose(&fa, fd[0]);
+    posix_spawn_file_actions_adddup2(&fa, fd[1], 3);
+    argv[0] = ch->path;
+    t0 = bench_now();
+    res = posix_spawn(&pid, ch->path, &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    close(fd[1]);
+    if (res) {
+        close(fd[0]);
+        errno = res;
+        return -1;
+    }
+    do {
+        len = read(fd[0], &t1, sizeof t1);
+    } while (len < 0 && errno == EINTR);
+    close(fd[0]);
+    while (wait4(pid, &status, 0, &ru) < 0 && errno == EINTR) {
+        ;
+    }
+    if (len != sizeof t1 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        /* Not a latency at all, so kept out of the percentiles */
+        ch->fail++;
+        return 0;
+    }
+    ch->lat[ch->nok] = t1 - t0;
+    ch->minflt[ch->nok++] = (unsigned long long)ru.ru_minflt;
+    ch->majflt += (unsigned long long)ru.ru_majflt;
+    ch->maxrss = ru.ru_maxrss > ch->maxrss ? ru.ru_maxrss : ch->maxrss;
+    return 0;
+}
+
+
+/** @brief Write the JSON line for @p ch. The statistics cover the
+ *      successful runs only, and are null if there were none */
+static void child_report(struct child *ch)
+{
+    const char *name = strrchr(ch->path, '/');
+    unsigned long runs = ch->nok;
+
+    printf("{\"binary\":\"%s\",\"runs\":%lu,\"failed\":%lu", name ? name + 1
+           : ch->path, runs + ch->fail, ch->fail);
+    if (!runs) {
+        printf(",\"p50_us\":null,\"p90_us\":null,\"p99_us\":null,"
+               "\"p999_us\":null,\"max_us\":null,\"minflt_p50\":null,"
+               "\"minflt_max\":null,\"majflt\":%llu,\"maxrss_kib\":%ld}\n",
+               ch->majflt, ch->maxrss);
+        return;
+    }
+    bench_sort(ch->lat, runs);
+    bench_sort(ch->minflt, runs);
+    printf(",\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,"
+           "\"p999_us\":%.1f,\"max_us\":%.1f",
+           bench_pct(ch->lat, runs, 50.0) / 1e3,
+           bench_pct(ch->lat, runs, 90.0) / 1e3,
+           bench_pct(ch->lat, runs, 99.0) / 1e3,
+           bench_pct(ch->lat, runs, 99.9) / 1e3,
+           ch->lat[runs - 1] / 1e3);
+    printf(",\"minflt_p50\":%llu,\"minflt_max\":%llu,\"majflt\":%llu"
+           ",\"maxrss_kib\":%ld}\n",
+           bench_pct(ch->minflt, runs, 50.0), ch->minflt[runs - 1],
+           ch->majflt, ch->maxrss);
+}
+
+
+/** @brief Command line of the driver itself */
+static struct {
+    unsigned long runs;
+    unsigned      nbin;
+    char        **bin;
+    unsigned      nargs;
+    char        **args;
+} cfg = { 2000, 0, NULL, 0, NULL };
+
+
+static int cfg_runs(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    if (count) {
+        cfg.runs = strtoul(args[0], NULL, 10);
+    }
+    return !count || !cfg.runs;
+}
+
+
+static int cfg_error(int type, char shrt, char *lng, void *data)
+{
+    (void)data;
+    if (type) {
+        fprintf(stderr, "startup: unknown option --%s\n", lng);
+    } else {
+        fprintf(stderr, "startup: unknown option -%c\n", shrt);
+    }
+    return 1;
+}
+
+
+/** @brief Split the positional arguments at "--" into binaries and child
+ *      arguments */
+static int cfg_positional(int idx, unsigned count, char *args[], void *data)
+{
+    unsigned i;
+
+    (void)idx;
+    (void)data;
+    for (i = 0; i < count && strcmp(args[i], "--"); i++) {
+        ;
+    }
+    cfg.nbin = i;
+    cfg.bin = args;
+    if (i < count) {
+        cfg.nargs = count - i - 1;
+        cfg.args = args + i + 1;
+    }
+    return !cfg.nbin;
+}
+
+
+static const struct optspec cfg_opts[] = {
+    { 'n', "runs", 1, cfg_runs }
+};
+
+
+static char *default_args[] = {
+    "-v", "--jobs", "4", "--output", "out", "-q", "input"
+};
+
+
+int main(int argc, char *argv[])
+{
+    struct optinfo info = {
+        0, NULL, OPT_FIRST_SKIP, OPT_END_ALLOW, cfg_error, cfg_positional, NULL
+    };
+    struct child *ch;
+    char **cargv;
+    unsigned long run;
+    unsigned i;
+
+    info.argc = argc;
+    info.argv = argv;
+    if (opt_parse(&info, BENCH_COUNT(cfg_opts), cfg_opts) || !cfg.nbin) {
+        fprintf(stderr, "usage: %s [-n RUNS] BINARY... [-- ARG...]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!cfg.args) {
+        cfg.nargs = BENCH_COUNT(default_args);
+        cfg.args = default_args;
+    }
+    cargv = calloc(cfg.nargs + 2, sizeof *cargv);
+    ch = calloc(cfg.nbin, sizeof *ch);
+    if (!cargv || !ch) {
+        return EXIT_FAILURE;
+    }
+    memcpy(cargv + 1, cfg.args, cfg.nargs * sizeof *cargv);
+    for (i = 0; i < cfg.nbin; i++) {
+        ch[i].path = cfg.bin[i];
+        ch[i].lat = calloc(cfg.runs, sizeof *ch[i].lat);
+        ch[i].minflt = calloc(cfg.runs, sizeof *ch[i].minflt);
+        if (!ch[i].lat || !ch[i].minflt) {
+            return EXIT_FAILURE;
+        }
+    }
+    for (run = 0; run < cfg.runs; run++) {
+        for (i = 0; i < cfg.nbin; i++) {
+            if (child_run(&ch[i], cargv)) {
+                fprintf(stderr, "startup: %s: %s\n", ch[i].path,
+                        strerror(errno));
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    for (i = 0; i < cfg.nbin; i++) {
+        child_report(&ch[i]);
+    }
+    return EXIT_SUCCESS;
+}
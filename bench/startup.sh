@@ -0,0 +1,46 @@
+#!/bin/sh
+# startup.sh: build startup_child.c in every memory management configuration,
+# table size and link mode, then run the startup latency benchmark over them.
+#
+#   CC=cc CFLAGS=-O2 RUNS=2000 bench/startup.sh [-- ARG...]
+#
+# Static variants are skipped when there is no static libc to link against.
+set -eu
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+RUNS=${RUNS:-2000}
+
+here=$(cd "$(dirname "$0")" && pwd)
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+$CC $CFLAGS -o "$out/startup" "$here/startup.c"
+
+bins=
+for size in 16 64 256; do
+    for mem in alloca vla fixed tbl; do
+        case $mem in
+        alloca) flags= ;;
+        vla)    flags="-DOPT_USE_ALLOCA=0" ;;
+        fixed)  flags="-DOPT_USE_ALLOCA=0 -DOPT_USE_VLAS=0" ;;
+        tbl)    flags="-DOPT_TBL_LEN=$((size + 4))" ;;
+        esac
+        for link in dynamic static; do
+            name=$mem-$size-$link
+            lflags=
+            if [ $link = static ]; then
+                lflags=-static
+            fi
+            if $CC $CFLAGS $flags -DCHILD_NOPT=$size $lflags \
+                    -o "$out/$name" "$here/startup_child.c" 2>/dev/null; then
+                bins="$bins $out/$name"
+            else
+                echo "startup.sh: skipping $name" >&2
+            fi
+        done
+    done
+done
+
+# shellcheck disable=SC2086
+"$out/startup" -n "$RUNS" $bins "$@"
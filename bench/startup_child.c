@@ -0,0 +1,56 @@
+/** @file startup_child.c minimal tool spawned by the startup benchmark.
+ *
+ *  This is a stand-in for one of our small command line tools: it parses its
+ *  argv against a table of CHILD_NOPT generated long options (16, 64 or 256,
+ *  plus four real ones), writes a CLOCK_MONOTONIC timestamp taken right after
+ *  opt_parse returns to fd 3 and exits without any further work. Memory
+ *  management is selected with the usual opt.h macros on the command line.
+ *
+ *  See startup.sh for the configurations it is built in.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#define OPT_IMPLEMENTATION 1
+#include "../opt.h"
+#include "bench.h"
+
+#include <unistd.h>
+
+
+#ifndef CHILD_NOPT
+#   define CHILD_NOPT 16
+#endif
+
+#if CHILD_NOPT == 16
+#   define CHILD_GEN BENCH_D16
+#elif CHILD_NOPT == 64
+#   define CHILD_GEN BENCH_D64
+#elif CHILD_NOPT == 256
+#   define CHILD_GEN BENCH_D256
+#else
+#   error "CHILD_NOPT must be 16, 64 or 256"
+#endif
+
+
+static const struct optspec opts[] = {
+    { 'v', "verbose", 0, bench_cb },
+    { 'q', "quiet",   0, bench_cb },
+    { 'j', "jobs",    1, bench_cb },
+    { 'o', "output",  1, bench_cb },
+    CHILD_GEN(BENCH_LONG, x)
+};
+
+
+int main(int argc, char *argv[])
+{
+    struct optinfo info = {
+        0, NULL, OPT_FIRST_SKIP, OPT_END_ALLOW, bench_errcb, bench_cb, NULL
+    };
+    unsigned long long now;
+
+    info.argc = argc;
+    info.argv = argv;
+    opt_parse(&info, BENCH_COUNT(opts), opts);
+    now = bench_now();
+    return write(3, &now, sizeof now) != sizeof now;
+}
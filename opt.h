@@ -24,6 +24,11 @@
  *  sorted by short/long option. This allows a relatively rapid lookup of either
  *  option size using bsearch(3).
  *
+ *  opt_parse sorts the table on every call. Programs that parse many times, or
+ *  that want the sorted index in read-only memory, can build a struct opttbl
+ *  once with opt_tbl_init, or generate it as constant data with tools/optgen.c,
+ *  and pass it to opt_parse_tbl instead.
+ *
  *  By default, memory management is performed with alloca(3). You can override
  *  this behavior in the implementation file by #defining the following macros
  *  before #inclusion:
@@ -43,6 +48,86 @@
  *  If neither alloca(3) nor VLAs are allowed for memory management, then a
  *  large fixed size buffer will be used. If the number of options exceeds the
  *  buffer size in any case, then the latter options will be truncated.
+ *
+ *    - OPT_BATCH_LEN   Look long options up this many cmdargs at a time (8 to
+ *                      32 is sensible). Each lookup in a large table is a
+ *                      chain of dependent cache misses through the sorted
+ *                      index, the option and its name. Batched, the binary
+ *                      searches of all the long options among the next
+ *                      OPT_BATCH_LEN cmdargs step together, and every step
+ *                      prefetches all of their probes before comparing any,
+ *                      so that the misses overlap. Options are still
+ *                      dispatched one at a time, in order. This is unset by
+ *                      default, and only pays off for tables too large for
+ *                      the cache, such as with response files
+ *
+ *    - OPT_FREESTANDING  Do not use the C library at all. Sorting, searching,
+ *                      string comparison and character classification are
+ *                      done with built-in ASCII-only routines, and alloca(3)
+ *                      is turned off. This is unset by default. Combine it
+ *                      with opt_parse_tbl and a generated table to avoid the
+ *                      sort as well.
+ *
+ *  The following macros enable optional diagnostics. They are off by default
+ *  and compile away completely when off:
+ *
+ *    - OPT_USE_USDT    Emit USDT (systemtap <sys/sdt.h>) probes under the
+ *                      provider "opt". If <sys/sdt.h> is unavailable this is
+ *                      turned off. Every probe that carries a timing argument
+ *                      passes a CLOCK_MONOTONIC timestamp in nanoseconds, so
+ *                      durations are differences between paired probes:
+ *
+ *                        parse__entry    (argc, nopt, ts)
+ *                        parse__return   (res, ts)
+ *                        build__start    (nopt, ts)
+ *                        build__done     (nshrt, nlng, ts)
+ *                        find__hit       (long, idx, ts)
+ *                        find__miss      (long, ts)
+ *                        arg__unget      (argc)
+ *                        call__entry     (idx, count, ts)    idx -1: poscb
+ *                        call__return    (idx, res, ts)
+ *                        error__entry    (type, shrt, lng, ts)
+ *                        error__return   (res, ts)
+ *
+ *                      parse__entry to parse__return covers the whole parse,
+ *                      including the table build of opt_parse in between.
+ *
+ *                      e.g. bpftrace -e 'usdt:./prog:opt:find__miss { ... }'
+ *
+ *                      Each probe has a semaphore, so nothing is evaluated,
+ *                      nor the clock read, unless a tracer is attached to it
+ *
+ *                      Instrumentation harnesses may instead #define
+ *                      OPT_PROBE_NOW() and OPT_PROBE1 through OPT_PROBE4
+ *                      themselves to receive the same events in-process (see
+ *                      bench/perfctr.c). These take the probe name as their
+ *                      first argument
+ *
+ *    - OPT_USE_CAPTURE Compile in the argv capture hook. When the environment
+ *                      variable OPT_CAPTURE names a file, every call to
+ *                      opt_parse appends its complete argc/argv to that file
+ *                      as one record: a 4-byte little-endian length followed
+ *                      by that many bytes of NUL-terminated strings. Records
+ *                      are written with a single write(2) to an O_APPEND
+ *                      descriptor, so concurrent processes may share a file.
+ *                      This uses the heap, and is POSIX-only. The corpus can
+ *                      be replayed with bench/replay.c
+ *
+ *    - OPT_USE_PROFILE Compile in the callback profiler. When the environment
+ *                      variable OPT_PROFILE is set, every callback dispatch,
+ *                      every parse and every table sort is timed, in wall
+ *                      (CLOCK_MONOTONIC) and thread CPU time, and at exit the
+ *                      spans are written to the file it names ("-" for
+ *                      stderr). A name ending in ".json" gets Chrome trace
+ *                      events, for chrome://tracing or Perfetto. Any other
+ *                      name gets a report of each option, "(poscb)",
+ *                      "(errcb) -x", "(parse)" and "(table)", largest self
+ *                      time first. Self time leaves out the spans nested in
+ *                      a span, so "(parse)" is the parser's own time and a
+ *                      callback's is its own work. Profiled parses must not
+ *                      run on several threads at once. This uses the heap,
+ *                      and is POSIX-only; with a strict -std, define
+ *                      _POSIX_C_SOURCE to 199309L or later
  */
 #ifndef OPT_H
 #define OPT_H
@@ -95,7 +180,8 @@ typedef int optcbfn_t(int idx, unsigned count, char *args[], void *data);
 
 /** @brief Error function invoked when an argument is unrecognized
  *  @param type
- *      Zero if this is a short option and one if it is long
+ *      Zero if this is a short option and one if it is long. Companion
+ *      headers may add types, like OPT_ERR_VALUE in opt_re.h
  *  @param shrt
  *      The offending character if @p type is zero, otherwise nul
  *  @param lng
@@ -144,6 +230,20 @@ struct optinfo {
 };
 
 
+/** @brief Options sorted for lookup. opt_parse builds one of these on the
+ *      stack on every call. Build one yourself with opt_tbl_init, or generate
+ *      one as constant data with tools/optgen.c, to use with opt_parse_tbl
+ */
+struct opttbl {
+    unsigned                     nopt;  /* Total option count */
+    unsigned                     nshrt; /* Short option count */
+    unsigned                     nlng;  /* Long option count */
+    const struct optspec        *opts;  /* The original list */
+    const struct optspec *const *shrt;  /* SORTED short options */
+    const struct optspec *const *lng;   /* SORTED long options */
+};
+
+
 /** @details The first argument is handled according to the disposition
  *      specified by the "fstact" member of @p info. Afterwards, cmdargs are
  *      parsed left-to-right.
@@ -162,7 +262,7 @@ struct optinfo {
  *      This function does not use any heap memory nor issue any stdio calls.
  *      This function uses qsort(3), bsearch(3), and potentially alloca(3). If
  *      alloca(3) is not allowed (-DUSE_ALLOCA=0) or unavailable, then VLAs are
- *      used instead.
+ *      used instead. With OPT_FREESTANDING, none of these are used.
  *  @brief Parse command-line arguments according to @p opts
  *  @param info
  *      Option context structure
@@ -177,6 +277,46 @@ struct optinfo {
 int opt_parse(struct optinfo *info, unsigned nopt, const struct optspec opts[]);
 
 
+/** @brief Sort @p opts into @p tbl for use with opt_parse_tbl
+ *  @param tbl
+ *      Table to initialize. It refers to @p opts, @p shrt and @p lng, which
+ *      must outlive it
+ *  @param nopt
+ *      Length of @p opts
+ *  @param opts
+ *      Option specification table
+ *  @param shrt
+ *      Buffer of at least @p nopt pointers for the sorted short options
+ *  @param lng
+ *      Buffer of at least @p nopt pointers for the sorted long options
+ */
+void opt_tbl_init(struct opttbl        *tbl,
+                  unsigned              nopt,
+                  const struct optspec  opts[],
+                  const struct optspec *shrt[],
+                  const struct optspec *lng[]);
+
+
+/** @brief Check that @p tbl is sorted and consistent with its option list.
+ *      Use this in a test of any table that was generated or written by hand
+ *  @param tbl
+ *      Table to check
+ *  @returns Zero if @p tbl is usable, otherwise the one-based position in
+ *      the short (negative) or long (positive) index of the first bad entry
+ */
+int opt_tbl_check(const struct opttbl *tbl);
+
+
+/** @brief Exactly opt_parse, with a table sorted in advance
+ *  @param info
+ *      Option context structure
+ *  @param tbl
+ *      Sorted option table
+ *  @returns See opt_parse
+ */
+int opt_parse_tbl(struct optinfo *info, const struct opttbl *tbl);
+
+
 
 #if defined(__cplusplus) && __cplusplus
 }
@@ -187,9 +327,29 @@ int opt_parse(struct optinfo *info, unsigned nopt, const struct optspec opts[]);
 
 #if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
 
-#include <ctype.h>
-#include <stdlib.h>
-#include <string.h>
+/* Set default for OPT_FREESTANDING */
+#ifndef OPT_FREESTANDING
+#   define OPT_FREESTANDING 0
+#endif
+
+#if OPT_FREESTANDING
+#   include <stddef.h>
+#   undef  OPT_USE_ALLOCA
+#   define OPT_USE_ALLOCA 0
+#   if defined(OPT_USE_CAPTURE) && OPT_USE_CAPTURE
+#       error "OPT_USE_CAPTURE requires the C library"
+#   endif
+#   if defined(OPT_USE_USDT) && OPT_USE_USDT
+#       error "OPT_USE_USDT requires the C library"
+#   endif
+#   if defined(OPT_USE_PROFILE) && OPT_USE_PROFILE
+#       error "OPT_USE_PROFILE requires the C library"
+#   endif
+#else
+#   include <ctype.h>
+#   include <stdlib.h>
+#   include <string.h>
+#endif
 
 
 /** Check for the macros
@@ -266,6 +426,554 @@ int opt_parse(struct optinfo *info, unsigned nopt, const struct optspec opts[]);
 #endif
 
 
+/* Set default for OPT_BATCH_LEN */
+#ifndef OPT_BATCH_LEN
+#   define OPT_BATCH_LEN 0
+#endif
+
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define OPT_PREFETCH(p) __builtin_prefetch(p)
+#else
+#   define OPT_PREFETCH(p) ((void)(p))
+#endif
+
+
+/* Set default for OPT_USE_USDT */
+#ifndef OPT_USE_USDT
+#   define OPT_USE_USDT 0
+#endif
+
+
+/* Double-check for <sys/sdt.h> */
+#if OPT_USE_USDT
+#   if __has_include(<sys/sdt.h>)
+/* Probes carry their semaphores, which tracers raise while attached */
+#       define _SDT_HAS_SEMAPHORES 1
+#       include <sys/sdt.h>
+#       include <time.h>
+#   else
+#       undef  OPT_USE_USDT
+#       define OPT_USE_USDT 0
+#   endif
+#endif
+
+
+#if OPT_USE_USDT
+/** @brief Monotonic timestamp in nanoseconds for probe arguments */
+static unsigned long long opt_probe_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull
+         + (unsigned long long)ts.tv_nsec;
+}
+
+/** @brief Semaphore of probe @p name. Volatile, as only tracers set it */
+#define OPT_PROBE_SEM(name)                                                   \
+    static volatile unsigned short opt_##name##_semaphore                     \
+    __attribute__((used, section(".probes")))
+
+OPT_PROBE_SEM(parse__entry);
+OPT_PROBE_SEM(parse__return);
+OPT_PROBE_SEM(build__start);
+OPT_PROBE_SEM(build__done);
+OPT_PROBE_SEM(find__hit);
+OPT_PROBE_SEM(find__miss);
+OPT_PROBE_SEM(arg__unget);
+OPT_PROBE_SEM(call__entry);
+OPT_PROBE_SEM(call__return);
+OPT_PROBE_SEM(error__entry);
+OPT_PROBE_SEM(error__return);
+
+/* Arguments, and so the clock, are only evaluated with a tracer attached */
+#   define OPT_PROBE_ON(name) __builtin_expect(opt_##name##_semaphore, 0)
+#   define OPT_PROBE_NOW()              opt_probe_clock()
+#   define OPT_PROBE1(name, a)                                                \
+    do {                                                                      \
+        if (OPT_PROBE_ON(name)) {                                             \
+            STAP_PROBE1(opt, name, a);                                        \
+        }                                                                     \
+    } while (0)
+#   define OPT_PROBE2(name, a, b)                                             \
+    do {                                                                      \
+        if (OPT_PROBE_ON(name)) {                                             \
+            STAP_PROBE2(opt, name, a, b);                                     \
+        }                                                                     \
+    } while (0)
+#   define OPT_PROBE3(name, a, b, c)                                          \
+    do {                                                                      \
+        if (OPT_PROBE_ON(name)) {                                             \
+            STAP_PROBE3(opt, name, a, b, c);                                  \
+        }                                                                     \
+    } while (0)
+#   define OPT_PROBE4(name, a, b, c, d)                                       \
+    do {                                                                      \
+        if (OPT_PROBE_ON(name)) {                                             \
+            STAP_PROBE4(opt, name, a, b, c, d);                               \
+        }                                                                     \
+    } while (0)
+
+#elif !defined(OPT_PROBE1)
+/* Probe arguments are never evaluated */
+#   define OPT_PROBE1(name, a)          ((void)0)
+#   define OPT_PROBE2(name, a, b)       ((void)0)
+#   define OPT_PROBE3(name, a, b, c)    ((void)0)
+#   define OPT_PROBE4(name, a, b, c, d) ((void)0)
+
+#endif
+
+
+/* Set default for OPT_USE_CAPTURE */
+#ifndef OPT_USE_CAPTURE
+#   define OPT_USE_CAPTURE 0
+#endif
+
+
+/* Double-check for open(2) and write(2) */
+#if OPT_USE_CAPTURE
+#   if __has_include(<unistd.h>) && __has_include(<fcntl.h>)
+#       include <fcntl.h>
+#       include <unistd.h>
+#   else
+#       undef  OPT_USE_CAPTURE
+#       define OPT_USE_CAPTURE 0
+#   endif
+#endif
+
+
+#if OPT_USE_CAPTURE
+/** @brief Append the cmdargs in @p info to the corpus named by $OPT_CAPTURE.
+ *      Failures are silently ignored, capture must never break a program
+ *  @param info
+ *      Option information, before anything has been consumed
+ */
+static void opt_capture(const struct optinfo *info)
+{
+    const char *path = getenv("OPT_CAPTURE");
+    size_t len = 0, pos = 4;
+    unsigned char *rec;
+    int i, fd;
+
+    if (!path || !*path) {
+        return;
+    }
+    for (i = 0; i < info->argc; i++) {
+        len += strlen(info->argv[i]) + 1;
+    }
+    if (len > 0xffffffffu || !(rec = (unsigned char *)malloc(len + 4))) {
+        return;
+    }
+    rec[0] = (unsigned char)len;
+    rec[1] = (unsigned char)(len >> 8);
+    rec[2] = (unsigned char)(len >> 16);
+    rec[3] = (unsigned char)(len >> 24);
+    for (i = 0; i < info->argc; i++) {
+        len = strlen(info->argv[i]) + 1;
+        memcpy(rec + pos, info->argv[i], len);
+        pos += len;
+    }
+    fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0666);
+    if (fd >= 0) {
+        (void)!write(fd, rec, pos);
+        close(fd);
+    }
+    free(rec);
+}
+#endif
+
+
+/* Set default for OPT_USE_PROFILE */
+#ifndef OPT_USE_PROFILE
+#   define OPT_USE_PROFILE 0
+#endif
+
+
+/* Double-check for clock_gettime(2) */
+#if OPT_USE_PROFILE
+#   if __has_include(<time.h>) && __has_include(<unistd.h>)
+#       include <stdio.h>
+#       include <time.h>
+#       include <unistd.h>
+#   else
+#       undef  OPT_USE_PROFILE
+#       define OPT_USE_PROFILE 0
+#   endif
+#endif
+
+
+#if OPT_USE_PROFILE
+/* Kinds of profiled span */
+#define OPT_PROF_CALL   0
+#define OPT_PROF_POS    1
+#define OPT_PROF_ERROR  2
+#define OPT_PROF_PARSE  3
+#define OPT_PROF_BUILD  4
+
+#define OPT_PROF_DEPTH  32  /* Nesting tracked for self time */
+
+
+/** @brief A finished span, or in a report the totals of a name */
+struct optprofev {
+    unsigned long long start;   /* Monotonic ns (report: the longest wall) */
+    unsigned long long wall;    /* ns, with the spans nested in it */
+    unsigned long long self;    /* ns, without them */
+    unsigned long long cpu;     /* Thread CPU ns, without them */
+    int                kind;    /* OPT_PROF_* */
+    int                idx;     /* Option index, or -1 (report: calls) */
+    char               name[32];
+};
+
+
+/** @brief An open span */
+struct optprofspan {
+    unsigned long long start;
+    unsigned long long cpu;
+};
+
+
+/** @brief Profile of the process, written at exit */
+static struct optprof {
+    int                  on;    /* 0 until $OPT_PROFILE is read, then +-1 */
+    const char          *path;
+    const struct opttbl *tbl;   /* Innermost parse, for option names */
+    unsigned             depth;
+    unsigned long long   wall[OPT_PROF_DEPTH];  /* Nested in each open span */
+    unsigned long long   cpu[OPT_PROF_DEPTH];
+    struct optprofev    *ev;
+    size_t               nev;
+    size_t               cap;
+    size_t               lost;
+} opt_prof;
+
+
+static unsigned long long opt_prof_clock(clockid_t id)
+{
+    struct timespec ts;
+
+    clock_gettime(id, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull
+         + (unsigned long long)ts.tv_nsec;
+}
+
+
+/** @brief qsort(3) comparison of events by kind and name */
+static int opt_prof_namecmp(const void *p1, const void *p2)
+{
+    const struct optprofev *ev1 = (const struct optprofev *)p1;
+    const struct optprofev *ev2 = (const struct optprofev *)p2;
+
+    if (ev1->kind != ev2->kind) {
+        return (ev1->kind > ev2->kind) - (ev1->kind < ev2->kind);
+    }
+    return strcmp(ev1->name, ev2->name);
+}
+
+
+/** @brief qsort(3) comparison of totals by self time, largest first */
+static int opt_prof_selfcmp(const void *p1, const void *p2)
+{
+    const struct optprofev *ev1 = (const struct optprofev *)p1;
+    const struct optprofev *ev2 = (const struct optprofev *)p2;
+
+    return (ev1->self < ev2->self) - (ev1->self > ev2->self);
+}
+
+
+/** @brief Write the totals of each name, largest self time first. This sorts
+ *      the events and totals them in place */
+static void opt_prof_report(FILE *fp)
+{
+    struct optprofev *ev = opt_prof.ev;
+    unsigned long long wall = 0, cpu = 0;
+    size_t i, n = 0;
+
+    qsort(ev, opt_prof.nev, sizeof *ev, opt_prof_namecmp);
+    for (i = 0; i < opt_prof.nev; i++) {
+        wall += ev[i].self;
+        cpu += ev[i].cpu;
+        if (!n || opt_prof_namecmp(&ev[n - 1], &ev[i])) {
+            ev[n] = ev[i];
+            ev[n].start = ev[i].wall;
+            ev[n++].idx = 1;
+            continue;
+        }
+        ev[n - 1].start = ev[i].wall > ev[n - 1].start ? ev[i].wall
+                                                       : ev[n - 1].start;
+        ev[n - 1].wall += ev[i].wall;
+        ev[n - 1].self += ev[i].self;
+        ev[n - 1].cpu += ev[i].cpu;
+        ev[n - 1].idx++;
+    }
+    qsort(ev, n, sizeof *ev, opt_prof_selfcmp);
+    fprintf(fp, "opt: %.3f ms wall, %.3f ms cpu in %lu spans%s\n",
+            (double)wall / 1e6, (double)cpu / 1e6, (unsigned long)opt_prof.nev,
+            opt_prof.lost ? ", some lost" : "");
+    fprintf(fp, "%8s %10s %10s %10s %10s  %s\n", "calls", "self ms", "cpu ms",
+            "total ms", "max ms", "name");
+    for (i = 0; i < n; i++) {
+        fprintf(fp, "%8d %10.3f %10.3f %10.3f %10.3f  %s\n", ev[i].idx,
+                (double)ev[i].self / 1e6, (double)ev[i].cpu / 1e6,
+                (double)ev[i].wall / 1e6, (double)ev[i].start / 1e6,
+                ev[i].name);
+    }
+}
+
+
+/** @brief Write the spans as Chrome trace events, for chrome://tracing and
+ *      Perfetto */
+static void opt_prof_trace(FILE *fp)
+{
+    static const char *const cat[] = {
+        "call", "poscb", "errcb", "parse", "build"
+    };
+    const struct optprofev *ev = opt_prof.ev;
+    unsigned long long t0 = ~0ull;
+    const char *p;
+    size_t i;
+
+    for (i = 0; i < opt_prof.nev; i++) {
+        t0 = ev[i].start < t0 ? ev[i].start : t0;
+    }
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", fp);
+    for (i = 0; i < opt_prof.nev; i++) {
+        fprintf(fp, "%s\n{\"ph\":\"X\",\"pid\":%ld,\"tid\":0,\"cat\":\"%s\","
+                "\"ts\":%.3f,\"dur\":%.3f,\"name\":\"", i ? "," : "",
+                (long)getpid(), cat[ev[i].kind],
+                (double)(ev[i].start - t0) / 1e3, (double)ev[i].wall / 1e3);
+        for (p = ev[i].name; *p; p++) {
+            if (*p == '"' || *p == '\\') {
+                fprintf(fp, "\\%c", *p);
+            } else if ((unsigned char)*p < ' ') {
+                fprintf(fp, "\\u%04x", (unsigned)(unsigned char)*p);
+            } else {
+                fputc(*p, fp);
+            }
+        }
+        fprintf(fp, "\",\"args\":{\"idx\":%d,\"self_us\":%.3f,"
+                "\"cpu_us\":%.3f}}", ev[i].idx, (double)ev[i].self / 1e3,
+                (double)ev[i].cpu / 1e3);
+    }
+    fputs("\n]}\n", fp);
+}
+
+
+/** @brief atexit(3) handler that writes the profile to $OPT_PROFILE */
+static void opt_prof_write(void)
+{
+    size_t len = strlen(opt_prof.path);
+    FILE *fp;
+
+    if (!strcmp(opt_prof.path, "-")) {
+        fp = stderr;
+    } else if (!(fp = fopen(opt_prof.path, "w"))) {
+        return;
+    }
+    if (len > 5 && !strcmp(opt_prof.path + len - 5, ".json")) {
+        opt_prof_trace(fp);
+    } else {
+        opt_prof_report(fp);
+    }
+    if (fp != stderr) {
+        fclose(fp);
+    }
+    free(opt_prof.ev);
+    opt_prof.ev = NULL;
+    opt_prof.nev = 0;
+}
+
+
+/** @brief Open a span, if profiling
+ *  @returns Nonzero if profiling
+ */
+static int opt_prof_begin(struct optprofspan *span)
+{
+    if (!opt_prof.on) {
+        opt_prof.path = getenv("OPT_PROFILE");
+        opt_prof.on = opt_prof.path && *opt_prof.path
+                   && !atexit(opt_prof_write) ? 1 : -1;
+    }
+    if (opt_prof.on < 0) {
+        return 0;
+    }
+    if (opt_prof.depth < OPT_PROF_DEPTH) {
+        opt_prof.wall[opt_prof.depth] = 0;
+        opt_prof.cpu[opt_prof.depth] = 0;
+    }
+    opt_prof.depth++;
+    span->start = opt_prof_clock(CLOCK_MONOTONIC);
+    span->cpu = opt_prof_clock(CLOCK_THREAD_CPUTIME_ID);
+    return 1;
+}
+
+
+/** @brief Close a span and record it
+ *  @param span
+ *      The span, from opt_prof_begin
+ *  @param kind
+ *      OPT_PROF_*
+ *  @param idx
+ *      Option index, or -1
+ *  @param shrt
+ *      Unknown short option, for OPT_PROF_ERROR
+ *  @param lng
+ *      Unknown long option, for OPT_PROF_ERROR
+ */
+static void opt_prof_end(const struct optprofspan *span, int kind, int idx,
+                         char shrt, const char *lng)
+{
+    unsigned long long wall = opt_prof_clock(CLOCK_MONOTONIC) - span->start;
+    unsigned long long cpu = opt_prof_clock(CLOCK_THREAD_CPUTIME_ID)
+                           - span->cpu;
+    const struct optspec *opt;
+    unsigned d = --opt_prof.depth;
+    struct optprofev *ev;
+    size_t cap;
+
+    if (d && d - 1 < OPT_PROF_DEPTH) {
+        opt_prof.wall[d - 1] += wall;
+        opt_prof.cpu[d - 1] += cpu;
+    }
+    if (opt_prof.nev == opt_prof.cap) {
+        cap = opt_prof.cap ? opt_prof.cap * 2 : 256;
+        if (!(ev = (struct optprofev *)realloc(opt_prof.ev,
+                                               cap * sizeof *ev))) {
+            opt_prof.lost++;
+            return;
+        }
+        opt_prof.ev = ev;
+        opt_prof.cap = cap;
+    }
+    ev = &opt_prof.ev[opt_prof.nev++];
+    ev->start = span->start;
+    ev->wall = wall;
+    ev->self = wall;
+    ev->cpu = cpu;
+    if (d < OPT_PROF_DEPTH) {
+        ev->self -= opt_prof.wall[d];
+        ev->cpu -= opt_prof.cpu[d] < cpu ? opt_prof.cpu[d] : cpu;
+    }
+    ev->kind = kind;
+    ev->idx = idx;
+    opt = opt_prof.tbl && idx >= 0 && (unsigned)idx < opt_prof.tbl->nopt
+        ? &opt_prof.tbl->opts[idx] : NULL;
+    switch (kind) {
+    case OPT_PROF_CALL:
+        if (opt && opt->lng) {
+            snprintf(ev->name, sizeof ev->name, "--%s", opt->lng);
+        } else if (opt) {
+            snprintf(ev->name, sizeof ev->name, "-%c", opt->shrt);
+        } else {
+            snprintf(ev->name, sizeof ev->name, "#%d", idx);
+        }
+        break;
+    case OPT_PROF_POS:
+        strcpy(ev->name, "(poscb)");
+        break;
+    case OPT_PROF_ERROR:
+        if (lng) {
+            snprintf(ev->name, sizeof ev->name, "(errcb) --%s", lng);
+        } else {
+            snprintf(ev->name, sizeof ev->name, "(errcb) -%c", shrt);
+        }
+        break;
+    case OPT_PROF_PARSE:
+        strcpy(ev->name, "(parse)");
+        break;
+    default:
+        strcpy(ev->name, "(table)");
+        break;
+    }
+}
+#endif
+
+
+typedef int optcmpfn_t(const void *, const void *);
+
+
+#if OPT_FREESTANDING
+/** @brief ASCII-only isgraph(3) */
+static int opt_isgraph(int c)
+{
+    return c > ' ' && c < 0x7f;
+}
+
+
+/** @brief ASCII-only isdigit(3) */
+static int opt_isdigit(int c)
+{
+    return c >= '0' && c <= '9';
+}
+
+
+/** @brief strcmp(3), which compares as unsigned char */
+static int opt_strcmp(const char *s1, const char *s2)
+{
+    const unsigned char *p1 = (const unsigned char *)s1;
+    const unsigned char *p2 = (const unsigned char *)s2;
+
+    while (*p1 && *p1 == *p2) {
+        p1++;
+        p2++;
+    }
+    return (*p1 > *p2) - (*p1 < *p2);
+}
+
+
+/** @brief Insertion sort of @p n option pointers. Tables are short and often
+ *      nearly sorted already, and this keeps the code and stack tiny
+ */
+static void opt_sort(const struct optspec **base, unsigned n, optcmpfn_t *cmp)
+{
+    const struct optspec *tmp;
+    unsigned i, j;
+
+    for (i = 1; i < n; i++) {
+        tmp = base[i];
+        for (j = i; j && cmp(&base[j - 1], &tmp) > 0; j--) {
+            base[j] = base[j - 1];
+        }
+        base[j] = tmp;
+    }
+}
+
+
+/** @brief bsearch(3) over @p n sorted option pointers */
+static const struct optspec *const *
+opt_search(const struct optspec *const *key,
+           const struct optspec *const *base,
+           unsigned                     n,
+           optcmpfn_t                  *cmp)
+{
+    unsigned lo = 0, hi = n, mid;
+    int res;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        res = cmp(key, &base[mid]);
+        if (!res) {
+            return &base[mid];
+        } else if (res < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+#else
+#   define opt_isgraph(c) isgraph(c)
+#   define opt_isdigit(c) isdigit(c)
+#   define opt_strcmp(s1, s2) strcmp(s1, s2)
+#   define opt_sort(base, n, cmp) qsort(base, n, sizeof *(base), cmp)
+#   define opt_search(key, base, n, cmp) \
+    ((const struct optspec *const *)bsearch(key, base, n, sizeof *(base), cmp))
+
+#endif
+
+
 /** @brief Short option comparison function for qsort(3) and bsearch(3) */
 static int optspec_shrtcmp(const void *p1, const void *p2)
 {
@@ -284,7 +992,7 @@ static int optspec_lngcmp(const void *p1, const void *p2)
 
     os1 = (const struct optspec *const *)p1;
     os2 = (const struct optspec *const *)p2;
-    return strcmp((*os1)->lng, (*os2)->lng);
+    return opt_strcmp((*os1)->lng, (*os2)->lng);
 }
 
 
@@ -357,20 +1065,10 @@ static void arg_unget(struct optinfo *info)
 {
     info->argc++;
     info->argv--;
+    OPT_PROBE1(arg__unget, info->argc);
 }
 
 
-/** @brief All of the option information wrapped up neatly */
-struct opttbl {
-    unsigned               nopt;    /* Total option count */
-    unsigned               nshrt;   /* Short option count */
-    unsigned               nlng;    /* Long option count */
-    const struct optspec  *opts;    /* The original list */
-    const struct optspec **shrt;    /* SORTED short options */
-    const struct optspec **lng;     /* SORTED long options */
-};
-
-
 /** @brief Find @p key in @p tbl
  *  @param tbl
  *      Options table
@@ -384,15 +1082,210 @@ static const struct optspec *opt_find(const struct opttbl  *tbl,
                                       const struct optspec *key,
                                       int                   len)
 {
-    typedef int cmpfn_t(const void *, const void *);
-    const size_t size = sizeof tbl->opts;
-    const void *base = len ? tbl->lng       : tbl->shrt;
-    size_t nmemb     = len ? tbl->nlng      : tbl->nshrt;
-    cmpfn_t *cmpfn   = len ? optspec_lngcmp : optspec_shrtcmp;
-    const struct optspec **res;
+    const struct optspec *const *base = len ? tbl->lng       : tbl->shrt;
+    unsigned nmemb                    = len ? tbl->nlng      : tbl->nshrt;
+    optcmpfn_t *cmpfn                 = len ? optspec_lngcmp : optspec_shrtcmp;
+    const struct optspec *const *res;
+
+    res = opt_search(&key, base, nmemb, cmpfn);
+    if (res) {
+        OPT_PROBE3(find__hit, len, (int)(*res - tbl->opts), OPT_PROBE_NOW());
+        return *res;
+    }
+    OPT_PROBE2(find__miss, len, OPT_PROBE_NOW());
+    return NULL;
+}
+
+
+/** @brief Long options looked up ahead of dispatch, see OPT_BATCH_LEN */
+struct optbatch {
+#if OPT_BATCH_LEN > 1
+    char                **argv;                 /* First cmdarg covered */
+    unsigned              n;                    /* Cmdargs covered */
+    const char           *key[OPT_BATCH_LEN];   /* Long option names */
+    const struct optspec *fnd[OPT_BATCH_LEN];   /* Lookup results */
+#else
+    int                   unused;
+#endif
+};
+
+
+#if OPT_BATCH_LEN > 1
+/** @brief Look up the long options among the @p n cmdargs at @p argv. The
+ *      binary searches go in lockstep, and each step of all of them is
+ *      prefetched level by level (index entry, option, name) before any of
+ *      them compares
+ *  @param tbl
+ *      Options table
+ *  @param batch
+ *      Batch to fill
+ *  @param argv
+ *      First cmdarg
+ *  @param n
+ *      Cmdarg count, at most OPT_BATCH_LEN
+ */
+static void opt_batch_fill(const struct opttbl *tbl,
+                           struct optbatch     *batch,
+                           char               **argv,
+                           unsigned             n)
+{
+    const struct optspec *const *base = tbl->lng;
+    unsigned lo[OPT_BATCH_LEN], hi[OPT_BATCH_LEN], mid[OPT_BATCH_LEN];
+    unsigned act[OPT_BATCH_LEN];
+    unsigned i, j, k, nact = 0;
+    int res;
 
-    res = (const struct optspec **)bsearch(&key, base, nmemb, size, cmpfn);
-    return res ? *res : NULL;
+    batch->argv = argv;
+    batch->n = n;
+    for (i = 0; i < n; i++) {
+        batch->fnd[i] = NULL;
+        batch->key[i] = arg_classify(argv[i]) == ARG_LONG ? argv[i] + 2 : NULL;
+        if (batch->key[i] && tbl->nlng) {
+            lo[i] = 0;
+            hi[i] = tbl->nlng;
+            act[nact++] = i;
+        }
+    }
+    while (nact) {
+        for (j = 0; j < nact; j++) {
+            i = act[j];
+            mid[i] = lo[i] + (hi[i] - lo[i]) / 2;
+            OPT_PREFETCH(&base[mid[i]]);
+        }
+        for (j = 0; j < nact; j++) {
+            OPT_PREFETCH(base[mid[act[j]]]);
+        }
+        for (j = 0; j < nact; j++) {
+            OPT_PREFETCH(base[mid[act[j]]]->lng);
+        }
+        for (j = k = 0; j < nact; j++) {
+            i = act[j];
+            res = opt_strcmp(batch->key[i], base[mid[i]]->lng);
+            if (!res) {
+                batch->fnd[i] = base[mid[i]];
+                continue;
+            } else if (res < 0) {
+                hi[i] = mid[i];
+            } else {
+                lo[i] = mid[i] + 1;
+            }
+            if (lo[i] < hi[i]) {
+                act[k++] = i;
+            }
+        }
+        nact = k;
+    }
+}
+
+
+/** @brief Find the long option @p key, which is the cmdarg just read, from
+ *      @p batch, refilling it from there if it does not cover it
+ *  @param info
+ *      Option information
+ *  @param tbl
+ *      Options table
+ *  @param batch
+ *      Batch of lookups
+ *  @param key
+ *      Long option name
+ *  @returns A pointer to the found option or NULL if not found
+ */
+static const struct optspec *opt_batch_find(const struct optinfo *info,
+                                            const struct opttbl  *tbl,
+                                            struct optbatch      *batch,
+                                            const char           *key)
+{
+    char **pos = info->argv - 1;
+    const struct optspec *res;
+    struct optspec tmp;
+    unsigned n;
+
+    if (pos < batch->argv || pos >= batch->argv + batch->n) {
+        n = (unsigned)info->argc + 1;
+        opt_batch_fill(tbl, batch, pos, n < OPT_BATCH_LEN ? n : OPT_BATCH_LEN);
+    }
+    if (batch->key[pos - batch->argv] != key) {
+        /* A callback rewrote argv under the batch */
+        tmp.lng = key;
+        return opt_find(tbl, &tmp, 1);
+    }
+    res = batch->fnd[pos - batch->argv];
+    if (res) {
+        OPT_PROBE3(find__hit, 1, (int)(res - tbl->opts), OPT_PROBE_NOW());
+    } else {
+        OPT_PROBE2(find__miss, 1, OPT_PROBE_NOW());
+    }
+    return res;
+}
+#endif
+
+
+/** @brief Invoke an option or positional argument callback
+ *  @param info
+ *      Option information
+ *  @param func
+ *      The callback
+ *  @param idx
+ *      Option index, or -1 for the positional callback
+ *  @param count
+ *      Argument count
+ *  @param args
+ *      Arguments
+ *  @returns Whatever the callback returns
+ */
+static int opt_invoke(struct optinfo *info,
+                      optcbfn_t      *func,
+                      int             idx,
+                      unsigned        count,
+                      char           *args[])
+{
+    int res;
+#if OPT_USE_PROFILE
+    struct optprofspan span;
+    int prof = opt_prof_begin(&span);
+#endif
+
+    OPT_PROBE3(call__entry, idx, count, OPT_PROBE_NOW());
+    res = func(idx, count, args, info->data);
+    OPT_PROBE3(call__return, idx, res, OPT_PROBE_NOW());
+#if OPT_USE_PROFILE
+    if (prof) {
+        opt_prof_end(&span, idx < 0 ? OPT_PROF_POS : OPT_PROF_CALL, idx, '\0',
+                     NULL);
+    }
+#endif
+    return res;
+}
+
+
+/** @brief Invoke the error callback
+ *  @param info
+ *      Option information
+ *  @param type
+ *      Zero for a short option, one for a long option
+ *  @param shrt
+ *      The offending short option character
+ *  @param lng
+ *      The offending long option string
+ *  @returns Whatever the callback returns
+ */
+static int opt_error(struct optinfo *info, int type, char shrt, char *lng)
+{
+    int res;
+#if OPT_USE_PROFILE
+    struct optprofspan span;
+    int prof = opt_prof_begin(&span);
+#endif
+
+    OPT_PROBE4(error__entry, type, shrt, lng, OPT_PROBE_NOW());
+    res = info->errcb(type, shrt, lng, info->data);
+    OPT_PROBE2(error__return, res, OPT_PROBE_NOW());
+#if OPT_USE_PROFILE
+    if (prof) {
+        opt_prof_end(&span, OPT_PROF_ERROR, -1, shrt, type ? lng : NULL);
+    }
+#endif
+    return res;
 }
 
 
@@ -416,7 +1309,7 @@ static int opt_valid_argument(const struct optinfo *info,
         return 1;
     } else if (arg->type == ARG_SHORT) {
         /* Quick fix to allow negative numbers */
-        return isdigit(arg->str[1]);
+        return opt_isdigit(arg->str[1]);
     } else {
         return 0;
     }
@@ -448,7 +1341,7 @@ static int opt_call_back(struct optinfo       *info,
             break;
         }
     }
-    return job->func((int)(job - tbl->opts), i, args, info->data);
+    return opt_invoke(info, job->func, (int)(job - tbl->opts), i, args);
 }
 
 
@@ -477,10 +1370,10 @@ static int opt_short(struct optinfo      *info,
         fnd = opt_find(tbl, &key, 0);
         if (fnd) {
             idx = (int)(fnd - tbl->opts);
-            res = noargs ? fnd->func(idx, 0, info->argv, info->data)
+            res = noargs ? opt_invoke(info, fnd->func, idx, 0, info->argv)
                          : opt_call_back(info, tbl, fnd);
         } else {
-            res = info->errcb(0, key.shrt, NULL, info->data);
+            res = opt_error(info, 0, key.shrt, NULL);
         }
     } while (*++opt && !res);
     return res;
@@ -494,24 +1387,33 @@ static int opt_short(struct optinfo      *info,
  *      Long option count
  *  @param shrt
  *      Sorted long option information
+ *  @param batch
+ *      Lookups done ahead, with OPT_BATCH_LEN
  *  @param opt
  *      The long option string
  *  @returns Nonzero if told to do so
  */
 static int opt_long(struct optinfo      *info,
                     const struct opttbl *tbl,
+                    struct optbatch     *batch,
                     char                *opt)
 {
     const struct optspec *fnd;
-    struct optspec key;
     int res;
 
+#if OPT_BATCH_LEN > 1
+    fnd = opt_batch_find(info, tbl, batch, opt);
+#else
+    struct optspec key;
+
+    (void)batch;
     key.lng = opt;
     fnd = opt_find(tbl, &key, 1);
+#endif
     if (fnd) {
         res = opt_call_back(info, tbl, fnd);
     } else {
-        res = info->errcb(1, '\0', opt, info->data);
+        res = opt_error(info, 1, '\0', opt);
     }
     return res;
 }
@@ -526,21 +1428,26 @@ static int opt_long(struct optinfo      *info,
  */
 static int opt_read(struct optinfo *info, const struct opttbl *tbl)
 {
+    struct optbatch batch;
     struct arg arg;
     int res = 0;
 
+#if OPT_BATCH_LEN > 1
+    batch.argv = NULL;
+    batch.n = 0;
+#endif
     while (arg_get(info, &arg) && !res) {
         switch (arg.type) {
         case ARG_TOKEN:
             arg_unget(info);
             /* FALL THRU */
         case ARG_END:
-            return info->poscb(-1, info->argc, info->argv, info->data);
+            return opt_invoke(info, info->poscb, -1, info->argc, info->argv);
         case ARG_SHORT:
             res = opt_short(info, tbl, arg.str + 1);
             break;
         case ARG_LONG:
-            res = opt_long(info, tbl, arg.str + 2);
+            res = opt_long(info, tbl, &batch, arg.str + 2);
             break;
         }
     }
@@ -580,42 +1487,134 @@ static unsigned opt_min(unsigned x, unsigned y)
 #endif
 
 
+/** @brief Handle the first argument and then read the rest. The caller fires
+ *      parse__entry, before it builds any table
+ *  @param info
+ *      Option information
+ *  @param tbl
+ *      Sorted options table
+ *  @returns Zero unless a callback says otherwise
+ */
+static int opt_run(struct optinfo *info, const struct opttbl *tbl)
+{
+    int res;
+#if OPT_USE_PROFILE
+    const struct opttbl *outer = opt_prof.tbl;
+    struct optprofspan span;
+    int prof = opt_prof_begin(&span);
+
+    /* Callbacks are named from the innermost parse's table */
+    opt_prof.tbl = tbl;
+#endif
+
+#if OPT_USE_CAPTURE
+    opt_capture(info);
+#endif
+    res = opt_first(info);
+    res = res ? res : opt_read(info, tbl);
+    OPT_PROBE2(parse__return, res, OPT_PROBE_NOW());
+#if OPT_USE_PROFILE
+    opt_prof.tbl = outer;
+    if (prof) {
+        opt_prof_end(&span, OPT_PROF_PARSE, -1, '\0', NULL);
+    }
+#endif
+    return res;
+}
+
+
+OPT_EXTERN_C
+void opt_tbl_init(struct opttbl        *tbl,
+                  unsigned              nopt,
+                  const struct optspec  opts[],
+                  const struct optspec *shrt[],
+                  const struct optspec *lng[])
+{
+    unsigned i;
+#if OPT_USE_PROFILE
+    struct optprofspan span;
+    int prof = opt_prof_begin(&span);
+#endif
+
+    OPT_PROBE2(build__start, nopt, OPT_PROBE_NOW());
+    tbl->nopt = nopt;
+    tbl->opts = opts;
+    tbl->nlng = 0;
+    tbl->nshrt = 0;
+    for (i = 0; i < nopt; i++) {
+        if (opt_isgraph(opts[i].shrt)) {
+            shrt[tbl->nshrt++] = &opts[i];
+        }
+        if (opts[i].lng && *opts[i].lng) {
+            lng[tbl->nlng++] = &opts[i];
+        }
+    }
+    opt_sort(shrt, tbl->nshrt, optspec_shrtcmp);
+    opt_sort(lng, tbl->nlng, optspec_lngcmp);
+    tbl->shrt = shrt;
+    tbl->lng = lng;
+    OPT_PROBE3(build__done, tbl->nshrt, tbl->nlng, OPT_PROBE_NOW());
+#if OPT_USE_PROFILE
+    if (prof) {
+        opt_prof_end(&span, OPT_PROF_BUILD, -1, '\0', NULL);
+    }
+#endif
+}
+
+
+OPT_EXTERN_C
+int opt_tbl_check(const struct opttbl *tbl)
+{
+    const struct optspec *end = tbl->opts + tbl->nopt;
+    unsigned i;
+
+    for (i = 0; i < tbl->nshrt; i++) {
+        if (tbl->shrt[i] < tbl->opts || tbl->shrt[i] >= end
+         || !opt_isgraph(tbl->shrt[i]->shrt)
+         || (i && optspec_shrtcmp(&tbl->shrt[i - 1], &tbl->shrt[i]) > 0)) {
+            return -(int)(i + 1);
+        }
+    }
+    for (i = 0; i < tbl->nlng; i++) {
+        if (tbl->lng[i] < tbl->opts || tbl->lng[i] >= end
+         || !tbl->lng[i]->lng || !*tbl->lng[i]->lng
+         || (i && optspec_lngcmp(&tbl->lng[i - 1], &tbl->lng[i]) > 0)) {
+            return (int)(i + 1);
+        }
+    }
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_parse_tbl(struct optinfo *info, const struct opttbl *tbl)
+{
+    OPT_PROBE3(parse__entry, info->argc, tbl->nopt, OPT_PROBE_NOW());
+    return opt_run(info, tbl);
+}
+
+
 OPT_EXTERN_C
 int opt_parse(struct optinfo *info, unsigned nopt, const struct optspec opts[])
 {
     struct opttbl tbl;
-    unsigned i;
-    int res;
 
 #if OPT_USE_ALLOCA
-    tbl.shrt = (const struct optspec **)alloca(sizeof *tbl.shrt * nopt);
-    tbl.lng = (const struct optspec **)alloca(sizeof *tbl.lng * nopt);
+    const struct optspec **shrtbuf, **lngbuf;
+
+    shrtbuf = (const struct optspec **)alloca(sizeof *shrtbuf * nopt);
+    lngbuf = (const struct optspec **)alloca(sizeof *lngbuf * nopt);
 #else
     const struct optspec *shrtbuf[OPT_VLEN(nopt)], *lngbuf[OPT_VLEN(nopt)];
 
-    tbl.shrt = shrtbuf;
-    tbl.lng = lngbuf;
-
     /* Clamp to prevent overrunning */
     nopt = opt_min(OPT_VLEN(nopt), nopt);
 #endif
 
-    tbl.nopt = nopt;
-    tbl.opts = opts;
-    tbl.nlng = 0;
-    tbl.nshrt = 0;
-    for (i = 0; i < nopt; i++) {
-        if (isgraph(opts[i].shrt)) {
-            tbl.shrt[tbl.nshrt++] = &opts[i];
-        }
-        if (opts[i].lng && *opts[i].lng) {
-            tbl.lng[tbl.nlng++] = &opts[i];
-        }
-    }
-    qsort(tbl.shrt, tbl.nshrt, sizeof *tbl.shrt, optspec_shrtcmp);
-    qsort(tbl.lng, tbl.nlng, sizeof *tbl.lng, optspec_lngcmp);
-    res = opt_first(info);
-    return res ? res : opt_read(info, &tbl);
+    /* The parse covers the table build */
+    OPT_PROBE3(parse__entry, info->argc, nopt, OPT_PROBE_NOW());
+    opt_tbl_init(&tbl, nopt, opts, shrtbuf, lngbuf);
+    return opt_run(info, &tbl);
 }
 
 #endif /* OPT_IMPLEMENTATION */
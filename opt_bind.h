@@ -0,0 +1,740 @@
+#pragma once
+/** @file opt_bind.h typed option values, decoded lazily.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  A tool with dozens of list, map and address set options decodes all of
+ *  them on every run, though most runs read only a few. Bindings decode
+ *  nothing during the parse. The parse only records where each option's
+ *  arguments are, and an option is decoded the first time it is asked for.
+ *
+ *  Give each option a binding with its decoder, in an array that runs
+ *  parallel to the option table, and point the table's callbacks at
+ *  opt_bind with the bindings as the callback data:
+ *
+ *  static struct optbind binds[] = {
+ *      { opt_dec_ints  },      --ports 80,443
+ *      { opt_dec_map   },      --label team=infra,tier=1
+ *      { opt_dec_cidrs },      --allow 10.0.0.0/8 fd00::/8
+ *      { NULL          }       --verbose, a flag
+ *  };
+ *  static struct optbinds store = { 4, binds };
+ *  ...
+ *  info.data = &store;
+ *  opt_parse(&info, 4, opts);
+ *  ...
+ *  if ((ports = (const struct optints *)opt_bind_get(&store, 0))) {
+ *      ... ports->v[0] to ports->v[ports->n - 1] ...
+ *  }
+ *  ...
+ *  opt_bind_free(&store);
+ *
+ *  A callback of your own can record with opt_bind_add instead. An option
+ *  given more than once accumulates its arguments, in order. The decoded
+ *  value is cached, so later calls cost a pointer lookup. A decode error
+ *  surfaces on the first access, with opt_bind_get returning NULL and
+ *  opt_bind_error naming the bad argument. opt_bind_check decodes every
+ *  option that was given and reports the first error, for tools that would
+ *  rather fail before doing anything.
+ *
+ *  The arguments are not copied, so they must outlive the bindings (argv
+ *  does). Decoding is not thread-safe. Call opt_bind_check before sharing the
+ *  bindings between threads.
+ *
+ *  This uses the heap. opt_dec_cidrs is POSIX-only (inet_pton(3)).
+ */
+#ifndef OPT_BIND_H
+#define OPT_BIND_H
+
+#include "opt.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+/** @brief Decode option arguments into a value
+ *  @param count
+ *      Argument count, over every time the option was given
+ *  @param args
+ *      Arguments
+ *  @param val
+ *      Set to the value, a single block from malloc(3) that free(3) releases
+ *  @param bad
+ *      Set to the index of the argument at fault on error
+ *  @returns Zero, or an errno value: EINVAL for a malformed argument, ERANGE
+ *      for one out of range, ENOMEM
+ */
+typedef int optdecfn_t(unsigned count, char *args[], void **val, unsigned *bad);
+
+
+/** @brief Binding of one option. Zero it apart from the decoder */
+struct optbind {
+    optdecfn_t  *dec;       /* Decoder (NULL: arguments only) */
+
+    /* Private */
+    unsigned     given;     /* Times the option was given */
+    unsigned     count;     /* Arguments recorded */
+    unsigned     cap;
+    char       **args;
+    void        *val;       /* Decoded value */
+    int          err;       /* Decoder's error */
+    unsigned     bad;       /* Index of the bad argument */
+    int          done;      /* Whether it was decoded */
+};
+
+
+/** @brief Bindings for an option table */
+struct optbinds {
+    unsigned        nbind;  /* Length of bind, that of the option table */
+    struct optbind *bind;   /* One per option */
+};
+
+
+/** @brief Integers, from opt_dec_ints */
+struct optints {
+    size_t     n;
+    long long *v;
+};
+
+
+/** @brief Reals, from opt_dec_reals */
+struct optreals {
+    size_t  n;
+    double *v;
+};
+
+
+/** @brief A key and its value, in struct optmap */
+struct optkv {
+    const char *key;
+    const char *val;
+};
+
+
+/** @brief Map from keys to values, from opt_dec_map, sorted by key */
+struct optmap {
+    size_t        n;
+    struct optkv *kv;
+};
+
+
+/** @brief An address prefix, in struct optcidrs */
+struct optcidr {
+    unsigned char addr[16]; /* In network order, host bits cleared */
+    unsigned char bits;     /* Prefix length */
+    unsigned char v6;       /* Nonzero for IPv6, else addr[0..3] is IPv4 */
+};
+
+
+/** @brief Set of address prefixes, from opt_dec_cidrs */
+struct optcidrs {
+    size_t          n;
+    struct optcidr *v;
+};
+
+
+/** @brief Option callback that records its arguments in the struct optbinds
+ *      given as @p data */
+int opt_bind(int idx, unsigned count, char *args[], void *data);
+
+
+/** @brief Record arguments of option @p idx
+ *  @param binds
+ *      Bindings
+ *  @param idx
+ *      Option index
+ *  @param count
+ *      Argument count
+ *  @param args
+ *      Arguments, which are not copied
+ *  @returns Zero, or nonzero if memory ran out, to stop the parse
+ */
+int opt_bind_add(struct optbinds *binds, int idx, unsigned count, char *args[]);
+
+
+/** @brief How many times option @p idx was given */
+unsigned opt_bind_given(const struct optbinds *binds, int idx);
+
+
+/** @brief The arguments of option @p idx, as recorded
+ *  @param binds
+ *      Bindings
+ *  @param idx
+ *      Option index
+ *  @param count
+ *      Set to the argument count
+ *  @returns The arguments
+ */
+char **opt_bind_args(const struct optbinds *binds, int idx, unsigned *count);
+
+
+/** @brief The value of option @p idx, decoded if this is the first access
+ *  @param binds
+ *      Bindings
+ *  @param idx
+ *      Option index
+ *  @returns The value, as its decoder makes it, or NULL if the option was
+ *      not given, has no decoder or failed to decode
+ */
+const void *opt_bind_get(struct optbinds *binds, int idx);
+
+
+/** @brief Why option @p idx failed to decode
+ *  @param binds
+ *      Bindings
+ *  @param idx
+ *      Option index
+ *  @param arg
+ *      Set to the bad argument on error, if not NULL
+ *  @returns Zero, or the decoder's errno value
+ */
+int opt_bind_error(const struct optbinds *binds, int idx, const char **arg);
+
+
+/** @brief Decode every option that was given and is not decoded yet
+ *  @param binds
+ *      Bindings
+ *  @returns -1 if all decoded, otherwise the index of the first option that
+ *      did not, for opt_bind_error
+ */
+int opt_bind_check(struct optbinds *binds);
+
+
+/** @brief Free the recorded arguments and the decoded values
+ *  @param binds
+ *      Bindings
+ */
+void opt_bind_free(struct optbinds *binds);
+
+
+/** @brief Decoder: integers, separated by commas within each argument, in
+ *      the bases of strtoll(3) with base 0. Makes a struct optints */
+int opt_dec_ints(unsigned count, char *args[], void **val, unsigned *bad);
+
+
+/** @brief Decoder: reals, separated by commas within each argument, as
+ *      strtod(3) reads them. Makes a struct optreals */
+int opt_dec_reals(unsigned count, char *args[], void **val, unsigned *bad);
+
+
+/** @brief Decoder: key=value pairs, separated by commas within each
+ *      argument. A key given again replaces its value. Makes a struct optmap
+ */
+int opt_dec_map(unsigned count, char *args[], void **val, unsigned *bad);
+
+
+/** @brief Decoder: IPv4 or IPv6 addresses with an optional /prefix length,
+ *      separated by commas within each argument. Makes a struct optcidrs */
+int opt_dec_cidrs(unsigned count, char *args[], void **val, unsigned *bad);
+
+
+/** @brief Look @p key up in @p map
+ *  @returns Its value, or NULL
+ */
+const char *opt_map_get(const struct optmap *map, const char *key);
+
+
+/** @brief Find the first prefix in @p set that contains an address
+ *  @param set
+ *      Prefixes
+ *  @param addr
+ *      Address in network order, 4 or 16 bytes
+ *  @param v6
+ *      Nonzero for IPv6
+ *  @returns The prefix, or NULL
+ */
+const struct optcidr *opt_cidr_find(const struct optcidrs *set,
+                                    const unsigned char   *addr,
+                                    int                    v6);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_BIND_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if __has_include(<arpa/inet.h>)
+#   include <arpa/inet.h>
+#   define OPT_BIND_INET 1
+#else
+#   define OPT_BIND_INET 0
+#endif
+
+
+#define OPT_BIND_MAXITEM 256    /* Longest list item, e.g. an address */
+
+
+OPT_EXTERN_C
+int opt_bind_add(struct optbinds *binds, int idx, unsigned count, char *args[])
+{
+    struct optbind *b;
+    unsigned cap;
+    void *p;
+
+    if (idx < 0 || (unsigned)idx >= binds->nbind) {
+        return 0;
+    }
+    b = &binds->bind[idx];
+    if (b->count + count > b->cap) {
+        for (cap = b->cap ? b->cap : 4; cap < b->count + count; cap *= 2) {
+            ;
+        }
+        if (!(p = realloc(b->args, cap * sizeof *b->args))) {
+            return -1;
+        }
+        b->args = (char **)p;
+        b->cap = cap;
+    }
+    if (count) {
+        memcpy(b->args + b->count, args, count * sizeof *args);
+    }
+    b->count += count;
+    b->given++;
+    /* More arguments make a new value */
+    if (b->done && count) {
+        free(b->val);
+        b->val = NULL;
+        b->err = b->done = 0;
+        b->bad = 0;
+    }
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_bind(int idx, unsigned count, char *args[], void *data)
+{
+    return opt_bind_add((struct optbinds *)data, idx, count, args);
+}
+
+
+OPT_EXTERN_C
+unsigned opt_bind_given(const struct optbinds *binds, int idx)
+{
+    if (idx < 0 || (unsigned)idx >= binds->nbind) {
+        return 0;
+    }
+    return binds->bind[idx].given;
+}
+
+
+OPT_EXTERN_C
+char **opt_bind_args(const struct optbinds *binds, int idx, unsigned *count)
+{
+    if (idx < 0 || (unsigned)idx >= binds->nbind) {
+        *count = 0;
+        return NULL;
+    }
+    *count = binds->bind[idx].count;
+    return binds->bind[idx].args;
+}
+
+
+OPT_EXTERN_C
+const void *opt_bind_get(struct optbinds *binds, int idx)
+{
+    struct optbind *b;
+
+    if (idx < 0 || (unsigned)idx >= binds->nbind) {
+        return NULL;
+    }
+    b = &binds->bind[idx];
+    if (!b->done && b->given && b->dec) {
+        b->bad = 0;
+        b->err = b->dec(b->count, b->args, &b->val, &b->bad);
+        if (b->err) {
+            b->val = NULL;
+        }
+        b->done = 1;
+    }
+    return b->val;
+}
+
+
+OPT_EXTERN_C
+int opt_bind_error(const struct optbinds *binds, int idx, const char **arg)
+{
+    const struct optbind *b;
+
+    if (idx < 0 || (unsigned)idx >= binds->nbind) {
+        return 0;
+    }
+    b = &binds->bind[idx];
+    if (arg) {
+        *arg = b->err && b->bad < b->count ? b->args[b->bad] : NULL;
+    }
+    return b->err;
+}
+
+
+OPT_EXTERN_C
+int opt_bind_check(struct optbinds *binds)
+{
+    unsigned i;
+
+    for (i = 0; i < binds->nbind; i++) {
+        opt_bind_get(binds, (int)i);
+        if (binds->bind[i].err) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+
+OPT_EXTERN_C
+void opt_bind_free(struct optbinds *binds)
+{
+    struct optbind *b;
+    unsigned i;
+
+    for (i = 0; i < binds->nbind; i++) {
+        b = &binds->bind[i];
+        free(b->args);
+        free(b->val);
+        b->given = b->count = b->cap = 0;
+        b->args = NULL;
+        b->val = NULL;
+        b->err = b->done = 0;
+        b->bad = 0;
+    }
+}
+
+
+/** @brief Walks the comma-separated items of a list of arguments */
+struct optitems {
+    unsigned    count;
+    char      **args;
+    unsigned    arg;    /* Current argument */
+    const char *pos;    /* Start of the next item in it */
+};
+
+
+/** @brief Get the next item of @p it into @p buf, NUL-terminated
+ *  @returns One, zero at the end, or -1 if the item is too long
+ */
+static int opt_item_next(struct optitems *it, char *buf, size_t *len)
+{
+    const char *end;
+
+    if (!it->pos) {
+        if (it->arg >= it->count) {
+            return 0;
+        }
+        it->pos = it->args[it->arg];
+    }
+    end = strchr(it->pos, ',');
+    *len = end ? (size_t)(end - it->pos) : strlen(it->pos);
+    if (*len >= OPT_BIND_MAXITEM) {
+        return -1;
+    }
+    memcpy(buf, it->pos, *len);
+    buf[*len] = '\0';
+    if (end) {
+        it->pos = end + 1;
+    } else {
+        it->pos = NULL;
+        it->arg++;
+    }
+    return 1;
+}
+
+
+/** @brief The argument the last item came from */
+static unsigned opt_item_arg(const struct optitems *it)
+{
+    return it->pos ? it->arg : it->arg - 1;
+}
+
+
+/** @brief Count the items in @p args, and the bytes in them */
+static size_t opt_item_count(unsigned count, char *args[], size_t *bytes)
+{
+    size_t n = 0;
+    unsigned i;
+    char *p;
+
+    *bytes = 0;
+    for (i = 0; i < count; i++) {
+        n++;
+        for (p = args[i]; *p; p++) {
+            n += *p == ',';
+        }
+        *bytes += (size_t)(p - args[i]) + 1;
+    }
+    return n;
+}
+
+
+OPT_EXTERN_C
+int opt_dec_ints(unsigned count, char *args[], void **val, unsigned *bad)
+{
+    struct optitems it = { 0, NULL, 0, NULL };
+    char buf[OPT_BIND_MAXITEM], *end;
+    struct optints *res;
+    size_t n, len;
+    int more;
+
+    it.count = count;
+    it.args = args;
+    n = opt_item_count(count, args, &len);
+    if (!(res = (struct optints *)malloc(sizeof *res + n * sizeof *res->v))) {
+        return ENOMEM;
+    }
+    res->v = (long long *)(res + 1);
+    res->n = 0;
+    while ((more = opt_item_next(&it, buf, &len)) > 0) {
+        errno = 0;
+        res->v[res->n] = strtoll(buf, &end, 0);
+        if (!len || *end || errno) {
+            more = errno == ERANGE ? ERANGE : -1;
+            break;
+        }
+        res->n++;
+    }
+    if (more) {
+        *bad = opt_item_arg(&it);
+        free(res);
+        return more == ERANGE ? ERANGE : EINVAL;
+    }
+    *val = res;
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_dec_reals(unsigned count, char *args[], void **val, unsigned *bad)
+{
+    struct optitems it = { 0, NULL, 0, NULL };
+    char buf[OPT_BIND_MAXITEM], *end;
+    struct optreals *res;
+    size_t n, len;
+    int more;
+
+    it.count = count;
+    it.args = args;
+    n = opt_item_count(count, args, &len);
+    if (!(res = (struct optreals *)malloc(sizeof *res + n * sizeof *res->v))) {
+        return ENOMEM;
+    }
+    res->v = (double *)(res + 1);
+    res->n = 0;
+    while ((more = opt_item_next(&it, buf, &len)) > 0) {
+        errno = 0;
+        res->v[res->n] = strtod(buf, &end);
+        if (!len || *end || errno) {
+            more = errno == ERANGE ? ERANGE : -1;
+            break;
+        }
+        res->n++;
+    }
+    if (more) {
+        *bad = opt_item_arg(&it);
+        free(res);
+        return more == ERANGE ? ERANGE : EINVAL;
+    }
+    *val = res;
+    return 0;
+}
+
+
+static int opt_kv_cmp(const void *p1, const void *p2)
+{
+    const struct optkv *kv1 = (const struct optkv *)p1;
+    const struct optkv *kv2 = (const struct optkv *)p2;
+    int res = strcmp(kv1->key, kv2->key);
+
+    /* Keys are copied in the order given, so equal keys keep that order
+     * by address, for the last to win */
+    return res ? res : (kv1->key > kv2->key) - (kv1->key < kv2->key);
+}
+
+
+OPT_EXTERN_C
+int opt_dec_map(unsigned count, char *args[], void **val, unsigned *bad)
+{
+    struct optmap *res;
+    size_t n, i, j, bytes;
+    unsigned a;
+    char *str, *p, *eq;
+
+    n = opt_item_count(count, args, &bytes);
+    res = (struct optmap *)malloc(sizeof *res + n * sizeof *res->kv + bytes);
+    if (!res) {
+        return ENOMEM;
+    }
+    res->kv = (struct optkv *)(res + 1);
+    res->n = 0;
+    str = (char *)(res->kv + n);
+    /* Copy the arguments and split them in place */
+    for (a = 0; a < count; a++) {
+        p = strcpy(str, args[a]);
+        str += strlen(str) + 1;
+        for (;;) {
+            res->kv[res->n].key = p;
+            p += strcspn(p, ",");
+            eq = (char *)memchr(res->kv[res->n].key, '=',
+                                (size_t)(p - res->kv[res->n].key));
+            if (!eq || eq == res->kv[res->n].key) {
+                *bad = a;
+                free(res);
+                return EINVAL;
+            }
+            *eq = '\0';
+            res->kv[res->n++].val = eq + 1;
+            if (!*p) {
+                break;
+            }
+            *p++ = '\0';
+        }
+    }
+    /* Sort, then keep the last of each key */
+    qsort(res->kv, res->n, sizeof *res->kv, opt_kv_cmp);
+    for (i = j = 0; i < res->n; i++) {
+        if (i + 1 < res->n && !strcmp(res->kv[i].key, res->kv[i + 1].key)) {
+            continue;
+        }
+        res->kv[j++] = res->kv[i];
+    }
+    res->n = j;
+    *val = res;
+    return 0;
+}
+
+
+OPT_EXTERN_C
+const char *opt_map_get(const struct optmap *map, const char *key)
+{
+    size_t lo = 0, hi = map ? map->n : 0, mid;
+    int res;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        res = strcmp(key, map->kv[mid].key);
+        if (!res) {
+            return map->kv[mid].val;
+        } else if (res < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+
+/** @brief Parse "address[/bits]" into @p cidr
+ *  @returns Zero or EINVAL
+ */
+static int opt_cidr_parse(char *str, struct optcidr *cidr)
+{
+    char *slash = strchr(str, '/'), *end;
+    unsigned max, i;
+    long bits;
+
+    memset(cidr, 0, sizeof *cidr);
+    if (slash) {
+        *slash = '\0';
+    }
+#if OPT_BIND_INET
+    if (inet_pton(AF_INET, str, cidr->addr) == 1) {
+        max = 32;
+    } else if (inet_pton(AF_INET6, str, cidr->addr) == 1) {
+        max = 128;
+        cidr->v6 = 1;
+    } else {
+        return EINVAL;
+    }
+#else
+    return EINVAL;
+#endif
+    bits = (long)max;
+    if (slash) {
+        bits = strtol(slash + 1, &end, 10);
+        if (!slash[1] || *end || bits < 0 || bits > (long)max) {
+            return EINVAL;
+        }
+    }
+    cidr->bits = (unsigned char)bits;
+    for (i = 0; i < max / 8; i++) {
+        if (i * 8 >= (unsigned)bits) {
+            cidr->addr[i] = 0;
+        } else if (i * 8 + 8 > (unsigned)bits) {
+            cidr->addr[i] &= (unsigned char)(0xff << (8 - (bits - i * 8)));
+        }
+    }
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_dec_cidrs(unsigned count, char *args[], void **val, unsigned *bad)
+{
+    struct optitems it = { 0, NULL, 0, NULL };
+    char buf[OPT_BIND_MAXITEM];
+    struct optcidrs *res;
+    size_t n, len;
+    int more;
+
+    it.count = count;
+    it.args = args;
+    n = opt_item_count(count, args, &len);
+    if (!(res = (struct optcidrs *)malloc(sizeof *res + n * sizeof *res->v))) {
+        return ENOMEM;
+    }
+    res->v = (struct optcidr *)(res + 1);
+    res->n = 0;
+    while ((more = opt_item_next(&it, buf, &len)) > 0) {
+        if (opt_cidr_parse(buf, &res->v[res->n])) {
+            more = -1;
+            break;
+        }
+        res->n++;
+    }
+    if (more) {
+        *bad = opt_item_arg(&it);
+        free(res);
+        return EINVAL;
+    }
+    *val = res;
+    return 0;
+}
+
+
+OPT_EXTERN_C
+const struct optcidr *opt_cidr_find(const struct optcidrs *set,
+                                    const unsigned char   *addr,
+                                    int                    v6)
+{
+    const struct optcidr *c;
+    unsigned full, rem;
+    size_t i;
+
+    for (i = 0; set && i < set->n; i++) {
+        c = &set->v[i];
+        if (!c->v6 != !v6) {
+            continue;
+        }
+        full = c->bits / 8u;
+        rem = c->bits % 8u;
+        if (!memcmp(c->addr, addr, full)
+                && (!rem || !((c->addr[full] ^ addr[full])
+                              & (0xff << (8 - rem)) & 0xff))) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+#endif /* OPT_IMPLEMENTATION */
@@ -0,0 +1,452 @@
+#pragma once
+/** @file opt_file.h option values read from files, mapped in place.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  Certificates, policies and manifests are too big to pass inline on the
+ *  command line, and every callback that opens and reads a file itself does
+ *  the same work. Instead, an argument "@path" stands for the contents of
+ *  path, and opt_file_expand turns an option's arguments into spans of bytes
+ *  from inside its callback:
+ *
+ *  static struct optfile files;
+ *
+ *  static int cert(int idx, unsigned count, char *args[], void *data)
+ *  {
+ *      return opt_file_expand(&files, idx, count, args, use_cert, data);
+ *  }
+ *
+ *  use_cert is then called with a struct optspan for each argument:
+ *
+ *  - "@path": the contents of path, mapped read-only
+ *  - "@@text": the literal text "@text"
+ *  - anything else: the argument itself
+ *
+ *  With OPT_FILE_ALL set, every argument is a path, with or without the '@'
+ *  (but "@@text" is still literal).
+ *  Regular files are mapped with mmap(2) and advised POSIX_MADV_WILLNEED, so
+ *  their pages are read in while the parse goes on. Anything else, such as a
+ *  pipe from "<(command)", is read into the heap, and so are files that
+ *  report no size, such as those in /proc. Either way the bytes are not
+ *  NUL-terminated, and they stay valid until opt_file_free.
+ *
+ *  Opening files one option at a time waits on each in turn, which adds up
+ *  on network filesystems. opt_file_load looks for "@path" arguments all
+ *  over argv before the parse and opens and maps them all at once, with a
+ *  pool of threads. opt_file_expand then finds them ready. It is a hint
+ *  only: a file it cannot open is reported by opt_file_expand, if an option
+ *  that takes files is ever given it. The arguments of one opt_file_expand
+ *  call that were not loaded beforehand are opened concurrently as well.
+ *
+ *  Files are keyed by the argument string's address, not its text, so the
+ *  args must be those of the argv that was loaded.
+ *
+ *  This is POSIX-only, uses the heap, and needs -pthread. With a strict -std,
+ *  define _POSIX_C_SOURCE to 200809L (or _GNU_SOURCE) before the first
+ *  include for O_CLOEXEC and posix_madvise(3).
+ */
+#ifndef OPT_FILE_H
+#define OPT_FILE_H
+
+#include "opt.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+#define OPT_FILE_ALL    0x1 /* Every argument is a path, with or without '@' */
+
+
+/** @brief Bytes of an option value */
+struct optspan {
+    const char *ptr;    /* Not NUL-terminated */
+    size_t      len;
+};
+
+
+/** @brief Files mapped for a parse. Zero it apart from the parameters */
+struct optfile {
+    unsigned            flags;      /* OPT_FILE_* */
+    unsigned            nthread;    /* Opening threads (0: 16) */
+    const char         *failed;     /* Argument that could not be read */
+
+    /* Private */
+    struct optfilemap  *maps;       /* Sorted by argument */
+    size_t              nmap;
+    size_t              cap;
+};
+
+
+/** @brief Called with the values of an option
+ *  @param idx
+ *      The option index
+ *  @param count
+ *      The number of values
+ *  @param vals
+ *      The values, valid until opt_file_free
+ *  @param data
+ *      User data
+ *  @returns Nonzero to stop
+ */
+typedef int optfilefn_t(int                   idx,
+                        unsigned              count,
+                        const struct optspan  vals[],
+                        void                 *data);
+
+
+/** @brief Open and map every "@path" argument in @p argv, concurrently
+ *  @param file
+ *      Files
+ *  @param argc
+ *      Argument count
+ *  @param argv
+ *      Arguments, as later passed to the parse
+ *  @returns Zero, or -1 with errno set if memory ran out. Files that cannot
+ *      be read are only reported by opt_file_expand
+ */
+int opt_file_load(struct optfile *file, int argc, char *argv[]);
+
+
+/** @brief Read the files named by the arguments given to an option callback
+ *      and pass their contents on to @p func
+ *  @param file
+ *      Files
+ *  @param idx
+ *      Passed to @p func
+ *  @param count
+ *      Argument count
+ *  @param args
+ *      Arguments
+ *  @param func
+ *      Called once with a span per argument
+ *  @param data
+ *      Passed to @p func
+ *  @returns Zero, what @p func returned to stop, or -1 with errno set and
+ *      file->failed set to the argument that could not be read
+ */
+int opt_file_expand(struct optfile  *file,
+                    int              idx,
+                    unsigned         count,
+                    char            *args[],
+                    optfilefn_t     *func,
+                    void            *data);
+
+
+/** @brief Unmap and free everything that was read
+ *  @param file
+ *      Files
+ */
+void opt_file_free(struct optfile *file);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_FILE_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define OPT_FILE_THREADS    16      /* Default opening threads */
+#define OPT_FILE_MAXTHREAD  64
+#define OPT_FILE_BATCH      64      /* Spans per opt_file_expand call */
+#define OPT_FILE_READ       65536   /* First read of an unmappable file */
+
+
+/** @brief One file */
+struct optfilemap {
+    const char *arg;    /* The argument naming it */
+    char       *ptr;    /* Contents */
+    size_t      len;
+    int         mapped; /* Whether ptr is mapped, rather than allocated */
+    int         err;    /* errno from reading it, -1 if not read yet */
+};
+
+
+/** @brief Maps being read by a pool of threads */
+struct optfilepool {
+    struct optfilemap  *maps;
+    size_t              n;
+    size_t              next;   /* Next to claim */
+    unsigned            flags;
+    pthread_mutex_t     lock;
+};
+
+
+/** @brief The path in @p arg, or NULL if it is not one */
+static const char *opt_file_path(unsigned flags, const char *arg)
+{
+    if (arg[0] == '@') {
+        return arg[1] == '@' ? NULL : arg + 1;
+    }
+    return flags & OPT_FILE_ALL ? arg : NULL;
+}
+
+
+/** @brief Read the whole of @p fd into the heap */
+static int opt_file_slurp(struct optfilemap *m, int fd)
+{
+    size_t cap = OPT_FILE_READ;
+    ssize_t n;
+    void *p;
+
+    m->len = 0;
+    if (!(m->ptr = (char *)malloc(cap))) {
+        return ENOMEM;
+    }
+    while ((n = read(fd, m->ptr + m->len, cap - m->len))) {
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            return errno;
+        }
+        m->len += (size_t)n;
+        if (m->len == cap) {
+            if (!(p = realloc(m->ptr, cap * 2))) {
+                return ENOMEM;
+            }
+            m->ptr = (char *)p;
+            cap *= 2;
+        }
+    }
+    return 0;
+}
+
+
+/** @brief Open and map or read one file */
+static void opt_file_open(struct optfilemap *m, unsigned flags)
+{
+    struct stat st;
+    void *p;
+    int fd;
+
+    if ((fd = open(opt_file_path(flags, m->arg), O_RDONLY | O_CLOEXEC)) < 0) {
+        m->err = errno;
+        return;
+    }
+    if (fstat(fd, &st)) {
+        m->err = errno;
+    } else if (!S_ISREG(st.st_mode) || !st.st_size) {
+        /* Files such as /proc/self/cmdline have no size until read */
+        m->err = opt_file_slurp(m, fd);
+    } else {
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            m->err = errno;
+        } else {
+            posix_madvise(p, (size_t)st.st_size, POSIX_MADV_WILLNEED);
+            m->ptr = (char *)p;
+            m->len = (size_t)st.st_size;
+            m->mapped = 1;
+            m->err = 0;
+        }
+    }
+    close(fd);
+}
+
+
+static void *opt_file_thread(void *arg)
+{
+    struct optfilepool *pool = (struct optfilepool *)arg;
+    size_t i;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        i = pool->next < pool->n ? pool->next++ : pool->n;
+        pthread_mutex_unlock(&pool->lock);
+        if (i == pool->n) {
+            return NULL;
+        }
+        opt_file_open(&pool->maps[i], pool->flags);
+    }
+}
+
+
+/** @brief Read maps[0] to maps[n - 1], concurrently if there are several */
+static void opt_file_read(struct optfile *file, struct optfilemap *maps,
+                          size_t n)
+{
+    pthread_t thread[OPT_FILE_MAXTHREAD];
+    struct optfilepool pool;
+    unsigned t = file->nthread ? file->nthread : OPT_FILE_THREADS, i, nt;
+
+    t = t < OPT_FILE_MAXTHREAD ? t : OPT_FILE_MAXTHREAD;
+    t = n < t ? (unsigned)n : t;
+    pool.maps = maps;
+    pool.n = n;
+    pool.next = 0;
+    pool.flags = file->flags;
+    pthread_mutex_init(&pool.lock, NULL);
+    for (nt = 0; t > 1 && nt < t; nt++) {
+        if (pthread_create(&thread[nt], NULL, opt_file_thread, &pool)) {
+            break;
+        }
+    }
+    /* The caller works too, and alone if no thread started */
+    opt_file_thread(&pool);
+    for (i = 0; i < nt; i++) {
+        pthread_join(thread[i], NULL);
+    }
+    pthread_mutex_destroy(&pool.lock);
+}
+
+
+static int opt_file_cmp(const void *a, const void *b)
+{
+    const char *x = ((const struct optfilemap *)a)->arg;
+    const char *y = ((const struct optfilemap *)b)->arg;
+
+    return (x > y) - (x < y);
+}
+
+
+/** @brief The map for @p arg, or NULL */
+static struct optfilemap *opt_file_find(struct optfile *file, const char *arg)
+{
+    size_t lo = 0, hi = file->nmap, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (file->maps[mid].arg == arg) {
+            return &file->maps[mid];
+        } else if (file->maps[mid].arg < arg) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+
+/** @brief Add maps, unread, for those of @p args that are paths not seen
+ *      yet, and read them
+ *  @returns Zero, or -1 if memory ran out */
+static int opt_file_add(struct optfile *file, size_t count, char *args[])
+{
+    size_t i, n = file->nmap, cap;
+    struct optfilemap *m;
+    void *p;
+
+    for (i = 0; i < count; i++) {
+        if (!opt_file_path(file->flags, args[i])
+                || opt_file_find(file, args[i])) {
+            continue;
+        }
+        if (n == file->cap) {
+            cap = file->cap ? file->cap * 2 : 16;
+            if (!(p = realloc(file->maps, cap * sizeof *file->maps))) {
+                errno = ENOMEM;
+                return -1;
+            }
+            file->maps = (struct optfilemap *)p;
+            file->cap = cap;
+        }
+        m = &file->maps[n++];
+        m->arg = args[i];
+        m->ptr = NULL;
+        m->len = 0;
+        m->mapped = 0;
+        m->err = -1;
+    }
+    if (n > file->nmap) {
+        opt_file_read(file, file->maps + file->nmap, n - file->nmap);
+        file->nmap = n;
+        qsort(file->maps, n, sizeof *file->maps, opt_file_cmp);
+    }
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_file_load(struct optfile *file, int argc, char *argv[])
+{
+    /* Only "@path", whatever the flags: the other arguments may be anything */
+    const unsigned flags = file->flags;
+    int res;
+
+    file->flags &= ~(unsigned)OPT_FILE_ALL;
+    res = opt_file_add(file, argc > 0 ? (size_t)argc : 0, argv);
+    file->flags = flags;
+    return res;
+}
+
+
+OPT_EXTERN_C
+int opt_file_expand(struct optfile  *file,
+                    int              idx,
+                    unsigned         count,
+                    char            *args[],
+                    optfilefn_t     *func,
+                    void            *data)
+{
+    struct optspan stack[OPT_FILE_BATCH], *vals = stack;
+    struct optfilemap *m;
+    unsigned i;
+    int res;
+
+    file->failed = NULL;
+    if (opt_file_add(file, count, args)) {
+        return -1;
+    }
+    if (count > OPT_FILE_BATCH
+            && !(vals = (struct optspan *)malloc(count * sizeof *vals))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if (!opt_file_path(file->flags, args[i])) {
+            vals[i].ptr = args[i][0] == '@' ? args[i] + 1 : args[i];
+            vals[i].len = strlen(vals[i].ptr);
+            continue;
+        }
+        m = opt_file_find(file, args[i]);
+        if (m->err) {
+            file->failed = args[i];
+            errno = m->err;
+            break;
+        }
+        vals[i].ptr = m->ptr ? m->ptr : "";
+        vals[i].len = m->len;
+    }
+    res = i < count ? -1 : func(idx, count, vals, data);
+    if (vals != stack) {
+        free(vals);
+    }
+    return res;
+}
+
+
+OPT_EXTERN_C
+void opt_file_free(struct optfile *file)
+{
+    size_t i;
+
+    for (i = 0; i < file->nmap; i++) {
+        if (file->maps[i].mapped) {
+            munmap(file->maps[i].ptr, file->maps[i].len);
+        } else {
+            free(file->maps[i].ptr);
+        }
+    }
+    free(file->maps);
+    file->maps = NULL;
+    file->nmap = 0;
+    file->cap = 0;
+}
+
+#endif /* OPT_IMPLEMENTATION */
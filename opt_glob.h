@@ -0,0 +1,941 @@
+#pragma once
+/** @file opt_glob.h parallel glob expansion of command line arguments.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  A pattern that would expand to more arguments than ARG_MAX allows, or just
+ *  to a great many, is better quoted and left for the tool to expand itself.
+ *  opt_glob_expand does that from inside an option or positional callback:
+ *
+ *  static int positional(int idx, unsigned count, char *args[], void *data)
+ *  {
+ *      return opt_glob_expand(NULL, idx, count, args, add_files, data);
+ *  }
+ *
+ *  add_files is then called with the arguments in batches, as if they had
+ *  been expanded by the shell: each argument containing an unescaped * ? or [
+ *  is replaced by the paths it matches, in order, and other arguments are
+ *  passed through. A pattern that matches nothing is passed through as well,
+ *  like sh(1) does, unless OPT_GLOB_NULL is set.
+ *
+ *  Each /-separated component of a pattern is matched with fnmatch(3), and a
+ *  component that is exactly ** matches any number of directories (not
+ *  following symbolic links). A trailing / matches directories only.
+ *  Hidden names are only matched by an explicit leading dot, unless
+ *  OPT_GLOB_DOT is set.
+ *
+ *  The paths come out in a deterministic order: a depth-first walk with the
+ *  entries of each directory sorted bytewise, so a directory comes just
+ *  before its contents. Directories are read with getdents64(2) on Linux
+ *  (readdir(3) elsewhere) and only the entries that can still match are
+ *  kept. While the walk goes on, a pool of threads reads and sorts the
+ *  directories it will come to next, up to a bounded number ahead.
+ *
+ *  Memory is bounded: no directory listing holds more than "maxent" entries.
+ *  A directory with more matching entries than that is walked in sorted runs
+ *  of "maxent", rereading it for each run, so even a directory of millions of
+ *  files takes fixed memory and still comes out in order.
+ *
+ *  This is POSIX-only, uses the heap, and needs -pthread. With a strict -std,
+ *  define _GNU_SOURCE (or _DEFAULT_SOURCE) before the first include for the
+ *  d_type constants and syscall(2).
+ */
+#ifndef OPT_GLOB_H
+#define OPT_GLOB_H
+
+#include "opt.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+#define OPT_GLOB_DOT    0x1 /* Wildcards match a leading dot */
+#define OPT_GLOB_NULL   0x2 /* Drop patterns that match nothing */
+#define OPT_GLOB_ERR    0x4 /* Stop at unreadable directories */
+
+
+/** @brief Expansion parameters. A null pointer means all defaults */
+struct optglob {
+    unsigned flags;     /* OPT_GLOB_* */
+    unsigned nthread;   /* Directory reading threads (0: online CPUs) */
+    unsigned maxent;    /* Entries per directory listing (0: 65536) */
+};
+
+
+/** @brief Called for each matching path
+ *  @param path
+ *      The path, valid until this returns
+ *  @param data
+ *      User data
+ *  @returns Nonzero to stop
+ */
+typedef int optglobfn_t(const char *path, void *data);
+
+
+/** @brief Expand one pattern
+ *  @param glob
+ *      Parameters, or NULL for defaults
+ *  @param pattern
+ *      The pattern
+ *  @param func
+ *      Called for each match, in order
+ *  @param data
+ *      User data for @p func
+ *  @returns Zero, what @p func returned to stop, or -1 with errno set. Zero
+ *      matches is not an error. A pattern of more than 62 components after
+ *      its literal leading ones is EINVAL
+ */
+int opt_glob(const struct optglob *glob,
+             const char           *pattern,
+             optglobfn_t          *func,
+             void                 *data);
+
+
+/** @brief Expand the arguments given to an option or positional callback and
+ *      pass them on to @p func in batches
+ *  @param glob
+ *      Parameters, or NULL for defaults
+ *  @param idx
+ *      Passed to @p func
+ *  @param count
+ *      Argument count
+ *  @param args
+ *      Arguments
+ *  @param func
+ *      Called with consecutive batches of expanded arguments
+ *  @param data
+ *      Passed to @p func
+ *  @returns Zero, what @p func returned to stop, or -1 with errno set
+ */
+int opt_glob_expand(const struct optglob *glob,
+                    int                   idx,
+                    unsigned              count,
+                    char                 *args[],
+                    optcbfn_t            *func,
+                    void                 *data);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_GLOB_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#   include <sys/syscall.h>
+#endif
+
+
+#define OPT_GLOB_MAXCOMP    62      /* Wildcard components in a pattern */
+#define OPT_GLOB_MAXTHREAD  64
+#define OPT_GLOB_AHEAD      8       /* Listings read ahead per thread */
+#define OPT_GLOB_BATCH      64      /* Arguments per opt_glob_expand call */
+#define OPT_GLOB_BLOCK      65536   /* Name storage block */
+#define OPT_GLOB_DENTS      32768   /* getdents64 buffer */
+#define OPT_GLOB_ISDIR      (1ull << 63)    /* In optglobent.next */
+
+/* A state bit per component, one for the end, then OPT_GLOB_ISDIR */
+typedef char opt_glob_maxcomp_check[(1ull << OPT_GLOB_MAXCOMP) < OPT_GLOB_ISDIR
+                                    ? 1 : -1];
+
+/* Listing states */
+#define OPT_GLOB_UNREAD     0
+#define OPT_GLOB_QUEUED     1
+#define OPT_GLOB_CLAIMED    2
+#define OPT_GLOB_DONE       3
+
+
+/** @brief Block of name storage. Names never move once stored */
+struct optglobblk {
+    struct optglobblk *next;
+    size_t             len;
+    char               buf[OPT_GLOB_BLOCK];
+};
+
+
+#if defined(__linux__) && defined(SYS_getdents64)
+/** @brief struct linux_dirent64, as read by getdents64 */
+struct optglobdent {
+    unsigned long long  ino;
+    long long           off;
+    unsigned short      reclen;
+    unsigned char       type;
+    char                name[1];
+};
+#endif
+
+
+/** @brief A matching directory entry */
+struct optglobent {
+    const char         *name;
+    unsigned long long  next;   /* Pattern states after it */
+    struct optglobdir  *sub;    /* Its listing, if it is walked into */
+};
+
+
+/** @brief Listing of the matching entries of one directory */
+struct optglobdir {
+    struct optglobdir  *next;   /* Read-ahead queue links */
+    struct optglobdir  *prev;
+    char               *path;   /* "" or ending in '/' */
+    unsigned long long  states; /* Pattern states inside it */
+    struct optglobent  *ents;
+    size_t              nent;
+    size_t              cap;
+    struct optglobblk  *names;
+    int                 more;   /* Entries were left for another run */
+    int                 err;    /* errno from reading it */
+    int                 state;  /* OPT_GLOB_UNREAD... */
+};
+
+
+/** @brief Expansion of one pattern */
+struct optglobctx {
+    unsigned            flags;
+    size_t              maxent;
+    unsigned            ncomp;
+    const char         *comp[OPT_GLOB_MAXCOMP + 1];
+    unsigned long long  star;       /* States that are ** */
+    int                 dirsonly;   /* Trailing slash */
+    optglobfn_t        *func;
+    void               *data;
+    char               *buf;        /* Path being emitted */
+    size_t              bufcap;
+    /* Read-ahead pool */
+    unsigned            nthread;
+    pthread_t           thread[OPT_GLOB_MAXTHREAD];
+    pthread_mutex_t     lock;
+    pthread_cond_t      work;       /* Queue not empty, or stop */
+    pthread_cond_t      done;       /* A listing was finished */
+    struct optglobdir  *head;
+    struct optglobdir  *tail;
+    unsigned            ahead;      /* Listings queued or read, not walked */
+    int                 stop;
+};
+
+
+/** @brief End state bit */
+#define OPT_GLOB_END(ctx) (1ull << (ctx)->ncomp)
+
+
+/** @brief Add the states that ** can skip to */
+static unsigned long long opt_glob_closure(const struct optglobctx *ctx,
+                                           unsigned long long       states)
+{
+    unsigned k;
+
+    for (k = 0; k < ctx->ncomp; k++) {
+        if (states & ctx->star & 1ull << k) {
+            states |= 1ull << (k + 1);
+        }
+    }
+    return states;
+}
+
+
+/** @brief States after an entry called @p name */
+static unsigned long long opt_glob_step(const struct optglobctx *ctx,
+                                        unsigned long long       states,
+                                        const char              *name)
+{
+    int flags = ctx->flags & OPT_GLOB_DOT ? 0 : FNM_PERIOD;
+    unsigned long long next = 0;
+    unsigned k;
+
+    if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) {
+        return 0;
+    }
+    for (k = 0; k < ctx->ncomp; k++) {
+        if (!(states & 1ull << k)) {
+            continue;
+        } else if (ctx->star & 1ull << k) {
+            if (name[0] != '.' || ctx->flags & OPT_GLOB_DOT) {
+                next |= 1ull << k;
+            }
+        } else if (!fnmatch(ctx->comp[k], name, flags)) {
+            next |= 1ull << (k + 1);
+        }
+    }
+    return opt_glob_closure(ctx, next);
+}
+
+
+/** @brief Store @p name in @p dir's name blocks */
+static const char *opt_glob_store(struct optglobdir *dir, const char *name)
+{
+    size_t len = strlen(name) + 1;
+    struct optglobblk *blk = dir->names;
+    char *str;
+
+    if (!blk || blk->len + len > OPT_GLOB_BLOCK) {
+        if (!(blk = (struct optglobblk *)malloc(sizeof *blk))) {
+            return NULL;
+        }
+        blk->next = dir->names;
+        blk->len = 0;
+        dir->names = blk;
+    }
+    str = blk->buf + blk->len;
+    memcpy(str, name, len);
+    blk->len += len;
+    return str;
+}
+
+
+/** @brief Free @p blk and the blocks after it */
+static void opt_glob_free_names(struct optglobblk *blk)
+{
+    struct optglobblk *next;
+
+    for (; blk; blk = next) {
+        next = blk->next;
+        free(blk);
+    }
+}
+
+
+static int opt_glob_entcmp(const void *a, const void *b)
+{
+    return strcmp(((const struct optglobent *)a)->name,
+                  ((const struct optglobent *)b)->name);
+}
+
+
+/** @brief Sort the entries of @p dir and keep the first @p max, moving their
+ *      names to fresh blocks so the rest can be freed */
+static int opt_glob_trim(struct optglobdir *dir, size_t max)
+{
+    struct optglobblk *old = dir->names;
+    size_t i;
+
+    if (dir->nent > 1) {
+        qsort(dir->ents, dir->nent, sizeof *dir->ents, opt_glob_entcmp);
+    }
+    if (dir->nent <= max) {
+        return 0;
+    }
+    dir->nent = max;
+    dir->more = 1;
+    dir->names = NULL;
+    for (i = 0; i < dir->nent; i++) {
+        if (!(dir->ents[i].name = opt_glob_store(dir, dir->ents[i].name))) {
+            opt_glob_free_names(old);
+            return -1;
+        }
+    }
+    opt_glob_free_names(old);
+    return 0;
+}
+
+
+/** @brief Consider the entry @p name of type @p type (a DT_* value) */
+static int opt_glob_entry(struct optglobctx *ctx,
+                          struct optglobdir *dir,
+                          int                fd,
+                          const char        *name,
+                          int                type,
+                          const char        *after,
+                          const char       **cut)
+{
+    unsigned long long next, sub;
+    struct optglobent *ent;
+    struct stat st;
+    size_t cap;
+    int isdir = type == DT_DIR;
+
+    /* Runs after the first skip what was walked already, and everything
+     * starts skipping what is past the best so far once the listing is full */
+    if ((after && strcmp(name, after) <= 0) || (*cut && strcmp(name, *cut) > 0)
+     || !(next = opt_glob_step(ctx, dir->states, name))) {
+        return 0;
+    }
+    sub = next & ~OPT_GLOB_END(ctx);
+    if (type == DT_LNK || type == DT_UNKNOWN) {
+        if ((sub || ctx->dirsonly) && !fstatat(fd, name, &st, 0)) {
+            isdir = S_ISDIR(st.st_mode);
+        }
+        /* ** does not follow links */
+        if (type == DT_LNK && sub && ctx->star) {
+            sub = opt_glob_step(ctx, dir->states & ~ctx->star, name)
+                & ~OPT_GLOB_END(ctx);
+        }
+    }
+    if (!isdir) {
+        if (ctx->dirsonly || !(next & OPT_GLOB_END(ctx))) {
+            return 0;
+        }
+        next = OPT_GLOB_END(ctx);
+    } else if (!sub && !(next & OPT_GLOB_END(ctx))) {
+        return 0;
+    } else {
+        next = sub | (next & OPT_GLOB_END(ctx));
+    }
+    if (dir->nent == dir->cap && dir->cap < ctx->maxent * 2) {
+        cap = dir->cap ? dir->cap * 2 : 64;
+        cap = cap < ctx->maxent * 2 ? cap : ctx->maxent * 2;
+        if (!(ent = (struct optglobent *)realloc(dir->ents,
+                                                 cap * sizeof *ent))) {
+            return -1;
+        }
+        dir->ents = ent;
+        dir->cap = cap;
+    }
+    if (dir->nent == ctx->maxent * 2) {
+        if (opt_glob_trim(dir, ctx->maxent)) {
+            return -1;
+        }
+        *cut = dir->ents[dir->nent - 1].name;
+        if (strcmp(name, *cut) > 0) {
+            return 0;
+        }
+    }
+    ent = &dir->ents[dir->nent];
+    if (!(ent->name = opt_glob_store(dir, name))) {
+        return -1;
+    }
+    ent->next = next | (isdir ? OPT_GLOB_ISDIR : 0);
+    ent->sub = NULL;
+    dir->nent++;
+    return 0;
+}
+
+
+/** @brief Read the entries of @p dir that sort after @p after, at most
+ *      "maxent" of them */
+static void opt_glob_read(struct optglobctx *ctx,
+                          struct optglobdir *dir,
+                          const char        *after)
+{
+    const char *cut = NULL;
+    int fd, res = 0;
+#if defined(__linux__) && defined(SYS_getdents64)
+    struct optglobdent *de;
+    char *buf;
+    long n, pos;
+#else
+    struct dirent *de;
+    DIR *dp;
+#endif
+
+    dir->nent = 0;
+    dir->more = 0;
+    dir->err = 0;
+    opt_glob_free_names(dir->names);
+    dir->names = NULL;
+    fd = open(*dir->path ? dir->path : ".", O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        dir->err = errno;
+        return;
+    }
+#if defined(__linux__) && defined(SYS_getdents64)
+    if (!(buf = (char *)malloc(OPT_GLOB_DENTS))) {
+        close(fd);
+        dir->err = ENOMEM;
+        return;
+    }
+    while (!res && (n = syscall(SYS_getdents64, fd, buf, OPT_GLOB_DENTS)) > 0) {
+        for (pos = 0; !res && pos < n; pos += de->reclen) {
+            de = (struct optglobdent *)(buf + pos);
+            res = opt_glob_entry(ctx, dir, fd, de->name, de->type, after, &cut);
+        }
+    }
+    if (n < 0) {
+        dir->err = errno;
+    }
+    free(buf);
+    close(fd);
+#else
+    if (!(dp = fdopendir(fd))) {
+        dir->err = errno;
+        close(fd);
+        return;
+    }
+    while (!res && (de = readdir(dp))) {
+        res = opt_glob_entry(ctx, dir, fd, de->d_name, de->d_type, after, &cut);
+    }
+    closedir(dp);
+#endif
+    if (res || opt_glob_trim(dir, ctx->maxent)) {
+        dir->err = ENOMEM;
+    }
+    dir->more |= cut != NULL;
+}
+
+
+/** @brief Unlink @p dir from the read-ahead queue and claim it */
+static void opt_glob_claim(struct optglobctx *ctx, struct optglobdir *dir)
+{
+    if (dir->prev) {
+        dir->prev->next = dir->next;
+    } else {
+        ctx->head = dir->next;
+    }
+    if (dir->next) {
+        dir->next->prev = dir->prev;
+    } else {
+        ctx->tail = dir->prev;
+    }
+    dir->state = OPT_GLOB_CLAIMED;
+}
+
+
+/** @brief Read-ahead thread */
+static void *opt_glob_thread(void *arg)
+{
+    struct optglobctx *ctx = (struct optglobctx *)arg;
+    struct optglobdir *dir;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (;;) {
+        while (!ctx->stop && !ctx->head) {
+            pthread_cond_wait(&ctx->work, &ctx->lock);
+        }
+        if (ctx->stop) {
+            break;
+        }
+        dir = ctx->head;
+        opt_glob_claim(ctx, dir);
+        pthread_mutex_unlock(&ctx->lock);
+        opt_glob_read(ctx, dir, NULL);
+        pthread_mutex_lock(&ctx->lock);
+        dir->state = OPT_GLOB_DONE;
+        pthread_cond_broadcast(&ctx->done);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+
+/** @brief Create the listing of the subdirectory @p ent of @p dir */
+static struct optglobdir *opt_glob_sub(const struct optglobctx *ctx,
+                                       const struct optglobdir *dir,
+                                       const struct optglobent *ent)
+{
+    size_t plen = strlen(dir->path), nlen = strlen(ent->name);
+    struct optglobdir *sub;
+
+    if (!(sub = (struct optglobdir *)calloc(1, sizeof *sub))
+     || !(sub->path = (char *)malloc(plen + nlen + 2))) {
+        free(sub);
+        return NULL;
+    }
+    memcpy(sub->path, dir->path, plen);
+    memcpy(sub->path + plen, ent->name, nlen);
+    memcpy(sub->path + plen + nlen, "/", 2);
+    sub->states = ent->next & ~OPT_GLOB_ISDIR & ~OPT_GLOB_END(ctx);
+    return sub;
+}
+
+
+/** @brief Take @p dir from the read-ahead pool, reading it here if no thread
+ *      has started on it */
+static void opt_glob_take(struct optglobctx *ctx, struct optglobdir *dir)
+{
+    int read = 0;
+
+    if (ctx->nthread) {
+        pthread_mutex_lock(&ctx->lock);
+        if (dir->state == OPT_GLOB_QUEUED) {
+            opt_glob_claim(ctx, dir);
+            read = 1;
+        }
+        while (dir->state == OPT_GLOB_CLAIMED && !read) {
+            pthread_cond_wait(&ctx->done, &ctx->lock);
+        }
+        if (dir->state != OPT_GLOB_UNREAD) {
+            ctx->ahead--;
+        }
+        pthread_mutex_unlock(&ctx->lock);
+    }
+    if (read || dir->state == OPT_GLOB_UNREAD) {
+        opt_glob_read(ctx, dir, NULL);
+    }
+    dir->state = OPT_GLOB_DONE;
+}
+
+
+/** @brief Free @p dir, which is not in the pool any more */
+static void opt_glob_free(struct optglobdir *dir)
+{
+    opt_glob_free_names(dir->names);
+    free(dir->ents);
+    free(dir->path);
+    free(dir);
+}
+
+
+/** @brief Queue the subdirectories of @p dir for reading ahead, while there
+ *      is room */
+static int opt_glob_ahead(struct optglobctx *ctx, struct optglobdir *dir)
+{
+    struct optglobent *ent;
+    size_t i;
+
+    for (i = 0; i < dir->nent; i++) {
+        ent = &dir->ents[i];
+        if (!(ent->next & ~OPT_GLOB_ISDIR & ~OPT_GLOB_END(ctx))) {
+            continue;
+        }
+        if (!(ent->sub = opt_glob_sub(ctx, dir, ent))) {
+            return -1;
+        }
+        if (!ctx->nthread || ctx->ahead >= ctx->nthread * OPT_GLOB_AHEAD) {
+            continue;
+        }
+        pthread_mutex_lock(&ctx->lock);
+        ent->sub->state = OPT_GLOB_QUEUED;
+        ent->sub->prev = ctx->tail;
+        if (ctx->tail) {
+            ctx->tail->next = ent->sub;
+        } else {
+            ctx->head = ent->sub;
+        }
+        ctx->tail = ent->sub;
+        ctx->ahead++;
+        pthread_cond_signal(&ctx->work);
+        pthread_mutex_unlock(&ctx->lock);
+    }
+    return 0;
+}
+
+
+/** @brief Call back with @p dir's path and @p name */
+static int opt_glob_emit(struct optglobctx *ctx,
+                         const struct optglobdir *dir,
+                         const char *name,
+                         int isdir)
+{
+    size_t plen = strlen(dir->path), nlen = strlen(name);
+    char *tmp;
+
+    if (plen + nlen + 2 > ctx->bufcap) {
+        if (!(tmp = (char *)realloc(ctx->buf, (plen + nlen) * 2 + 2))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        ctx->buf = tmp;
+        ctx->bufcap = (plen + nlen) * 2 + 2;
+    }
+    memcpy(ctx->buf, dir->path, plen);
+    memcpy(ctx->buf + plen, name, nlen);
+    memcpy(ctx->buf + plen + nlen, "/", 2);
+    ctx->buf[plen + nlen + (ctx->dirsonly && isdir)] = '\0';
+    return ctx->func(ctx->buf, ctx->data);
+}
+
+
+/** @brief Walk @p dir, which is then freed, and everything below it */
+static int opt_glob_walk(struct optglobctx *ctx, struct optglobdir *dir)
+{
+    struct optglobent *ent;
+    char *after = NULL;
+    size_t i;
+    int res = 0;
+
+    opt_glob_take(ctx, dir);
+    for (;;) {
+        if (dir->err && (ctx->flags & OPT_GLOB_ERR || dir->err == ENOMEM)) {
+            errno = dir->err;
+            res = -1;
+        }
+        if (!res && opt_glob_ahead(ctx, dir)) {
+            errno = ENOMEM;
+            res = -1;
+        }
+        for (i = 0; i < dir->nent; i++) {
+            ent = &dir->ents[i];
+            if (!res && ent->next & OPT_GLOB_END(ctx)) {
+                res = opt_glob_emit(ctx, dir, ent->name,
+                                    !!(ent->next & OPT_GLOB_ISDIR));
+            }
+            if (!ent->sub) {
+                continue;
+            } else if (!res) {
+                res = opt_glob_walk(ctx, ent->sub);
+            } else {
+                /* Unwinding: wait for any read in progress, then drop it */
+                opt_glob_take(ctx, ent->sub);
+                opt_glob_free(ent->sub);
+            }
+        }
+        if (res || !dir->more || !dir->nent) {
+            break;
+        }
+        /* The next run of a directory too big to list at once */
+        free(after);
+        if (!(after = (char *)malloc(strlen(dir->ents[dir->nent - 1].name)
+                                     + 1))) {
+            errno = ENOMEM;
+            res = -1;
+            break;
+        }
+        strcpy(after, dir->ents[dir->nent - 1].name);
+        opt_glob_read(ctx, dir, after);
+    }
+    free(after);
+    opt_glob_free(dir);
+    return res;
+}
+
+
+/** @brief Check whether @p str has an unescaped wildcard */
+static int opt_glob_magic(const char *str, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (str[i] == '\\' && i + 1 < len) {
+            i++;
+        } else if (str[i] == '*' || str[i] == '?' || str[i] == '[') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_glob(const struct optglob *glob,
+             const char           *pattern,
+             optglobfn_t          *func,
+             void                 *data)
+{
+    struct optglobctx *ctx;
+    struct optglobdir *root;
+    char *pat, *p, *slash, *base;
+    size_t len = strlen(pattern), blen = 0, i;
+    struct stat st;
+    long ncpu;
+    unsigned t;
+    int res = 0;
+
+    ctx = (struct optglobctx *)calloc(1, sizeof *ctx);
+    root = (struct optglobdir *)calloc(1, sizeof *root);
+    pat = (char *)malloc(len + 1);
+    base = (char *)malloc(len + 2);
+    if (!ctx || !root || !pat || !base) {
+        free(ctx);
+        free(root);
+        free(pat);
+        free(base);
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(pat, pattern, len + 1);
+    ctx->flags = glob ? glob->flags : 0;
+    ctx->maxent = glob && glob->maxent ? glob->maxent : 65536;
+    ctx->func = func;
+    ctx->data = data;
+    /* Literal leading components become the base directory, unescaped */
+    p = pat;
+    if (*p == '/') {
+        base[blen++] = '/';
+    }
+    while (*p == '/') {
+        p++;
+    }
+    for (; *p; p = slash) {
+        for (slash = p; *slash && *slash != '/'; slash++) {
+            slash += *slash == '\\' && slash[1];
+        }
+        if (opt_glob_magic(p, (size_t)(slash - p))) {
+            break;
+        }
+        for (; p < slash; p++) {
+            p += *p == '\\' && p + 1 < slash;
+            base[blen++] = *p;
+        }
+        base[blen++] = '/';
+        while (*slash == '/') {
+            slash++;
+        }
+    }
+    base[blen] = '\0';
+    if (!*p) {
+        /* Entirely literal: it matches if it exists */
+        if (!lstat(pattern, &st)) {
+            res = func(pattern, data);
+        }
+        goto out;
+    }
+    /* The rest are matched a component at a time */
+    ctx->dirsonly = len && pattern[len - 1] == '/';
+    for (; *p; p = slash) {
+        if (ctx->ncomp == OPT_GLOB_MAXCOMP) {
+            errno = EINVAL;
+            res = -1;
+            goto out;
+        }
+        for (slash = p; *slash && *slash != '/'; slash++) {
+            slash += *slash == '\\' && slash[1];
+        }
+        if (slash - p == 2 && p[0] == '*' && p[1] == '*') {
+            ctx->star |= 1ull << ctx->ncomp;
+        }
+        ctx->comp[ctx->ncomp++] = p;
+        for (; *slash == '/'; slash++) {
+            *slash = '\0';
+        }
+    }
+    root->path = base;
+    base = NULL;
+    root->states = opt_glob_closure(ctx, 1);
+    /* Read-ahead pool */
+    t = glob ? glob->nthread : 0;
+    if (!t) {
+        ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        t = ncpu > 0 ? (unsigned)ncpu : 1;
+    }
+    t = t < OPT_GLOB_MAXTHREAD ? t : OPT_GLOB_MAXTHREAD;
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->work, NULL);
+    pthread_cond_init(&ctx->done, NULL);
+    for (i = 0; t > 1 && i < t; i++) {
+        if (pthread_create(&ctx->thread[i], NULL, opt_glob_thread, ctx)) {
+            break;
+        }
+        ctx->nthread++;
+    }
+    res = opt_glob_walk(ctx, root);
+    root = NULL;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->stop = 1;
+    pthread_cond_broadcast(&ctx->work);
+    pthread_mutex_unlock(&ctx->lock);
+    for (i = 0; i < ctx->nthread; i++) {
+        pthread_join(ctx->thread[i], NULL);
+    }
+    pthread_mutex_destroy(&ctx->lock);
+    pthread_cond_destroy(&ctx->work);
+    pthread_cond_destroy(&ctx->done);
+out:
+    free(root);
+    free(base);
+    free(pat);
+    free(ctx->buf);
+    free(ctx);
+    return res;
+}
+
+
+/** @brief Batch of expanded arguments for opt_glob_expand */
+struct optglobbatch {
+    int        idx;
+    optcbfn_t *func;
+    void      *data;
+    unsigned   n;
+    unsigned   nmatch;  /* Matches of the current pattern */
+    char      *args[OPT_GLOB_BATCH];
+    char      *copies[OPT_GLOB_BATCH];  /* Owned copies among args */
+};
+
+
+/** @brief Pass on and empty the batch */
+static int opt_glob_flush(struct optglobbatch *b)
+{
+    unsigned i;
+    int res;
+
+    if (!b->n) {
+        return 0;
+    }
+    res = b->func(b->idx, b->n, b->args, b->data);
+    for (i = 0; i < b->n; i++) {
+        free(b->copies[i]);
+    }
+    b->n = 0;
+    return res;
+}
+
+
+/** @brief Add @p arg to the batch, copying it if @p copy */
+static int opt_glob_add(struct optglobbatch *b, char *arg, int copy)
+{
+    size_t len;
+    int res;
+
+    if (b->n == OPT_GLOB_BATCH && (res = opt_glob_flush(b))) {
+        return res;
+    }
+    b->copies[b->n] = NULL;
+    if (copy) {
+        len = strlen(arg) + 1;
+        if (!(b->copies[b->n] = (char *)malloc(len))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        arg = (char *)memcpy(b->copies[b->n], arg, len);
+    }
+    b->args[b->n++] = arg;
+    return 0;
+}
+
+
+static int opt_glob_match(const char *path, void *data)
+{
+    struct optglobbatch *b = (struct optglobbatch *)data;
+
+    b->nmatch++;
+    return opt_glob_add(b, (char *)path, 1);
+}
+
+
+OPT_EXTERN_C
+int opt_glob_expand(const struct optglob *glob,
+                    int                   idx,
+                    unsigned              count,
+                    char                 *args[],
+                    optcbfn_t            *func,
+                    void                 *data)
+{
+    struct optglobbatch *b;
+    unsigned i;
+    int res = 0;
+
+    if (!(b = (struct optglobbatch *)malloc(sizeof *b))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    b->idx = idx;
+    b->func = func;
+    b->data = data;
+    b->n = 0;
+    for (i = 0; !res && i < count; i++) {
+        if (!opt_glob_magic(args[i], strlen(args[i]))) {
+            res = opt_glob_add(b, args[i], 0);
+            continue;
+        }
+        b->nmatch = 0;
+        res = opt_glob(glob, args[i], opt_glob_match, b);
+        if (!res && !b->nmatch && !(glob && glob->flags & OPT_GLOB_NULL)) {
+            res = opt_glob_add(b, args[i], 0);
+        }
+    }
+    if (!res) {
+        res = opt_glob_flush(b);
+    } else {
+        for (i = 0; i < b->n; i++) {
+            free(b->copies[i]);
+        }
+    }
+    free(b);
+    return res;
+}
+
+#endif /* OPT_IMPLEMENTATION */
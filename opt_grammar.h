@@ -0,0 +1,810 @@
+#pragma once
+/** @file opt_grammar.h whole command line grammars, compiled to tables.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  opt.h knows option names and argument counts. The rest of a command line's
+ *  structure, i.e. subcommands and what the positional arguments are, is
+ *  left to callbacks. Here it is part of the grammar instead, as a tree of
+ *  commands with their options and positional slots:
+ *
+ *  static const struct optgslot cp_slots[] = {
+ *      { "src", 1, -1, cp_src },
+ *      { "dst", 1, 1,  cp_dst }
+ *  };
+ *  static const struct optgcmd cmds[] = {
+ *      { NULL,     -1, 2, tool_opts, 0, NULL     },    root: global options
+ *      { "cp",      0, 3, cp_opts,   2, cp_slots },    tool cp [-r] SRC... DST
+ *      { "remote",  0, 0, NULL,      0, NULL     },
+ *      { "add",     2, 1, add_opts,  2, add_slots }    tool remote add ...
+ *  };
+ *
+ *  Commands name their parent, which must come before them. Options are
+ *  valid in the command that declares them and in all its subcommands, where
+ *  an option of the same name shadows the inherited one.
+ *
+ *  The grammar is compiled into a single automaton: a state per command,
+ *  each with sorted edges for its short options, long options and
+ *  subcommands. opt_gram_parse runs it over argv in one loop that classifies
+ *  each token, looks it up in the current state, collects option arguments
+ *  the same way opt_parse does, and finally assigns the positional arguments
+ *  to slots. Nothing is called back during parsing: the result is a list of
+ *  events, which opt_gram_run then dispatches to the options' and slots'
+ *  callbacks, only once the whole command line was accepted.
+ *
+ *  Positional arguments are those after the options of the last subcommand
+ *  (or "--"), as with opt_parse. They are assigned to slots left to right,
+ *  each slot taking as many as it can while leaving the later slots their
+ *  minimum, so SRC... DST works as cp(1) does.
+ *
+ *  The automaton never depends on anything but the grammar, so it need not
+ *  be compiled at run time at all:
+ *
+ *  - C: tools/optgen.c emits it as constant data, with -DOPTGEN_GRAMMAR
+ *  - C++17: opt_gram<cmds> is the compiled struct optgram, built by the
+ *    compiler, and a grammar error does not compile
+ *
+ *  opt_gram_compile does the same at run time, into caller memory.
+ *
+ *  The events go to a buffer of the caller's. There is one per option, so
+ *  one per letter of a group like -vv, one per subcommand and one per slot,
+ *  and opt_gram_nev gives the most a command line can need:
+ *
+ *  struct optgev ev[64];
+ *  struct optgres res = { ev, 64, 0, 0, OPT_GRAM_OK, 0, 0 };
+ *
+ *  if (opt_gram_nev(&gram, argc - 1, argv + 1) > 64
+ *   || opt_gram_parse(&gram, argc - 1, argv + 1, &res)) {
+ *      ... res.err, about argv[1 + res.at] ...
+ *  }
+ *  return opt_gram_run(&gram, &res, argv + 1, data);
+ *
+ *  With tool_opts declaring -v, "tool -vv cp -r a b dst" is six events: -v
+ *  twice, cp, -r, then src with "a" and "b" and dst with "dst".
+ *
+ *  This does not use any heap memory nor issue any stdio calls.
+ */
+#ifndef OPT_GRAMMAR_H
+#define OPT_GRAMMAR_H
+
+#include "opt.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus) && __cplusplus >= 201703L
+#   define OPT_GRAM_CONSTEXPR constexpr
+#   define OPT_GRAM_CXX 1
+#else
+#   define OPT_GRAM_CONSTEXPR
+#   define OPT_GRAM_CXX 0
+#endif
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+/** @brief Positional argument slot */
+struct optgslot {
+    const char *name;   /* For messages, e.g. "src" */
+    unsigned    min;    /* Fewest arguments */
+    int         max;    /* Most arguments (-1: no limit) */
+    optcbfn_t  *func;   /* Callback for its arguments (NULL: none) */
+};
+
+
+/** @brief Command or subcommand */
+struct optgcmd {
+    const char            *name;    /* Its name (ignored for the root) */
+    int                    parent;  /* Index of its parent (-1: the root) */
+    unsigned               nopt;    /* Length of opts */
+    const struct optspec  *opts;    /* Options, also valid in subcommands */
+    unsigned               nslot;   /* Length of slots */
+    const struct optgslot *slots;   /* Positional slots, in order */
+};
+
+
+/** @brief Automaton state: a command's sorted edges, which are its short
+ *      options, then long options, then subcommands
+ */
+struct optgstate {
+    unsigned edge;      /* First edge */
+    unsigned nshrt;     /* Short options */
+    unsigned nlng;      /* Long options */
+    unsigned nsub;      /* Subcommands */
+};
+
+
+/** @brief Automaton edge */
+struct optgedge {
+    const char *lng;    /* Long option or subcommand name */
+    char        shrt;   /* Short option */
+    unsigned    cmd;    /* Command declaring the option, or the subcommand */
+    unsigned    idx;    /* Index of the option in its command */
+};
+
+
+/** @brief Compiled grammar */
+struct optgram {
+    unsigned                ncmd;       /* Commands and states */
+    unsigned                nedge;      /* Edges */
+    unsigned                maxslot;    /* Most slots of any command */
+    const struct optgcmd   *cmds;       /* The grammar */
+    const struct optgstate *states;     /* A state per command */
+    const struct optgedge  *edges;      /* Edges of all states */
+};
+
+
+/** @brief Event kinds */
+enum optgevk {
+    OPT_GRAM_OPT,   /* An option */
+    OPT_GRAM_SUB,   /* A subcommand */
+    OPT_GRAM_SLOT   /* A positional slot */
+};
+
+
+/** @brief Parse errors */
+enum optgerr {
+    OPT_GRAM_OK,        /* Accepted */
+    OPT_GRAM_EOPT,      /* Unknown option */
+    OPT_GRAM_ECMD,      /* Unknown subcommand */
+    OPT_GRAM_EFEW,      /* Too few positional arguments */
+    OPT_GRAM_EMANY,     /* Too many positional arguments */
+    OPT_GRAM_ENOSPC     /* Out of events */
+};
+
+
+/** @brief Something recognized on the command line */
+struct optgev {
+    enum optgevk kind;
+    unsigned     cmd;   /* Command of the option, the subcommand, or slot */
+    unsigned     idx;   /* Index of the option or slot in its command */
+    unsigned     arg;   /* Index in argv of the arguments, or subcommand */
+    unsigned     count; /* Argument count */
+};
+
+
+/** @brief Parse result */
+struct optgres {
+    struct optgev *ev;      /* Event buffer, of opt_gram_nev entries */
+    unsigned       cap;     /* Its length */
+    unsigned       nev;     /* Events, in command line order */
+    unsigned       cmd;     /* Command that was accepted */
+    enum optgerr   err;     /* Why parsing failed */
+    unsigned       at;      /* Index in argv of the offending argument, argc
+                               if it is missing */
+    char           shrt;    /* Offending short option, for OPT_GRAM_EOPT */
+};
+
+
+/** @brief Count the edges that compiling @p cmds may need
+ *  @param ncmd
+ *      Length of @p cmds
+ *  @param cmds
+ *      The grammar
+ *  @returns The edge count, which is at least one. For a grammar with a
+ *      parent that does not come before its command it is only enough for
+ *      opt_gram_compile to find that command and return its index
+ */
+unsigned opt_gram_nedge(unsigned ncmd, const struct optgcmd cmds[]);
+
+
+/** @brief Compile @p cmds into @p gram
+ *  @param gram
+ *      Compiled grammar, which refers to @p cmds, @p states and @p edges
+ *  @param ncmd
+ *      Length of @p cmds
+ *  @param cmds
+ *      The grammar
+ *  @param states
+ *      Buffer of @p ncmd states
+ *  @param edges
+ *      Buffer of opt_gram_nedge edges
+ *  @returns Zero, or the one-based index of a command whose parent is not
+ *      before it, or that has two options or subcommands of the same name
+ */
+unsigned opt_gram_compile(struct optgram       *gram,
+                          unsigned              ncmd,
+                          const struct optgcmd  cmds[],
+                          struct optgstate      states[],
+                          struct optgedge       edges[]);
+
+
+/** @brief Size the event buffer for parsing a command line: an event for
+ *      each argument, or each letter of a group of short options, and one
+ *      for each slot
+ *  @param gram
+ *      Compiled grammar
+ *  @param argc
+ *      Argument count, not counting the program name
+ *  @param argv
+ *      Arguments, not counting the program name
+ *  @returns The most events opt_gram_parse can produce, at most the total
+ *      length of the arguments plus gram->maxslot
+ */
+unsigned opt_gram_nev(const struct optgram *gram, int argc, char *argv[]);
+
+
+/** @brief Parse a command line without calling back
+ *  @param gram
+ *      Compiled grammar
+ *  @param argc
+ *      Argument count, not counting the program name
+ *  @param argv
+ *      Arguments, not counting the program name
+ *  @param res
+ *      Result, with its event buffer set
+ *  @returns Zero if accepted, otherwise res->err
+ */
+int opt_gram_parse(const struct optgram *gram,
+                   int                   argc,
+                   char                 *argv[],
+                   struct optgres       *res);
+
+
+/** @brief Invoke the callbacks of an accepted command line, in order
+ *  @param gram
+ *      Compiled grammar
+ *  @param res
+ *      Result of opt_gram_parse
+ *  @param argv
+ *      The arguments that were parsed
+ *  @param data
+ *      User data for the callbacks
+ *  @returns Zero, or the first nonzero callback return
+ */
+int opt_gram_run(const struct optgram *gram,
+                 const struct optgres *res,
+                 char                 *argv[],
+                 void                 *data);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_GRAMMAR_H */
+
+
+/* The compiler is plain C that is also a valid C++17 constant expression,
+ * so that the compiler can run it. C++ sees it in every translation unit */
+#if OPT_GRAM_CXX || (defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION)
+#ifndef OPT_GRAM_CORE
+#define OPT_GRAM_CORE
+
+/** @brief Compare possibly null strings, null first */
+static OPT_GRAM_CONSTEXPR int opt_gram_strcmp(const char *a, const char *b)
+{
+    unsigned i = 0;
+
+    if (!a || !b) {
+        return !!a - !!b;
+    }
+    for (i = 0; a[i] && a[i] == b[i]; i++) {
+        ;
+    }
+    return (unsigned char)a[i] - (unsigned char)b[i];
+}
+
+
+/** @brief Order edges by short option then name */
+static OPT_GRAM_CONSTEXPR int opt_gram_edgecmp(const struct optgedge *a,
+                                               const struct optgedge *b)
+{
+    return a->shrt != b->shrt ? (unsigned char)a->shrt - (unsigned char)b->shrt
+                              : opt_gram_strcmp(a->lng, b->lng);
+}
+
+
+/** @brief Check for a printable short option, as opt.h does */
+static OPT_GRAM_CONSTEXPR int opt_gram_isgraph(char c)
+{
+    return c > ' ' && c < 0x7f;
+}
+
+
+/** @brief Edges of command @p c: its and its ancestors' options, and its
+ *      subcommands, before shadowed options are dropped */
+static OPT_GRAM_CONSTEXPR unsigned opt_gram_count(unsigned              ncmd,
+                                                  const struct optgcmd *cmds,
+                                                  unsigned              c)
+{
+    unsigned n = 0, i = 0;
+    int a = (int)c;
+
+    /* Only parents before their commands, which also ends any cycle.
+     * opt_gram_build returns the command before it uses more edges */
+    for (; a >= 0 && (unsigned)a < ncmd;
+         a = a && cmds[a].parent < a ? cmds[a].parent : -1) {
+        for (i = 0; i < cmds[a].nopt; i++) {
+            n += opt_gram_isgraph(cmds[a].opts[i].shrt);
+            n += cmds[a].opts[i].lng && *cmds[a].opts[i].lng;
+        }
+    }
+    for (i = 1; i < ncmd; i++) {
+        n += cmds[i].parent == (int)c;
+    }
+    return n;
+}
+
+
+/** @brief See opt_gram_nedge */
+static OPT_GRAM_CONSTEXPR unsigned
+opt_gram_nedge_core(unsigned ncmd, const struct optgcmd *cmds)
+{
+    unsigned n = 1, c = 0;
+
+    for (c = 0; c < ncmd; c++) {
+        n += opt_gram_count(ncmd, cmds, c);
+    }
+    return n;
+}
+
+
+/** @brief Most slots of any command */
+static OPT_GRAM_CONSTEXPR unsigned opt_gram_maxslot(unsigned              ncmd,
+                                                    const struct optgcmd *cmds)
+{
+    unsigned n = 0, c = 0;
+
+    for (c = 0; c < ncmd; c++) {
+        n = cmds[c].nslot > n ? cmds[c].nslot : n;
+    }
+    return n;
+}
+
+
+/** @brief Sort @p n edges, dropping shadowed options
+ *  @returns The edges kept, or zero if two have the same name in the same
+ *      command
+ */
+static OPT_GRAM_CONSTEXPR unsigned opt_gram_sort(struct optgedge *e,
+                                                 unsigned         n)
+{
+    struct optgedge tmp = { 0, 0, 0, 0 };
+    unsigned i = 0, j = 0, k = 0;
+
+    for (i = 1; i < n; i++) {
+        tmp = e[i];
+        for (j = i; j && opt_gram_edgecmp(&e[j - 1], &tmp) > 0; j--) {
+            e[j] = e[j - 1];
+        }
+        e[j] = tmp;
+    }
+    for (i = 0; i < n; i++) {
+        if (k && !opt_gram_edgecmp(&e[k - 1], &e[i])) {
+            if (e[k - 1].cmd == e[i].cmd) {
+                return 0;
+            }
+            /* Descendants come after their ancestors */
+            if (e[i].cmd > e[k - 1].cmd) {
+                e[k - 1] = e[i];
+            }
+            continue;
+        }
+        e[k++] = e[i];
+    }
+    return k;
+}
+
+
+/** @brief See opt_gram_compile, without the struct optgram */
+static OPT_GRAM_CONSTEXPR unsigned opt_gram_build(unsigned              ncmd,
+                                                  const struct optgcmd *cmds,
+                                                  struct optgstate     *states,
+                                                  struct optgedge      *edges)
+{
+    unsigned c = 0, i = 0, n = 0, at = 0, nshrt = 0, nlng = 0, nsub = 0;
+    int a = 0;
+
+    for (c = 0; c < ncmd; c++) {
+        if (c ? cmds[c].parent < 0 || (unsigned)cmds[c].parent >= c
+              : cmds[c].parent != -1) {
+            return c + 1;
+        }
+        /* Short options */
+        for (a = (int)c, n = 0; a >= 0; a = a ? cmds[a].parent : -1) {
+            for (i = 0; i < cmds[a].nopt; i++) {
+                if (opt_gram_isgraph(cmds[a].opts[i].shrt)) {
+                    edges[at + n].lng = 0;
+                    edges[at + n].shrt = cmds[a].opts[i].shrt;
+                    edges[at + n].cmd = (unsigned)a;
+                    edges[at + n++].idx = i;
+                }
+            }
+        }
+        if (n && !(nshrt = opt_gram_sort(edges + at, n))) {
+            return c + 1;
+        }
+        nshrt = n ? nshrt : 0;
+        /* Long options */
+        for (a = (int)c, n = 0; a >= 0; a = a ? cmds[a].parent : -1) {
+            for (i = 0; i < cmds[a].nopt; i++) {
+                if (cmds[a].opts[i].lng && *cmds[a].opts[i].lng) {
+                    edges[at + nshrt + n].lng = cmds[a].opts[i].lng;
+                    edges[at + nshrt + n].shrt = 0;
+                    edges[at + nshrt + n].cmd = (unsigned)a;
+                    edges[at + nshrt + n++].idx = i;
+                }
+            }
+        }
+        if (n && !(nlng = opt_gram_sort(edges + at + nshrt, n))) {
+            return c + 1;
+        }
+        nlng = n ? nlng : 0;
+        /* Subcommands */
+        for (i = 1, n = 0; i < ncmd; i++) {
+            if (cmds[i].parent == (int)c) {
+                edges[at + nshrt + nlng + n].lng = cmds[i].name;
+                edges[at + nshrt + nlng + n].shrt = 0;
+                edges[at + nshrt + nlng + n].cmd = i;
+                edges[at + nshrt + nlng + n++].idx = 0;
+            }
+        }
+        nsub = n ? opt_gram_sort(edges + at + nshrt + nlng, n) : 0;
+        if (nsub != n) {
+            return c + 1;
+        }
+        states[c].edge = at;
+        states[c].nshrt = nshrt;
+        states[c].nlng = nlng;
+        states[c].nsub = nsub;
+        at += nshrt + nlng + nsub;
+    }
+    /* A terminator, so that the edge table is never empty */
+    edges[at].lng = 0;
+    edges[at].shrt = 0;
+    edges[at].cmd = 0;
+    edges[at].idx = 0;
+    return 0;
+}
+
+#endif /* OPT_GRAM_CORE */
+#endif /* OPT_GRAM_CXX || OPT_IMPLEMENTATION */
+
+
+#if OPT_GRAM_CXX && !defined(OPT_GRAM_CXX_API)
+#define OPT_GRAM_CXX_API
+
+/** @brief Storage of a grammar compiled by the compiler */
+template <size_t S, size_t E>
+struct optgramtbl {
+    unsigned         nedge;     /* Edges used */
+    unsigned         err;       /* opt_gram_build's result */
+    struct optgstate states[S];
+    struct optgedge  edges[E];
+};
+
+
+namespace opt_gram_detail {
+
+template <const auto &Cmds>
+constexpr auto compile()
+{
+    constexpr unsigned ncmd = sizeof Cmds / sizeof Cmds[0];
+    constexpr unsigned nedge = opt_gram_nedge_core(ncmd, Cmds);
+    optgramtbl<ncmd, nedge> tbl = {};
+
+    tbl.err = opt_gram_build(ncmd, Cmds, tbl.states, tbl.edges);
+    tbl.nedge = ncmd ? tbl.states[ncmd - 1].edge + tbl.states[ncmd - 1].nshrt
+                     + tbl.states[ncmd - 1].nlng + tbl.states[ncmd - 1].nsub
+                     : 0;
+    return tbl;
+}
+
+template <const auto &Cmds>
+inline constexpr auto tables = compile<Cmds>();
+
+template <const auto &Cmds>
+constexpr struct optgram gram()
+{
+    static_assert(!tables<Cmds>.err, "the grammar does not compile: a "
+                  "parent comes after its command, or a name is repeated");
+    return {
+        sizeof Cmds / sizeof Cmds[0], tables<Cmds>.nedge,
+        opt_gram_maxslot(sizeof Cmds / sizeof Cmds[0], Cmds),
+        Cmds, tables<Cmds>.states, tables<Cmds>.edges
+    };
+}
+
+} /* namespace opt_gram_detail */
+
+
+/** @brief Grammar compiled by the compiler. @p Cmds is a constexpr array
+ *      with static storage:
+ *
+ *      static constexpr struct optgcmd cmds[] = { ... };
+ *
+ *      opt_gram_parse(&opt_gram<cmds>, argc - 1, argv + 1, &res);
+ */
+template <const auto &Cmds>
+inline constexpr struct optgram opt_gram = opt_gram_detail::gram<Cmds>();
+
+#endif /* OPT_GRAM_CXX */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+OPT_EXTERN_C
+unsigned opt_gram_nedge(unsigned ncmd, const struct optgcmd cmds[])
+{
+    return opt_gram_nedge_core(ncmd, cmds);
+}
+
+
+OPT_EXTERN_C
+unsigned opt_gram_compile(struct optgram       *gram,
+                          unsigned              ncmd,
+                          const struct optgcmd  cmds[],
+                          struct optgstate      states[],
+                          struct optgedge       edges[])
+{
+    const struct optgstate *last = &states[ncmd ? ncmd - 1 : 0];
+    unsigned res;
+
+    if ((res = opt_gram_build(ncmd, cmds, states, edges))) {
+        return res;
+    }
+    gram->ncmd = ncmd;
+    gram->nedge = ncmd ? last->edge + last->nshrt + last->nlng + last->nsub
+                       : 0;
+    gram->maxslot = opt_gram_maxslot(ncmd, cmds);
+    gram->cmds = cmds;
+    gram->states = states;
+    gram->edges = edges;
+    return 0;
+}
+
+
+OPT_EXTERN_C
+unsigned opt_gram_nev(const struct optgram *gram, int argc, char *argv[])
+{
+    unsigned n = gram->maxslot;
+    const char *a;
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        a = argv[i];
+        if (a[0] == '-' && a[1] && a[1] != '-') {
+            for (a++; *a; a++) {
+                n++;
+            }
+        } else {
+            n++;
+        }
+    }
+    return n;
+}
+
+
+/** @brief Binary search @p n edges for @p key
+ *  @returns The edge, or NULL
+ */
+static const struct optgedge *opt_gram_find(const struct optgedge *e,
+                                            unsigned               n,
+                                            const struct optgedge *key)
+{
+    unsigned lo = 0, hi = n, mid;
+    int cmp;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = opt_gram_edgecmp(key, &e[mid]);
+        if (!cmp) {
+            return &e[mid];
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return (const struct optgedge *)0;
+}
+
+
+/** @brief Append an event
+ *  @returns Zero, or nonzero if the buffer is full
+ */
+static int opt_gram_push(struct optgres *res,
+                         enum optgevk    kind,
+                         unsigned        cmd,
+                         unsigned        idx,
+                         unsigned        arg,
+                         unsigned        count)
+{
+    struct optgev *ev;
+
+    if (res->nev == res->cap) {
+        res->err = OPT_GRAM_ENOSPC;
+        return 1;
+    }
+    ev = &res->ev[res->nev++];
+    ev->kind = kind;
+    ev->cmd = cmd;
+    ev->idx = idx;
+    ev->arg = arg;
+    ev->count = count;
+    return 0;
+}
+
+
+/** @brief Count the arguments of an option at @p i, as opt_parse takes them:
+ *      up to its limit, stopping at anything that looks like an option other
+ *      than a negative number
+ */
+static unsigned opt_gram_args(const struct optgram  *gram,
+                              const struct optgedge *e,
+                              int                    argc,
+                              char                  *argv[],
+                              int                    i)
+{
+    unsigned n = 0, lim = (unsigned)gram->cmds[e->cmd].opts[e->idx].args;
+    const char *a;
+
+    for (; n < lim && i < argc; n++, i++) {
+        a = argv[i];
+        if (a[0] == '-' && a[1] && (a[1] == '-' || a[1] < '0' || a[1] > '9')) {
+            break;
+        }
+    }
+    return n;
+}
+
+
+/** @brief Assign the positional arguments [@p pos, @p argc) to the slots of
+ *      the accepted command
+ *  @returns Zero, or nonzero with res->err set
+ */
+static int opt_gram_slots(const struct optgram *gram,
+                          struct optgres       *res,
+                          int                   argc,
+                          int                   pos)
+{
+    const struct optgcmd *cmd = &gram->cmds[res->cmd];
+    unsigned i, rest = 0, take, left = (unsigned)(argc - pos);
+
+    for (i = 0; i < cmd->nslot; i++) {
+        rest += cmd->slots[i].min;
+    }
+    if (left < rest) {
+        res->err = OPT_GRAM_EFEW;
+        res->at = (unsigned)argc;
+        return 1;
+    }
+    for (i = 0; i < cmd->nslot; i++) {
+        rest -= cmd->slots[i].min;
+        take = left - rest;
+        if (cmd->slots[i].max >= 0 && take > (unsigned)cmd->slots[i].max) {
+            take = (unsigned)cmd->slots[i].max;
+        }
+        if (opt_gram_push(res, OPT_GRAM_SLOT, res->cmd, i, (unsigned)pos,
+                          take)) {
+            return 1;
+        }
+        pos += (int)take;
+        left -= take;
+    }
+    if (left) {
+        /* Anything left over where a subcommand could be was not one */
+        res->err = !cmd->nslot && gram->states[res->cmd].nsub
+                 ? OPT_GRAM_ECMD : OPT_GRAM_EMANY;
+        res->at = (unsigned)pos;
+        return 1;
+    }
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_gram_parse(const struct optgram *gram,
+                   int                   argc,
+                   char                 *argv[],
+                   struct optgres       *res)
+{
+    const struct optgstate *st = &gram->states[0];
+    const struct optgedge *e;
+    struct optgedge key = { 0, 0, 0, 0 };
+    unsigned n;
+    char *a;
+    int i = 0, j;
+
+    res->nev = 0;
+    res->cmd = 0;
+    res->err = OPT_GRAM_OK;
+    res->at = 0;
+    res->shrt = '\0';
+    while (i < argc) {
+        a = argv[i];
+        if (a[0] != '-' || !a[1]) {
+            /* A subcommand, or the first positional argument */
+            key.lng = a;
+            key.shrt = '\0';
+            e = opt_gram_find(gram->edges + st->edge + st->nshrt + st->nlng,
+                              st->nsub, &key);
+            if (!e) {
+                break;
+            }
+            res->cmd = e->cmd;
+            st = &gram->states[e->cmd];
+            if (opt_gram_push(res, OPT_GRAM_SUB, e->cmd, 0, (unsigned)i++,
+                              0)) {
+                return res->err;
+            }
+        } else if (a[1] == '-' && !a[2]) {
+            i++;
+            break;
+        } else if (a[1] == '-') {
+            key.lng = a + 2;
+            key.shrt = '\0';
+            e = opt_gram_find(gram->edges + st->edge + st->nshrt, st->nlng,
+                              &key);
+            if (!e) {
+                res->err = OPT_GRAM_EOPT;
+                res->at = (unsigned)i;
+                return res->err;
+            }
+            n = opt_gram_args(gram, e, argc, argv, ++i);
+            if (opt_gram_push(res, OPT_GRAM_OPT, e->cmd, e->idx, (unsigned)i,
+                              n)) {
+                return res->err;
+            }
+            i += (int)n;
+        } else {
+            /* Short options: only an isolated one takes arguments */
+            key.lng = (const char *)0;
+            for (j = 1; a[j]; j++) {
+                key.shrt = a[j];
+                e = opt_gram_find(gram->edges + st->edge, st->nshrt, &key);
+                if (!e) {
+                    res->err = OPT_GRAM_EOPT;
+                    res->at = (unsigned)i;
+                    res->shrt = a[j];
+                    return res->err;
+                }
+                n = a[2] ? 0 : opt_gram_args(gram, e, argc, argv, i + 1);
+                if (opt_gram_push(res, OPT_GRAM_OPT, e->cmd, e->idx,
+                                  (unsigned)i + 1, n)) {
+                    return res->err;
+                }
+            }
+            i += 1 + (int)n;
+        }
+    }
+    opt_gram_slots(gram, res, argc, i);
+    return res->err;
+}
+
+
+OPT_EXTERN_C
+int opt_gram_run(const struct optgram *gram,
+                 const struct optgres *res,
+                 char                 *argv[],
+                 void                 *data)
+{
+    const struct optgev *ev;
+    optcbfn_t *func;
+    unsigned i;
+    int ret = 0;
+
+    for (i = 0; !ret && i < res->nev; i++) {
+        ev = &res->ev[i];
+        switch (ev->kind) {
+        case OPT_GRAM_OPT:
+            func = gram->cmds[ev->cmd].opts[ev->idx].func;
+            break;
+        case OPT_GRAM_SLOT:
+            func = gram->cmds[ev->cmd].slots[ev->idx].func;
+            break;
+        case OPT_GRAM_SUB:
+        default:
+            func = (optcbfn_t *)0;
+            break;
+        }
+        if (func) {
+            ret = func((int)ev->idx, ev->count, argv + ev->arg, data);
+        }
+    }
+    return ret;
+}
+
+#endif /* OPT_IMPLEMENTATION */
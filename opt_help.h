@@ -0,0 +1,365 @@
+#pragma once
+/** @file opt_help.h option help text, formatted once.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  Describe each option in an array of struct opthelp that runs parallel to
+ *  the option table, e.g. for the table in opt.h:
+ *
+ *  static const struct opthelp help[] = {
+ *      { "N",    "Seed the generator",          "Generation" },
+ *      { "N",    "Number of items to generate", "Generation" },
+ *      { NULL,   "Run the self-test",           "Debugging"  },
+ *      ...
+ *  };
+ *
+ *  opt_help_format lays the options out in aligned columns under their group
+ *  headings:
+ *
+ *  Generation:
+ *    -s, --seed N           Seed the generator
+ *    -n, --count N          Number of items to generate
+ *
+ *  Debugging:
+ *    -t, --test-mode        Run the self-test
+ *
+ *  The text never depends on anything but the tables, so it need not be
+ *  formatted at run time at all:
+ *
+ *  - C: tools/optgen.c emits it as a string literal, with -DOPTGEN_HELP
+ *  - C++17: opt_help_text<opts, help> is the same text as a constexpr
+ *    character array, formatted by the compiler
+ *
+ *  after which printing help is a single write(2) of a static buffer.
+ *  Help text is kept as written, with its own line breaks, unless a width is
+ *  given, in which case it is reflowed to fit. Pass the terminal's width to
+ *  opt_help_format only when you really want reflow.
+ *
+ *  This does not use any heap memory nor issue any stdio calls.
+ */
+#ifndef OPT_HELP_H
+#define OPT_HELP_H
+
+#include "opt.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus) && __cplusplus >= 201703L
+#   define OPT_HELP_CONSTEXPR constexpr
+#   define OPT_HELP_CXX 1
+#else
+#   define OPT_HELP_CONSTEXPR
+#   define OPT_HELP_CXX 0
+#endif
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+#define OPT_HELP_MAXCOL 32  /* Help text column, at most */
+#define OPT_HELP_MINTXT 20  /* Narrowest reflowed help text */
+
+
+/** @brief Help for one option */
+struct opthelp {
+    const char *argname;    /* Name of its arguments (NULL: "ARG") */
+    const char *help;       /* Description (NULL: none) */
+    const char *group;      /* Heading (NULL: none) */
+};
+
+
+/** @brief Format help for @p opts into @p buf, like snprintf(3)
+ *  @param buf
+ *      Output buffer, which is always NUL-terminated if @p size is nonzero
+ *  @param size
+ *      Size of @p buf
+ *  @param nopt
+ *      Length of @p opts and @p help
+ *  @param opts
+ *      Option specification table
+ *  @param help
+ *      Help for each option, or NULL to list the options only
+ *  @param width
+ *      Zero to keep the help text as written, otherwise the width to reflow
+ *      it to
+ *  @returns The length of the full text, which did not fit if it is not
+ *      less than @p size
+ */
+size_t opt_help_format(char                 *buf,
+                       size_t                size,
+                       unsigned              nopt,
+                       const struct optspec  opts[],
+                       const struct opthelp  help[],
+                       unsigned              width);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_HELP_H */
+
+
+/* The formatter is plain C that is also a valid C++17 constant expression,
+ * so that the compiler can run it. C++ sees it in every translation unit */
+#if OPT_HELP_CXX || (defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION)
+#ifndef OPT_HELP_CORE
+#define OPT_HELP_CORE
+
+/** @brief Output position */
+struct opthelpout {
+    char   *buf;
+    size_t  size;
+    size_t  len;    /* Length of the full text so far */
+    size_t  col;    /* Column of the current line */
+};
+
+
+/** @brief Append @p c */
+static OPT_HELP_CONSTEXPR void opt_help_putc(struct opthelpout *out, char c)
+{
+    if (out->len + 1 < out->size) {
+        out->buf[out->len] = c;
+    }
+    out->len++;
+    out->col = c == '\n' ? 0 : out->col + 1;
+}
+
+
+/** @brief Append @p n bytes of @p str */
+static OPT_HELP_CONSTEXPR void opt_help_putn(struct opthelpout *out,
+                                             const char        *str,
+                                             size_t             n)
+{
+    size_t i = 0;
+
+    for (i = 0; i < n; i++) {
+        opt_help_putc(out, str[i]);
+    }
+}
+
+
+/** @brief Length of @p str */
+static OPT_HELP_CONSTEXPR size_t opt_help_len(const char *str)
+{
+    size_t n = 0;
+
+    while (str[n]) {
+        n++;
+    }
+    return n;
+}
+
+
+/** @brief Append @p str */
+static OPT_HELP_CONSTEXPR void opt_help_puts(struct opthelpout *out,
+                                             const char        *str)
+{
+    opt_help_putn(out, str, opt_help_len(str));
+}
+
+
+/** @brief Pad with spaces to column @p col */
+static OPT_HELP_CONSTEXPR void opt_help_pad(struct opthelpout *out,
+                                            size_t             col)
+{
+    while (out->col < col) {
+        opt_help_putc(out, ' ');
+    }
+}
+
+
+/** @brief Compare two possibly null strings for equality */
+static OPT_HELP_CONSTEXPR int opt_help_eq(const char *a, const char *b)
+{
+    size_t i = 0;
+
+    if (!a || !b) {
+        return a == b;
+    }
+    for (i = 0; a[i] && a[i] == b[i]; i++) {
+        ;
+    }
+    return a[i] == b[i];
+}
+
+
+/** @brief Write the option column of @p opt: "  -s, --seed N" */
+static OPT_HELP_CONSTEXPR void opt_help_left(struct opthelpout    *out,
+                                             const struct optspec *opt,
+                                             const struct opthelp *help)
+{
+    const char *arg = help && help->argname ? help->argname : "ARG";
+
+    opt_help_puts(out, "  ");
+    if (opt->shrt) {
+        opt_help_putc(out, '-');
+        opt_help_putc(out, opt->shrt);
+    } else {
+        opt_help_puts(out, "  ");
+    }
+    if (opt->lng) {
+        opt_help_puts(out, opt->shrt ? ", --" : "  --");
+        opt_help_puts(out, opt->lng);
+    }
+    if (opt->args) {
+        opt_help_putc(out, ' ');
+        opt_help_puts(out, arg);
+        if (opt->args != 1) {
+            opt_help_puts(out, "...");
+        }
+    }
+}
+
+
+/** @brief Write @p text at column @p col, reflowed to @p width if nonzero */
+static OPT_HELP_CONSTEXPR void opt_help_body(struct opthelpout *out,
+                                             const char        *text,
+                                             size_t             col,
+                                             unsigned           width)
+{
+    size_t end = width > col + OPT_HELP_MINTXT ? width : col + OPT_HELP_MINTXT;
+    size_t n = 0;
+
+    while (*text) {
+        if (*text == '\n') {
+            opt_help_putc(out, '\n');
+            text++;
+            continue;
+        }
+        opt_help_pad(out, col);
+        if (!width) {
+            opt_help_putc(out, *text++);
+            continue;
+        }
+        /* Reflow: spaces become one space or a line break */
+        if (*text == ' ') {
+            text++;
+            continue;
+        }
+        for (n = 0; text[n] && text[n] != ' ' && text[n] != '\n'; n++) {
+            ;
+        }
+        if (out->col > col && out->col + 1 + n > end) {
+            opt_help_putc(out, '\n');
+            opt_help_pad(out, col);
+        } else if (out->col > col) {
+            opt_help_putc(out, ' ');
+        }
+        opt_help_putn(out, text, n);
+        text += n;
+    }
+}
+
+
+/** @brief The formatter behind opt_help_format and opt_help_text<> */
+static OPT_HELP_CONSTEXPR size_t opt_help_core(char                 *buf,
+                                               size_t                size,
+                                               unsigned              nopt,
+                                               const struct optspec *opts,
+                                               const struct opthelp *help,
+                                               unsigned              width)
+{
+    struct opthelpout out = { buf, size, 0, 0 };
+    struct opthelpout probe = { buf, 0, 0, 0 };
+    const char *group = 0;
+    size_t col = 0;
+    unsigned i = 0;
+
+    /* The help column follows the widest option column that is not an
+     * outlier. Those put their help on a line of its own */
+    for (i = 0; i < nopt; i++) {
+        probe.len = 0;
+        probe.col = 0;
+        opt_help_left(&probe, &opts[i], help ? &help[i] : 0);
+        if (probe.col + 2 > col && probe.col + 2 <= OPT_HELP_MAXCOL) {
+            col = probe.col + 2;
+        }
+    }
+    for (i = 0; i < nopt; i++) {
+        if (help && help[i].group && !opt_help_eq(help[i].group, group)) {
+            if (out.len) {
+                opt_help_putc(&out, '\n');
+            }
+            group = help[i].group;
+            opt_help_puts(&out, group);
+            opt_help_puts(&out, ":\n");
+        }
+        opt_help_left(&out, &opts[i], help ? &help[i] : 0);
+        if (help && help[i].help && *help[i].help) {
+            if (out.col + 2 > col) {
+                opt_help_putc(&out, '\n');
+            }
+            opt_help_body(&out, help[i].help, col, width);
+        }
+        opt_help_putc(&out, '\n');
+    }
+    if (size) {
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    }
+    return out.len;
+}
+
+#endif /* OPT_HELP_CORE */
+#endif /* OPT_HELP_CXX || OPT_IMPLEMENTATION */
+
+
+#if OPT_HELP_CXX && !defined(OPT_HELP_CXX_API)
+#define OPT_HELP_CXX_API
+
+/** @brief Help text as a constant character array. @p Opts and @p Help are
+ *      constexpr arrays of the same length with static storage:
+ *
+ *      static constexpr struct optspec opts[] = { ... };
+ *      static constexpr struct opthelp help[] = { ... };
+ *
+ *      write(1, opt_help_text<opts, help>.str,
+ *            opt_help_text<opts, help>.len);
+ */
+template <size_t N>
+struct opthelpstr {
+    char   str[N];  /* The text, NUL-terminated */
+    size_t len;     /* Its length */
+};
+
+
+namespace opt_help_detail {
+
+template <const auto &Opts, const auto &Help, unsigned Width>
+constexpr auto render()
+{
+    constexpr unsigned nopt = sizeof Opts / sizeof Opts[0];
+    constexpr size_t len = opt_help_core(nullptr, 0, nopt, Opts, Help, Width);
+    opthelpstr<len + 1> text = {};
+
+    static_assert(sizeof Help / sizeof Help[0] == nopt,
+                  "the help table must be as long as the option table");
+    text.len = opt_help_core(text.str, len + 1, nopt, Opts, Help, Width);
+    return text;
+}
+
+} /* namespace opt_help_detail */
+
+
+template <const auto &Opts, const auto &Help, unsigned Width = 0>
+inline constexpr auto opt_help_text =
+    opt_help_detail::render<Opts, Help, Width>();
+
+#endif /* OPT_HELP_CXX */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+OPT_EXTERN_C
+size_t opt_help_format(char                 *buf,
+                       size_t                size,
+                       unsigned              nopt,
+                       const struct optspec  opts[],
+                       const struct opthelp  help[],
+                       unsigned              width)
+{
+    return opt_help_core(buf, size, nopt, opts, help, width);
+}
+
+#endif /* OPT_IMPLEMENTATION */
@@ -0,0 +1,315 @@
+#pragma once
+/** @file opt_key.h canonical hashes of what a command line means.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  Caches keyed on the raw argv miss on invocations that mean the same:
+ *  options in another order, "-abc" for "-a -b -c", or a short spelling for
+ *  a long one. A key hashes the parse instead. Each option is hashed by its
+ *  name, not by how it was spelled or where it came, and how its repeats
+ *  combine is up to its mode, in an array that runs parallel to the option
+ *  table:
+ *
+ *  static struct optkeyent ents[] = {
+ *      { OPT_KEY_ORDERED   },      -I dir, where the search order matters
+ *      { OPT_KEY_UNORDERED },      -D name=value
+ *      { OPT_KEY_LAST      },      -O level, the last one wins
+ *      { OPT_KEY_IGNORE    }       -j jobs, which does not change the output
+ *  };
+ *  static struct optkey key = { 4, opts, ents, { OPT_KEY_ORDERED } };
+ *  unsigned long long h[2];
+ *
+ *  Point the table's callbacks and the positional callback at opt_key with
+ *  the key as their data, or call opt_key_add from callbacks of your own.
+ *  After the parse, opt_key_hash gives the 128-bit key:
+ *
+ *  opt_key_hash(&key, h);
+ *
+ *  with h[0] alone as a 64-bit key. The last member of struct optkey is the
+ *  mode of the positional arguments.
+ *
+ *  Options go into the key in one pass, as they are parsed. The arguments of
+ *  each time an option is given are hashed where they lie, always in order,
+ *  and fold into that option's hash by its mode. The option hashes then add
+ *  up, so the order options came in is lost, but repeats of an option keep
+ *  their order unless its mode drops it. The key depends on the option
+ *  names, modes and arguments, not on the table's order or callbacks, and
+ *  is the same on every platform. It is not cryptographic: keep untrusted
+ *  command lines from choosing cache entries by other means.
+ *
+ *  This does not use the heap.
+ */
+#ifndef OPT_KEY_H
+#define OPT_KEY_H
+
+#include "opt.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+#define OPT_KEY_ORDERED     0   /* Every time given, in order */
+#define OPT_KEY_UNORDERED   1   /* Every time given, in any order */
+#define OPT_KEY_LAST        2   /* Only the last time given */
+#define OPT_KEY_IGNORE      3   /* Not part of the key */
+
+
+/** @brief Key state of one option. Zero it apart from the mode */
+struct optkeyent {
+    unsigned            mode;   /* OPT_KEY_* */
+
+    /* Private */
+    unsigned            given;  /* Times the option was given */
+    unsigned long long  h[2];
+};
+
+
+/** @brief Key of a parse */
+struct optkey {
+    unsigned              nopt; /* Length of opts and ent */
+    const struct optspec *opts; /* Option table, for the names */
+    struct optkeyent     *ent;  /* One per option */
+    struct optkeyent      pos;  /* The positional arguments */
+};
+
+
+/** @brief Option and positional callback that adds to the struct optkey
+ *      given as @p data */
+int opt_key(int idx, unsigned count, char *args[], void *data);
+
+
+/** @brief Add option @p idx to the key
+ *  @param key
+ *      Key
+ *  @param idx
+ *      Option index, or -1 for the positional arguments
+ *  @param count
+ *      Argument count
+ *  @param args
+ *      Arguments
+ *  @returns Zero
+ */
+int opt_key_add(struct optkey *key, int idx, unsigned count, char *args[]);
+
+
+/** @brief The key of what was added
+ *  @param key
+ *      Key
+ *  @param h
+ *      Set to the 128-bit key
+ *  @returns h[0], a 64-bit key
+ */
+unsigned long long opt_key_hash(const struct optkey *key,
+                                unsigned long long   h[2]);
+
+
+/** @brief Clear the key for another parse, keeping the modes
+ *  @param key
+ *      Key
+ */
+void opt_key_reset(struct optkey *key);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_KEY_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+#include <string.h>
+
+
+#define OPT_KEY_C1  0x87c37b91114253d5ull
+#define OPT_KEY_C2  0x4cf5ad432745937full
+
+
+static unsigned long long opt_key_rotl(unsigned long long x, int r)
+{
+    return x << r | x >> (64 - r);
+}
+
+
+/** @brief Load 8 bytes, little endian on every platform */
+static unsigned long long opt_key_load(const unsigned char *p, size_t len)
+{
+    unsigned long long w = 0;
+
+    while (len--) {
+        w = w << 8 | p[len];
+    }
+    return w;
+}
+
+
+static unsigned long long opt_key_fmix(unsigned long long h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+
+/** @brief MurmurHash3 x64-128 of @p len bytes of @p buf, seeded and chained
+ *      through @p h */
+static void opt_key_mix(unsigned long long h[2], const void *buf, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    unsigned long long h1 = h[0], h2 = h[1], k1, k2;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        k1 = opt_key_load(p + i, 8) * OPT_KEY_C1;
+        k2 = opt_key_load(p + i + 8, 8) * OPT_KEY_C2;
+        h1 ^= opt_key_rotl(k1, 31) * OPT_KEY_C2;
+        h1 = (opt_key_rotl(h1, 27) + h2) * 5 + 0x52dce729;
+        h2 ^= opt_key_rotl(k2, 33) * OPT_KEY_C1;
+        h2 = (opt_key_rotl(h2, 31) + h1) * 5 + 0x38495ab5;
+    }
+    if (len - i > 8) {
+        k2 = opt_key_load(p + i + 8, len - i - 8) * OPT_KEY_C2;
+        h2 ^= opt_key_rotl(k2, 33) * OPT_KEY_C1;
+    }
+    if (len > i) {
+        k1 = opt_key_load(p + i, len - i < 8 ? len - i : 8) * OPT_KEY_C1;
+        h1 ^= opt_key_rotl(k1, 31) * OPT_KEY_C2;
+    }
+    h1 ^= (unsigned long long)len;
+    h2 ^= (unsigned long long)len;
+    h1 += h2;
+    h2 += h1;
+    h1 = opt_key_fmix(h1);
+    h2 = opt_key_fmix(h2);
+    h1 += h2;
+    h2 += h1;
+    h[0] = h1;
+    h[1] = h2;
+}
+
+
+OPT_EXTERN_C
+int opt_key_add(struct optkey *key, int idx, unsigned count, char *args[])
+{
+    struct optkeyent *ent;
+    unsigned long long h[2] = { 0, 0 };
+    unsigned char n[4];
+    unsigned i;
+
+    if (idx < -1 || idx >= (int)key->nopt) {
+        return 0;
+    }
+    ent = idx < 0 ? &key->pos : &key->ent[idx];
+    if (ent->mode == OPT_KEY_IGNORE) {
+        return 0;
+    }
+    /* The count, and each argument's length, go in, so no two lists
+     * collide */
+    if (ent->mode == OPT_KEY_ORDERED) {
+        h[0] = ent->h[0];
+        h[1] = ent->h[1];
+    }
+    n[0] = (unsigned char)(count >> 24);
+    n[1] = (unsigned char)(count >> 16);
+    n[2] = (unsigned char)(count >> 8);
+    n[3] = (unsigned char)count;
+    opt_key_mix(h, n, sizeof n);
+    for (i = 0; i < count; i++) {
+        opt_key_mix(h, args[i], strlen(args[i]));
+    }
+    if (ent->mode == OPT_KEY_UNORDERED) {
+        ent->h[0] += h[0];
+        ent->h[1] += h[1];
+    } else {
+        ent->h[0] = h[0];
+        ent->h[1] = h[1];
+    }
+    ent->given++;
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_key(int idx, unsigned count, char *args[], void *data)
+{
+    return opt_key_add((struct optkey *)data, idx, count, args);
+}
+
+
+/** @brief Add @p ent, named @p name of @p len bytes, into @p sum */
+static void opt_key_sum(unsigned long long sum[2], const struct optkeyent *ent,
+                        const char *name, size_t len)
+{
+    unsigned long long h[2];
+    unsigned char given[5];
+    unsigned n;
+
+    if (!ent->given || ent->mode == OPT_KEY_IGNORE) {
+        return;
+    }
+    /* Repeats of a last-wins option are not part of it */
+    n = ent->mode == OPT_KEY_LAST ? 1 : ent->given;
+    given[0] = (unsigned char)ent->mode;
+    given[1] = (unsigned char)(n >> 24);
+    given[2] = (unsigned char)(n >> 16);
+    given[3] = (unsigned char)(n >> 8);
+    given[4] = (unsigned char)n;
+    h[0] = ent->h[0];
+    h[1] = ent->h[1];
+    opt_key_mix(h, given, sizeof given);
+    opt_key_mix(h, name, len);
+    sum[0] += h[0];
+    sum[1] += h[1];
+}
+
+
+OPT_EXTERN_C
+unsigned long long opt_key_hash(const struct optkey *key,
+                                unsigned long long   h[2])
+{
+    const struct optspec *opt;
+    unsigned long long sum[2] = { 0, 0 };
+    char name[3];
+    unsigned i;
+
+    for (i = 0; i < key->nopt; i++) {
+        opt = &key->opts[i];
+        if (opt->lng) {
+            opt_key_sum(sum, &key->ent[i], opt->lng, strlen(opt->lng) + 1);
+        } else {
+            /* "-c", which no long name can be */
+            name[0] = '-';
+            name[1] = opt->shrt;
+            name[2] = '\0';
+            opt_key_sum(sum, &key->ent[i], name, sizeof name);
+        }
+    }
+    opt_key_sum(sum, &key->pos, "", 0);
+    h[0] = sum[0];
+    h[1] = sum[1];
+    opt_key_mix(h, "optkey", 6);
+    return h[0];
+}
+
+
+OPT_EXTERN_C
+void opt_key_reset(struct optkey *key)
+{
+    unsigned i;
+
+    for (i = 0; i < key->nopt; i++) {
+        key->ent[i].given = 0;
+        key->ent[i].h[0] = key->ent[i].h[1] = 0;
+    }
+    key->pos.given = 0;
+    key->pos.h[0] = key->pos.h[1] = 0;
+}
+
+#endif /* OPT_IMPLEMENTATION */
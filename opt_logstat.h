@@ -0,0 +1,1088 @@
+#pragma once
+/** @file opt_logstat.h option usage statistics over recorded command lines.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  Feed it shell history, audit logs or CI logs, one command line per line,
+ *  and it reports how one tool's options are used there:
+ *
+ *  - "freq": uses of each option, and of unrecognized options
+ *  - "top": the most frequent values of each option, by the space-saving
+ *    algorithm, each with a bound on how far its count may be over
+ *  - "cm": a count-min sketch of every (option, value) pair, for point
+ *    queries with opt_ls_estimate
+ *  - "co": for each pair of options, the commands that use both. The
+ *    diagonal counts the commands that use each option at all
+ *
+ *  All of these take fixed memory, chosen in struct optlsconf, however much
+ *  input there is. Lines are split at newlines 64 bytes at a time with SSE2
+ *  (or a scalar fallback), each line is split into commands and words with
+ *  opt_tok_cmd, leading VAR=value assignments are skipped, and commands of
+ *  the configured tool are parsed with opt.h against a private copy of its
+ *  table, whose callbacks only record. When a tool name is configured, lines
+ *  that do not contain it at all are skipped without being tokenized.
+ *
+ *  opt_ls_run splits a buffer (typically a mapped file) at newlines into one
+ *  chunk per thread, gives each thread its own statistics and merges them
+ *  when they are done. For example:
+ *
+ *  struct optlsconf conf = { "make", NOPT, make_opts };
+ *  struct optlsstat st;
+ *
+ *  if (!opt_ls_init(&st, &conf)) {
+ *      opt_ls_run(&st, map, len);
+ *      ... st.freq[i], st.top[i * st.topk + j], ...
+ *      opt_ls_free(&st);
+ *  }
+ *
+ *  With OPT_LS_COLS set in the configuration's flags, every value parsed is
+ *  also kept, in columns rather than per command, for analyses that the
+ *  statistics do not cover. Row i of st.cols is one value:
+ *
+ *  - line[i]: the input line, counting from zero across everything fed
+ *  - opt[i]: the option index, OPT_LS_POS for a positional argument, or
+ *    OPT_LS_UNKNOWN for an unrecognized option, whose name is the value
+ *  - arg[i]: the position of the value among its option's arguments, or -1
+ *    for an option given without any (and an empty value)
+ *  - val[off[i]] to val[off[i + 1]]: the value, unterminated
+ *
+ *  so that a scan of, say, every value of one option is a pass over two
+ *  arrays rather than a walk of per-command objects, and the columns can be
+ *  written out as they are. Threads' columns are concatenated in input
+ *  order. opt_ls_arrow hands them over through the Arrow C data interface
+ *  as a struct<line: uint64, opt: int32, arg: int32, val: large_binary>
+ *  array, which pyarrow, DuckDB, polars and the like import without a copy.
+ *  Values are bytes as logged, not checked to be UTF-8; cast the column to a
+ *  string type where they are known to be.
+ *
+ *  This uses the heap, and opt_ls_run needs -pthread.
+ */
+#ifndef OPT_LOGSTAT_H
+#define OPT_LOGSTAT_H
+
+#include "opt.h"
+#include "opt_token.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+#define OPT_LS_VALLEN   32      /* Value bytes kept in a top-k entry */
+#define OPT_LS_DEPTH    4       /* Count-min rows */
+
+#define OPT_LS_COLS     0x1     /* Keep every value in st.cols */
+
+/* Column opt values other than option indices */
+#define OPT_LS_POS      (-1)    /* Positional argument */
+#define OPT_LS_UNKNOWN  (-2)    /* Unrecognized option */
+
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+/* The Arrow C data interface ABI, as its specification defines it */
+struct ArrowSchema {
+    const char *format;
+    const char *name;
+    const char *metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema **children;
+    struct ArrowSchema *dictionary;
+    void (*release)(struct ArrowSchema *);
+    void *private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void **buffers;
+    struct ArrowArray **children;
+    struct ArrowArray *dictionary;
+    void (*release)(struct ArrowArray *);
+    void *private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+
+/** @brief What to count, and in how much memory */
+struct optlsconf {
+    const char           *name;     /* Tool basename, or NULL for any */
+    unsigned              nopt;     /* Length of opts */
+    const struct optspec *opts;     /* The tool's option table */
+    unsigned              topk;     /* Values kept per option (0: 16) */
+    unsigned              width;    /* Count-min columns, 2^n (0: 2^14) */
+    unsigned              nthread;  /* opt_ls_run threads (0: all CPUs) */
+    unsigned              flags;    /* OPT_LS_* */
+};
+
+
+/** @brief Every value parsed, in columns, with OPT_LS_COLS */
+struct optlscols {
+    size_t              n;      /* Rows */
+    unsigned long long *line;   /* Input line of each */
+    int                *opt;    /* Option index, OPT_LS_POS or _UNKNOWN */
+    int                *arg;    /* Position among the option's arguments */
+    long long          *off;    /* n + 1 offsets of the values in val */
+    char               *val;    /* The values, back to back */
+
+    /* Private */
+    size_t              cap;    /* Rows allocated */
+    size_t              valcap; /* Value bytes allocated */
+};
+
+
+/** @brief A frequent value of an option */
+struct optlsval {
+    unsigned long long count;       /* Count, zero for an empty entry */
+    unsigned long long err;         /* Most the count may be over by */
+    unsigned long long hash;        /* Hash of the option and value */
+    char               val[OPT_LS_VALLEN]; /* The value, truncated */
+};
+
+
+/** @brief Statistics. Only the first group of members is of interest */
+struct optlsstat {
+    unsigned long long  bytes;      /* Input bytes */
+    unsigned long long  lines;      /* Input lines */
+    unsigned long long  cmds;       /* Commands of the tool */
+    unsigned long long  unknown;    /* Unrecognized options */
+    unsigned            nopt;       /* Option count */
+    unsigned            topk;       /* Top-k entries per option */
+    unsigned            width;      /* Count-min columns */
+    unsigned long long *freq;       /* nopt uses per option */
+    unsigned long long *co;         /* nopt x nopt, upper triangle */
+    struct optlsval    *top;        /* nopt x topk, by descending count */
+    unsigned long long *cm;         /* OPT_LS_DEPTH x width */
+    struct optlscols    cols;       /* Values, with OPT_LS_COLS */
+
+    /* Private */
+    const struct optlsconf *conf;
+    struct opttbl           tbl;
+    struct optspec         *opts;
+    const struct optspec  **idx;
+    char                   *out;    /* Tokenizer output */
+    size_t                  outcap;
+    char                  **argv;
+    unsigned                argvcap;
+    unsigned               *hits;   /* Options of the current command */
+    unsigned                nhit;
+    unsigned long long     *seen;   /* Command serial each option was seen */
+    unsigned long long      line;   /* Line of the current command */
+    int                     nomem;
+};
+
+
+/** @brief Allocate statistics for @p conf, which must outlive them
+ *  @returns Zero on success, -1 if out of memory
+ */
+int opt_ls_init(struct optlsstat *st, const struct optlsconf *conf);
+
+
+/** @brief Free @p st */
+void opt_ls_free(struct optlsstat *st);
+
+
+/** @brief Count @p len bytes of complete lines on the calling thread. A
+ *      final line without a newline is counted as a line
+ *  @returns Zero on success, -1 if out of memory
+ */
+int opt_ls_feed(struct optlsstat *st, const char *buf, size_t len);
+
+
+/** @brief Count @p len bytes of lines, split across threads
+ *  @returns Zero on success, -1 if out of memory or threads
+ */
+int opt_ls_run(struct optlsstat *st, const char *buf, size_t len);
+
+
+/** @brief Add @p src to @p dst. Both must have the same configuration */
+void opt_ls_merge(struct optlsstat *dst, const struct optlsstat *src);
+
+
+/** @brief Estimate how often option @p idx had the value @p val
+ *  @returns An upper bound, exact unless the sketch is crowded
+ */
+unsigned long long opt_ls_estimate(const struct optlsstat *st,
+                                   unsigned                idx,
+                                   const char             *val);
+
+
+/** @brief Move @p st's columns out as an Arrow struct array, leaving them
+ *      empty. Both exported structures must be released by their consumer
+ *  @param st
+ *      Statistics with OPT_LS_COLS
+ *  @param schema
+ *      Exported schema
+ *  @param array
+ *      Exported array
+ *  @returns Zero on success, -1 if out of memory
+ */
+int opt_ls_arrow(struct optlsstat   *st,
+                 struct ArrowSchema *schema,
+                 struct ArrowArray  *array);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_LOGSTAT_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#   define OPT_LS_SSE2 1
+#else
+#   define OPT_LS_SSE2 0
+#endif
+
+#if defined(__GNUC__)
+#   define opt_ls_ctz(x)    __builtin_ctzll(x)
+#   define opt_ls_popcnt(x) __builtin_popcountll(x)
+#else
+/** @brief Count trailing zeros of nonzero @p x */
+static int opt_ls_ctz(unsigned long long x)
+{
+    int n = 0;
+
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+}
+
+
+/** @brief Count the set bits of @p x */
+static int opt_ls_popcnt(unsigned long long x)
+{
+    int n = 0;
+
+    for (; x; x &= x - 1) {
+        n++;
+    }
+    return n;
+}
+#endif
+
+
+/** @brief Mask of the newlines in the 64 bytes at @p p */
+static unsigned long long opt_ls_mask(const char *p)
+{
+#if OPT_LS_SSE2
+    const __m128i nl = _mm_set1_epi8('\n');
+    unsigned long long m0, m1, m2, m3;
+
+    m0 = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(nl,
+         _mm_loadu_si128((const __m128i *)(const void *)p)));
+    m1 = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(nl,
+         _mm_loadu_si128((const __m128i *)(const void *)(p + 16))));
+    m2 = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(nl,
+         _mm_loadu_si128((const __m128i *)(const void *)(p + 32))));
+    m3 = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(nl,
+         _mm_loadu_si128((const __m128i *)(const void *)(p + 48))));
+    return m0 | m1 << 16 | m2 << 32 | m3 << 48;
+#else
+    unsigned long long m = 0;
+    unsigned i;
+
+    for (i = 0; i < 64; i++) {
+        m |= (unsigned long long)(p[i] == '\n') << i;
+    }
+    return m;
+#endif
+}
+
+
+/** @brief Find the next newline at or after @p p, or @p end */
+static const char *opt_ls_eol(const char *p, const char *end)
+{
+    const char *nl = (const char *)memchr(p, '\n', (size_t)(end - p));
+
+    return nl ? nl : end;
+}
+
+
+/** @brief Find the first @p name of @p nlen bytes in [@p p, @p end), or NULL.
+ *      This is memmem(3), which is not in POSIX */
+static const char *opt_ls_find(const char *p, const char *end,
+                               const char *name, size_t nlen)
+{
+    if (!nlen) {
+        return p;
+    }
+    for (; (size_t)(end - p) >= nlen; p++) {
+        /* Candidates: the first byte, where the rest still fits */
+        p = (const char *)memchr(p, *name, (size_t)(end - p) - nlen + 1);
+        if (!p) {
+            return NULL;
+        } else if (!memcmp(p, name, nlen)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+
+/** @brief Count the newlines in [@p p, @p end) */
+static unsigned long long opt_ls_count(const char *p, const char *end)
+{
+    unsigned long long n = 0;
+
+    for (; end - p >= 64; p += 64) {
+        n += (unsigned long long)opt_ls_popcnt(opt_ls_mask(p));
+    }
+    for (; p < end; p++) {
+        n += *p == '\n';
+    }
+    return n;
+}
+
+
+/** @brief FNV-1a of option @p idx and the value @p val */
+static unsigned long long opt_ls_hash(unsigned idx, const char *val)
+{
+    unsigned long long h = 0xcbf29ce484222325ull;
+
+    h = (h ^ (idx & 0xff)) * 0x100000001b3ull;
+    h = (h ^ (idx >> 8)) * 0x100000001b3ull;
+    for (; *val; val++) {
+        h = (h ^ (unsigned char)*val) * 0x100000001b3ull;
+    }
+    /* FNV's low bits mix poorly; the sketches index with them */
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ull;
+    return h ^ h >> 32;
+}
+
+
+/** @brief Count-min column of @p h in row @p r */
+static size_t opt_ls_col(const struct optlsstat *st, unsigned long long h,
+                         unsigned r)
+{
+    unsigned h1 = (unsigned)h, h2 = (unsigned)(h >> 32) | 1;
+
+    return (size_t)r * st->width + ((h1 + r * h2) & (st->width - 1));
+}
+
+
+/** @brief Count value @p val of option @p idx in the top-k entries */
+static void opt_ls_top(struct optlsstat *st, unsigned idx,
+                       unsigned long long h, const char *val)
+{
+    struct optlsval *t = st->top + (size_t)idx * st->topk, tmp;
+    unsigned i;
+
+    for (i = 0; i < st->topk && t[i].count && t[i].hash != h; i++) {
+        ;
+    }
+    if (i == st->topk || !t[i].count) {
+        /* A new value takes an empty entry, or replaces the smallest (last)
+         * and inherits its count as the error */
+        i -= i == st->topk;
+        t[i].err = t[i].count;
+        t[i].hash = h;
+        strncpy(t[i].val, val, OPT_LS_VALLEN - 1);
+        t[i].val[OPT_LS_VALLEN - 1] = '\0';
+    }
+    t[i].count++;
+    for (; i && t[i].count > t[i - 1].count; i--) {
+        tmp = t[i];
+        t[i] = t[i - 1];
+        t[i - 1] = tmp;
+    }
+}
+
+
+/** @brief Grow @p c to hold @p n more rows and @p len more value bytes */
+static int opt_ls_reserve(struct optlscols *c, size_t n, size_t len)
+{
+    size_t cap = c->cap, valcap = c->valcap;
+    void *p;
+
+    while (c->n + n > cap) {
+        cap = cap ? cap * 2 : 1024;
+    }
+    if (cap != c->cap) {
+        if (!(p = realloc(c->line, cap * sizeof *c->line))) {
+            return -1;
+        }
+        c->line = (unsigned long long *)p;
+        if (!(p = realloc(c->opt, cap * sizeof *c->opt))) {
+            return -1;
+        }
+        c->opt = (int *)p;
+        if (!(p = realloc(c->arg, cap * sizeof *c->arg))) {
+            return -1;
+        }
+        c->arg = (int *)p;
+        if (!(p = realloc(c->off, (cap + 1) * sizeof *c->off))) {
+            return -1;
+        }
+        c->off = (long long *)p;
+        c->off[0] = c->n ? c->off[0] : 0;
+        c->cap = cap;
+    }
+    while ((size_t)c->off[c->n] + len > valcap) {
+        valcap = valcap ? valcap * 2 : 16384;
+    }
+    if (valcap != c->valcap) {
+        if (!(p = realloc(c->val, valcap))) {
+            return -1;
+        }
+        c->val = (char *)p;
+        c->valcap = valcap;
+    }
+    return 0;
+}
+
+
+/** @brief Add a row to the columns of @p st */
+static void opt_ls_row(struct optlsstat *st, int opt, int arg,
+                       const char *val, size_t len)
+{
+    struct optlscols *c = &st->cols;
+
+    if (st->nomem || opt_ls_reserve(c, 1, len)) {
+        st->nomem = 1;
+        return;
+    }
+    c->line[c->n] = st->line;
+    c->opt[c->n] = opt;
+    c->arg[c->n] = arg;
+    if (len) {
+        memcpy(c->val + c->off[c->n], val, len);
+    }
+    c->off[c->n + 1] = c->off[c->n] + (long long)len;
+    c->n++;
+}
+
+
+/** @brief Add a row per argument, or one for none, to the columns */
+static void opt_ls_rows(struct optlsstat *st, int opt, unsigned count,
+                        char *args[])
+{
+    unsigned i;
+
+    if (!count) {
+        opt_ls_row(st, opt, -1, "", 0);
+    }
+    for (i = 0; i < count; i++) {
+        opt_ls_row(st, opt, (int)i, args[i], strlen(args[i]));
+    }
+}
+
+
+/** @brief Recording option callback */
+static int opt_ls_opt(int idx, unsigned count, char *args[], void *data)
+{
+    struct optlsstat *st = (struct optlsstat *)data;
+    unsigned long long h;
+    unsigned i, r;
+
+    if (st->conf->flags & OPT_LS_COLS) {
+        opt_ls_rows(st, idx, count, args);
+    }
+    st->freq[idx]++;
+    if (st->seen[idx] != st->cmds) {
+        st->seen[idx] = st->cmds;
+        st->hits[st->nhit++] = (unsigned)idx;
+    }
+    for (i = 0; i < count; i++) {
+        h = opt_ls_hash((unsigned)idx, args[i]);
+        for (r = 0; r < OPT_LS_DEPTH; r++) {
+            st->cm[opt_ls_col(st, h, r)]++;
+        }
+        opt_ls_top(st, (unsigned)idx, h, args[i]);
+    }
+    return 0;
+}
+
+
+/** @brief Recording error callback */
+static int opt_ls_err(int type, char shrt, char *lng, void *data)
+{
+    struct optlsstat *st = (struct optlsstat *)data;
+
+    st->unknown++;
+    if (st->conf->flags & OPT_LS_COLS) {
+        opt_ls_row(st, OPT_LS_UNKNOWN, -1, type ? lng : &shrt,
+                   type ? strlen(lng) : 1);
+    }
+    return 0;
+}
+
+
+/** @brief Positional arguments are not counted, only kept in columns */
+static int opt_ls_pos(int idx, unsigned count, char *args[], void *data)
+{
+    struct optlsstat *st = (struct optlsstat *)data;
+    unsigned i;
+
+    (void)idx;
+    if (st->conf->flags & OPT_LS_COLS) {
+        for (i = 0; i < count; i++) {
+            opt_ls_row(st, OPT_LS_POS, (int)i, args[i], strlen(args[i]));
+        }
+    }
+    return 0;
+}
+
+
+/** @brief Check for and skip a VAR=value assignment */
+static int opt_ls_assign(const char *word)
+{
+    const char *p = word;
+
+    if (!(*p == '_' || (*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z'))) {
+        return 0;
+    }
+    for (p++; *p == '_' || (*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z')
+              || (*p >= '0' && *p <= '9'); p++) {
+        ;
+    }
+    return *p == '=';
+}
+
+
+/** @brief Grow @p st's argv to hold @p n words */
+static int opt_ls_grow(struct optlsstat *st, unsigned n)
+{
+    char **tmp;
+
+    tmp = (char **)realloc(st->argv, ((size_t)n + 1) * sizeof *tmp);
+    if (!tmp) {
+        st->nomem = 1;
+        return -1;
+    }
+    st->argv = tmp;
+    st->argvcap = n;
+    return 0;
+}
+
+
+/** @brief Count the commands of the line [@p p, @p end) */
+static void opt_ls_line(struct optlsstat *st, const char *p, const char *end)
+{
+    const char *next, *base, *name = st->conf->name;
+    struct optinfo info;
+    unsigned argc, k, i, j, a, b;
+    char *tmp;
+
+    if ((size_t)(end - p) + 1 > st->outcap) {
+        if (!(tmp = (char *)realloc(st->out, (size_t)(end - p) * 2 + 1))) {
+            st->nomem = 1;
+            return;
+        }
+        st->out = tmp;
+        st->outcap = (size_t)(end - p) * 2 + 1;
+    }
+    while (p < end) {
+        next = opt_tok_cmd(p, end, st->out, st->argv, st->argvcap, &argc);
+        if (argc > st->argvcap) {
+            if (opt_ls_grow(st, argc * 2)) {
+                return;
+            }
+            continue;
+        }
+        p = next;
+        for (k = 0; k < argc && opt_ls_assign(st->argv[k]); k++) {
+            ;
+        }
+        if (k == argc) {
+            continue;
+        }
+        base = strrchr(st->argv[k], '/');
+        base = base ? base + 1 : st->argv[k];
+        if (name && strcmp(base, name)) {
+            continue;
+        }
+        /* The serial of this command marks the options seen in it */
+        st->cmds++;
+        st->nhit = 0;
+        memset(&info, 0, sizeof info);
+        info.argc = (int)(argc - k);
+        info.argv = st->argv + k;
+        info.fstact = OPT_FIRST_SKIP;
+        info.endact = OPT_END_ALLOW;
+        info.errcb = opt_ls_err;
+        info.poscb = opt_ls_pos;
+        info.data = st;
+        opt_parse_tbl(&info, &st->tbl);
+        for (i = 0; i < st->nhit; i++) {
+            for (j = i; j < st->nhit; j++) {
+                a = st->hits[i] < st->hits[j] ? st->hits[i] : st->hits[j];
+                b = st->hits[i] < st->hits[j] ? st->hits[j] : st->hits[i];
+                st->co[(size_t)a * st->nopt + b]++;
+            }
+        }
+    }
+}
+
+
+OPT_EXTERN_C
+int opt_ls_init(struct optlsstat *st, const struct optlsconf *conf)
+{
+    unsigned nopt = conf->nopt, i;
+
+    memset(st, 0, sizeof *st);
+    st->conf = conf;
+    st->nopt = nopt;
+    st->topk = conf->topk ? conf->topk : 16;
+    st->width = conf->width ? conf->width : 1u << 14;
+    if (st->width & (st->width - 1)) {
+        st->width = 1u << 14;
+    }
+    st->freq = (unsigned long long *)calloc(nopt + 1, sizeof *st->freq);
+    st->co = (unsigned long long *)calloc((size_t)nopt * nopt + 1,
+                                          sizeof *st->co);
+    st->top = (struct optlsval *)calloc((size_t)nopt * st->topk + 1,
+                                        sizeof *st->top);
+    st->cm = (unsigned long long *)calloc((size_t)OPT_LS_DEPTH * st->width,
+                                          sizeof *st->cm);
+    st->opts = (struct optspec *)malloc((nopt + 1) * sizeof *st->opts);
+    st->idx = (const struct optspec **)malloc((nopt + 1) * 2
+                                              * sizeof *st->idx);
+    st->hits = (unsigned *)malloc((nopt + 1) * sizeof *st->hits);
+    st->seen = (unsigned long long *)calloc(nopt + 1, sizeof *st->seen);
+    if (!st->freq || !st->co || !st->top || !st->cm || !st->opts || !st->idx
+     || !st->hits || !st->seen || opt_ls_grow(st, 64)) {
+        opt_ls_free(st);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < nopt; i++) {
+        st->opts[i] = conf->opts[i];
+        st->opts[i].func = opt_ls_opt;
+    }
+    opt_tbl_init(&st->tbl, nopt, st->opts, st->idx, st->idx + nopt + 1);
+    return 0;
+}
+
+
+OPT_EXTERN_C
+void opt_ls_free(struct optlsstat *st)
+{
+    free(st->freq);
+    free(st->co);
+    free(st->top);
+    free(st->cm);
+    free(st->opts);
+    free(st->idx);
+    free(st->out);
+    free(st->argv);
+    free(st->hits);
+    free(st->seen);
+    free(st->cols.line);
+    free(st->cols.opt);
+    free(st->cols.arg);
+    free(st->cols.off);
+    free(st->cols.val);
+    memset(st, 0, sizeof *st);
+}
+
+
+OPT_EXTERN_C
+int opt_ls_feed(struct optlsstat *st, const char *buf, size_t len)
+{
+    const char *p = buf, *end = buf + len, *line, *eol, *hit, *name;
+    int cols = st->conf->flags & OPT_LS_COLS;
+    unsigned long long m;
+    size_t nlen;
+
+    st->line = st->lines;
+    st->bytes += len;
+    st->lines += opt_ls_count(buf, end) + (len && end[-1] != '\n');
+    if ((name = st->conf->name)) {
+        /* Only lines mentioning the tool can count */
+        nlen = strlen(name);
+        while (p < end && (hit = opt_ls_find(p, end, name, nlen))) {
+            for (line = hit; line > p && line[-1] != '\n'; line--) {
+                ;
+            }
+            /* Line numbers are only needed for the columns */
+            st->line += cols ? opt_ls_count(p, line) : 0;
+            eol = opt_ls_eol(hit + nlen, end);
+            opt_ls_line(st, line, eol);
+            st->line += eol < end;
+            p = eol + (eol < end);
+        }
+        return st->nomem ? -1 : 0;
+    }
+    for (line = p; end - p >= 64; p += 64) {
+        for (m = opt_ls_mask(p); m; m &= m - 1) {
+            eol = p + opt_ls_ctz(m);
+            opt_ls_line(st, line, eol);
+            st->line++;
+            line = eol + 1;
+        }
+    }
+    for (; line < end; line = eol + 1) {
+        eol = opt_ls_eol(line, end);
+        opt_ls_line(st, line, eol);
+        st->line++;
+    }
+    return st->nomem ? -1 : 0;
+}
+
+
+/** @brief Merge the top-k entries of one option (mergeable space-saving) */
+static void opt_ls_merge_top(struct optlsval *dst, const struct optlsval *src,
+                             unsigned k, struct optlsval *tmp)
+{
+    unsigned long long dmin, smin;
+    unsigned i, j, n = 0;
+
+    /* A value missing from a full list may have had up to its minimum */
+    dmin = dst[k - 1].count;
+    smin = src[k - 1].count;
+    for (i = 0; i < k && dst[i].count; i++) {
+        tmp[n] = dst[i];
+        for (j = 0; j < k && src[j].count && src[j].hash != dst[i].hash; j++) {
+            ;
+        }
+        if (j < k && src[j].count) {
+            tmp[n].count += src[j].count;
+            tmp[n].err += src[j].err;
+        } else {
+            tmp[n].count += smin;
+            tmp[n].err += smin;
+        }
+        n++;
+    }
+    for (j = 0; j < k && src[j].count; j++) {
+        for (i = 0; i < k && dst[i].count && dst[i].hash != src[j].hash; i++) {
+            ;
+        }
+        if (i == k || !dst[i].count) {
+            tmp[n] = src[j];
+            tmp[n].count += dmin;
+            tmp[n].err += dmin;
+            n++;
+        }
+    }
+    /* Insertion sort, descending */
+    for (i = 1; i < n; i++) {
+        struct optlsval v = tmp[i];
+
+        for (j = i; j && tmp[j - 1].count < v.count; j--) {
+            tmp[j] = tmp[j - 1];
+        }
+        tmp[j] = v;
+    }
+    memset(dst, 0, k * sizeof *dst);
+    memcpy(dst, tmp, (n < k ? n : k) * sizeof *dst);
+}
+
+
+OPT_EXTERN_C
+void opt_ls_merge(struct optlsstat *dst, const struct optlsstat *src)
+{
+    const struct optlscols *sc = &src->cols;
+    struct optlscols *dc = &dst->cols;
+    struct optlsval *tmp;
+    size_t i, base;
+
+    /* Columns are appended, with src's lines after dst's */
+    if (sc->n && !dst->nomem) {
+        if (opt_ls_reserve(dc, sc->n, (size_t)sc->off[sc->n])) {
+            dst->nomem = 1;
+        } else {
+            base = (size_t)dc->off[dc->n];
+            for (i = 0; i < sc->n; i++) {
+                dc->line[dc->n + i] = sc->line[i] + dst->lines;
+                dc->off[dc->n + i + 1] = sc->off[i + 1] + (long long)base;
+            }
+            memcpy(dc->opt + dc->n, sc->opt, sc->n * sizeof *sc->opt);
+            memcpy(dc->arg + dc->n, sc->arg, sc->n * sizeof *sc->arg);
+            if (sc->off[sc->n]) {
+                memcpy(dc->val + base, sc->val, (size_t)sc->off[sc->n]);
+            }
+            dc->n += sc->n;
+        }
+    }
+    dst->bytes += src->bytes;
+    dst->lines += src->lines;
+    dst->cmds += src->cmds;
+    dst->unknown += src->unknown;
+    for (i = 0; i < dst->nopt; i++) {
+        dst->freq[i] += src->freq[i];
+    }
+    for (i = 0; i < (size_t)dst->nopt * dst->nopt; i++) {
+        dst->co[i] += src->co[i];
+    }
+    for (i = 0; i < (size_t)OPT_LS_DEPTH * dst->width; i++) {
+        dst->cm[i] += src->cm[i];
+    }
+    tmp = (struct optlsval *)malloc(2 * dst->topk * sizeof *tmp);
+    if (!tmp) {
+        dst->nomem = 1;
+        return;
+    }
+    for (i = 0; i < dst->nopt; i++) {
+        opt_ls_merge_top(dst->top + i * dst->topk, src->top + i * dst->topk,
+                         dst->topk, tmp);
+    }
+    free(tmp);
+}
+
+
+OPT_EXTERN_C
+unsigned long long opt_ls_estimate(const struct optlsstat *st,
+                                   unsigned                idx,
+                                   const char             *val)
+{
+    unsigned long long h = opt_ls_hash(idx, val), est, c;
+    unsigned r;
+
+    est = st->cm[opt_ls_col(st, h, 0)];
+    for (r = 1; r < OPT_LS_DEPTH; r++) {
+        c = st->cm[opt_ls_col(st, h, r)];
+        est = c < est ? c : est;
+    }
+    return est;
+}
+
+
+/** @brief Private data of an exported Arrow array: its buffers, and the
+ *      allocations it owns */
+struct optlsarrow {
+    const void        *buf[3];
+    void              *own[2];
+    struct ArrowArray *child[4];    /* The struct's, which are ... */
+    struct ArrowArray  arr[4];      /* ... these unless moved */
+};
+
+
+/** @brief Release an exported schema */
+static void opt_ls_schema_release(struct ArrowSchema *schema)
+{
+    int64_t i;
+
+    for (i = 0; i < schema->n_children; i++) {
+        if (schema->children[i]->release) {
+            schema->children[i]->release(schema->children[i]);
+        }
+    }
+    free(schema->private_data);
+    schema->release = NULL;
+}
+
+
+/** @brief Release an exported array */
+static void opt_ls_array_release(struct ArrowArray *array)
+{
+    struct optlsarrow *priv = (struct optlsarrow *)array->private_data;
+    int64_t i;
+
+    for (i = 0; i < array->n_children; i++) {
+        if (array->children[i]->release) {
+            array->children[i]->release(array->children[i]);
+        }
+    }
+    free(priv->own[0]);
+    free(priv->own[1]);
+    free(priv);
+    array->release = NULL;
+}
+
+
+/** @brief Export a column of @p n rows with @p nbuf buffers, the first of
+ *      which is the (absent) validity bitmap
+ *  @returns Zero on success, -1 if out of memory
+ */
+static int opt_ls_array(struct ArrowArray *array, size_t n, int nbuf,
+                        void *own0, void *own1)
+{
+    struct optlsarrow *priv;
+
+    if (!(priv = (struct optlsarrow *)calloc(1, sizeof *priv))) {
+        return -1;
+    }
+    priv->own[0] = own0;
+    priv->own[1] = own1;
+    priv->buf[1] = own0;
+    priv->buf[2] = own1;
+    memset(array, 0, sizeof *array);
+    array->length = (int64_t)n;
+    array->n_buffers = nbuf;
+    array->buffers = priv->buf;
+    array->release = opt_ls_array_release;
+    array->private_data = priv;
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_ls_arrow(struct optlsstat   *st,
+                 struct ArrowSchema *schema,
+                 struct ArrowArray  *array)
+{
+    static const char *const name[4] = { "line", "opt", "arg", "val" };
+    /* The values are raw log bytes, so binary rather than utf8 ("U") */
+    static const char *const format[4] = { "L", "i", "i", "Z" };
+    struct optlscols c = st->cols;
+    struct ArrowSchema *sch;
+    struct optlsarrow *priv;
+    int i, res = 0;
+
+    /* An empty value column still has its one offset */
+    if (!c.off && !(c.off = (long long *)calloc(1, sizeof *c.off))) {
+        return -1;
+    }
+    sch = (struct ArrowSchema *)calloc(1, 4 * sizeof *sch + 4 * sizeof sch);
+    if (!sch || opt_ls_array(array, c.n, 1, NULL, NULL)) {
+        free(sch);
+        if (!st->cols.off) {
+            free(c.off);
+        }
+        return -1;
+    }
+    memset(&st->cols, 0, sizeof st->cols);
+    priv = (struct optlsarrow *)array->private_data;
+    res |= opt_ls_array(&priv->arr[0], c.n, 2, c.line, NULL);
+    res |= opt_ls_array(&priv->arr[1], c.n, 2, c.opt, NULL);
+    res |= opt_ls_array(&priv->arr[2], c.n, 2, c.arg, NULL);
+    res |= opt_ls_array(&priv->arr[3], c.n, 3, c.off, c.val);
+    for (i = 0; i < 4; i++) {
+        priv->child[i] = &priv->arr[i];
+        /* The children own the columns now, if they could be made */
+        if (!priv->arr[i].release) {
+            free(i == 0 ? (void *)c.line : i == 1 ? (void *)c.opt
+                 : i == 2 ? (void *)c.arg : (void *)c.off);
+            free(i == 3 ? c.val : NULL);
+        }
+    }
+    array->n_children = 4;
+    array->children = priv->child;
+    schema->format = "+s";
+    schema->name = "";
+    schema->metadata = NULL;
+    schema->flags = 0;
+    schema->n_children = 4;
+    schema->children = (struct ArrowSchema **)(void *)(sch + 4);
+    schema->dictionary = NULL;
+    schema->release = opt_ls_schema_release;
+    schema->private_data = sch;
+    for (i = 0; i < 4; i++) {
+        sch[i].format = format[i];
+        sch[i].name = name[i];
+        sch[i].release = opt_ls_schema_release;
+        schema->children[i] = &sch[i];
+    }
+    if (res) {
+        array->release(array);
+        schema->release(schema);
+        return -1;
+    }
+    return 0;
+}
+
+
+/** @brief One chunk of opt_ls_run */
+struct optlsjob {
+    struct optlsstat st;
+    pthread_t        thread;
+    const char      *buf;
+    size_t           len;
+    int              res;
+};
+
+
+static void *opt_ls_thread(void *arg)
+{
+    struct optlsjob *job = (struct optlsjob *)arg;
+
+    job->res = opt_ls_feed(&job->st, job->buf, job->len);
+    return NULL;
+}
+
+
+OPT_EXTERN_C
+int opt_ls_run(struct optlsstat *st, const char *buf, size_t len)
+{
+    const char *p = buf, *end = buf + len, *cut;
+    struct optlsjob *job;
+    unsigned n = st->conf->nthread, i, ninit, nrun;
+    long ncpu;
+    int res = 0;
+
+    if (!n) {
+        ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        n = ncpu > 0 ? (unsigned)ncpu : 1;
+    }
+    /* Chunks of less than a megabyte are not worth a thread */
+    while (n > 1 && len / n < (1u << 20)) {
+        n--;
+    }
+    if (n <= 1) {
+        return opt_ls_feed(st, buf, len);
+    }
+    if (!(job = (struct optlsjob *)calloc(n, sizeof *job))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        cut = i + 1 < n ? opt_ls_eol(buf + len / n * (i + 1), end) : end;
+        cut = cut < p ? p : cut + (cut < end);
+        job[i].buf = p;
+        job[i].len = (size_t)(cut - p);
+        p = cut;
+        if (opt_ls_init(&job[i].st, st->conf)) {
+            res = -1;
+            break;
+        }
+    }
+    ninit = i;
+    if (!res) {
+        for (nrun = 0; nrun + 1 < n && !pthread_create(&job[nrun].thread, NULL,
+                                                       opt_ls_thread,
+                                                       &job[nrun]); nrun++) {
+            ;
+        }
+        /* This thread takes the last chunk, and any that got no thread */
+        for (i = nrun; i < n; i++) {
+            opt_ls_thread(&job[i]);
+        }
+        for (i = 0; i < nrun; i++) {
+            pthread_join(job[i].thread, NULL);
+        }
+        for (i = 0; i < n; i++) {
+            opt_ls_merge(st, &job[i].st);
+            res |= job[i].res;
+        }
+        res |= -st->nomem;
+    }
+    for (i = 0; i < ninit; i++) {
+        opt_ls_free(&job[i].st);
+    }
+    free(job);
+    if (res) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+#endif /* OPT_IMPLEMENTATION */
@@ -0,0 +1,410 @@
+#pragma once
+/** @file opt_policy.h parse loops specialized at compile time (C++).
+ *
+ *  opt_parse decides at run time, for every cmdarg, what to do with the
+ *  first one, whether "--" ends the options, and how to look options up,
+ *  although none of that ever changes within a program. opt_parse_pol is
+ *  the same loop as a template over policies, so each tool gets a parse loop
+ *  with only the features it uses:
+ *
+ *  - First     opt_first_info    skip the first cmdarg if info->fstact says
+ *              opt_first_skip    always skip it, e.g. argv[0]
+ *              opt_first_parse   always parse it
+ *
+ *  - End       opt_end_allow     "--" ends the options
+ *              opt_end_disallow  "--" is an ordinary positional argument
+ *
+ *  - Order     opt_order_posix   the first positional argument ends the
+ *                                options
+ *              opt_order_permute positional arguments may come between
+ *                                options, as with GNU getopt(3). They are
+ *                                moved together, before the options, and the
+ *                                positional callback gets them all at the
+ *                                end. Only the order of argv changes
+ *
+ *  - Inline    opt_inline_none   option arguments are separate cmdargs
+ *              opt_inline_values also "--name=value", and "-nvalue" for a
+ *                                short option that takes arguments, each
+ *                                giving that one argument. Any other option
+ *                                in a group still takes the cmdargs after it
+ *
+ *  - Lookup    opt_lookup_sorted binary search of the sorted table
+ *              opt_lookup_linear scan of the option list in order, which is
+ *                                faster for a handful of options and needs
+ *                                only nopt and opts of the table
+ *
+ *  The defaults are what opt_parse_tbl does, so opt_parse_pol<> parses
+ *  exactly as it does, only without the run-time choices. A tool that skips
+ *  argv[0] and takes options anywhere instead uses:
+ *
+ *  res = opt_parse_pol<opt_first_skip, opt_end_allow, opt_order_permute>(
+ *            &info, &tbl);
+ *
+ *  A policy is a struct of the same shape as those below, so tools can add
+ *  their own, e.g. a lookup generated for their option table.
+ *
+ *  The loops are templates, inline in every translation unit that uses
+ *  them, and do not need OPT_IMPLEMENTATION. The C parser's USDT probes,
+ *  capture and profiling are not part of them. Callbacks of inline values
+ *  get an args array that lives only for the call; the strings are in argv.
+ *
+ *  This does not use any heap memory nor issue any stdio calls.
+ */
+#ifndef OPT_POLICY_H
+#define OPT_POLICY_H
+
+#if !defined(__cplusplus) || __cplusplus < 201103L
+#   error "opt_policy.h needs C++11"
+#endif
+
+#include "opt.h"
+
+#include <algorithm>
+#include <stddef.h>
+
+
+/** @brief First cmdarg: as info->fstact says */
+struct opt_first_info {
+    static bool skip(const struct optinfo *info)
+    {
+        return info->fstact == OPT_FIRST_SKIP;
+    }
+};
+
+
+/** @brief First cmdarg: always skipped */
+struct opt_first_skip {
+    static bool skip(const struct optinfo *)
+    {
+        return true;
+    }
+};
+
+
+/** @brief First cmdarg: always parsed */
+struct opt_first_parse {
+    static bool skip(const struct optinfo *)
+    {
+        return false;
+    }
+};
+
+
+/** @brief "--" ends the options */
+struct opt_end_allow {
+    static const bool allow = true;
+};
+
+
+/** @brief "--" is a positional argument */
+struct opt_end_disallow {
+    static const bool allow = false;
+};
+
+
+/** @brief Options end at the first positional argument */
+struct opt_order_posix {
+    static const bool permute = false;
+};
+
+
+/** @brief Options and positional arguments may mix */
+struct opt_order_permute {
+    static const bool permute = true;
+};
+
+
+/** @brief No "--name=value" or "-nvalue" */
+struct opt_inline_none {
+    static const bool values = false;
+};
+
+
+/** @brief "--name=value" and "-nvalue" */
+struct opt_inline_values {
+    static const bool values = true;
+};
+
+
+namespace opt_pol_detail {
+
+/** @brief An argument string classification, as the C parser's */
+enum argtype {
+    ARG_TOKEN,  /* Not an option */
+    ARG_END,    /* "--" to stop parsing options */
+    ARG_SHORT,  /* A short option string */
+    ARG_LONG    /* A long option string */
+};
+
+
+/** @brief Compare the long option @p key, which ends at NUL or at @p stop,
+ *      with the name @p lng, as strcmp(3) would
+ */
+inline int lngcmp(const char *key, char stop, const char *lng)
+{
+    unsigned char c;
+
+    while (*key && *key != stop && *key == *lng) {
+        key++;
+        lng++;
+    }
+    c = (unsigned char)(*key == stop ? '\0' : *key);
+    return (c > (unsigned char)*lng) - (c < (unsigned char)*lng);
+}
+
+} /* namespace opt_pol_detail */
+
+
+/** @brief Lookup: binary search of the sorted table */
+struct opt_lookup_sorted {
+    static const struct optspec *shrt(const struct opttbl *tbl, char key)
+    {
+        unsigned lo = 0, hi = tbl->nshrt, mid;
+
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (tbl->shrt[mid]->shrt < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo < tbl->nshrt && tbl->shrt[lo]->shrt == key ? tbl->shrt[lo]
+                                                             : NULL;
+    }
+
+    static const struct optspec *lng(const struct opttbl *tbl,
+                                     const char          *key,
+                                     char                 stop)
+    {
+        unsigned lo = 0, hi = tbl->nlng, mid;
+        int res;
+
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            res = opt_pol_detail::lngcmp(key, stop, tbl->lng[mid]->lng);
+            if (!res) {
+                return tbl->lng[mid];
+            } else if (res < 0) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return NULL;
+    }
+};
+
+
+/** @brief Lookup: scan of the option list, first match wins */
+struct opt_lookup_linear {
+    static const struct optspec *shrt(const struct opttbl *tbl, char key)
+    {
+        unsigned i;
+
+        /* What opt_tbl_init would index: no blanks or controls */
+        if (key <= ' ' || key >= 0x7f) {
+            return NULL;
+        }
+        for (i = 0; i < tbl->nopt; i++) {
+            if (tbl->opts[i].shrt == key) {
+                return &tbl->opts[i];
+            }
+        }
+        return NULL;
+    }
+
+    static const struct optspec *lng(const struct opttbl *tbl,
+                                     const char          *key,
+                                     char                 stop)
+    {
+        const char *lng;
+        unsigned i;
+
+        for (i = 0; i < tbl->nopt; i++) {
+            lng = tbl->opts[i].lng;
+            if (lng && *lng && !opt_pol_detail::lngcmp(key, stop, lng)) {
+                return &tbl->opts[i];
+            }
+        }
+        return NULL;
+    }
+};
+
+
+namespace opt_pol_detail {
+
+template <class First, class End, class Order, class Inline, class Lookup>
+struct parser {
+    static argtype classify(const char *arg)
+    {
+        if (arg[0] == '-') {
+            if (arg[1] == '-') {
+                return arg[2] ? ARG_LONG : End::allow ? ARG_END : ARG_TOKEN;
+            } else if (arg[1]) {
+                return ARG_SHORT;
+            }
+        }
+        return ARG_TOKEN;
+    }
+
+    static int invoke(struct optinfo       *info,
+                      const struct opttbl  *tbl,
+                      const struct optspec *job,
+                      unsigned              count,
+                      char                 *args[])
+    {
+        return job->func((int)(job - tbl->opts), count, args, info->data);
+    }
+
+    /* Take up to job->args cmdargs that are not options, or are negative
+     * numbers, and call back */
+    static int call_back(struct optinfo       *info,
+                         const struct opttbl  *tbl,
+                         const struct optspec *job)
+    {
+        char **args = info->argv;
+        unsigned i, lim = (unsigned)job->args;
+        argtype type;
+
+        for (i = 0; i < lim && i < (unsigned)info->argc; i++) {
+            type = classify(args[i]);
+            if (type != ARG_TOKEN
+             && (type != ARG_SHORT || args[i][1] < '0' || args[i][1] > '9')) {
+                break;
+            }
+        }
+        info->argc -= (int)i;
+        info->argv += i;
+        return invoke(info, tbl, job, i, args);
+    }
+
+    static int shrt(struct optinfo      *info,
+                    const struct opttbl *tbl,
+                    char                *opt)
+    {
+        const struct optspec *fnd;
+        int res = 0, noargs = opt[1] != '\0';
+        char *val;
+
+        do {
+            fnd = Lookup::shrt(tbl, *opt);
+            if (!fnd) {
+                res = info->errcb(0, *opt, NULL, info->data);
+            } else if (Inline::values && fnd->args && opt[1]) {
+                /* The rest of the group is the argument */
+                val = opt + 1;
+                return invoke(info, tbl, fnd, 1, &val);
+            } else if (noargs && !Inline::values) {
+                res = invoke(info, tbl, fnd, 0, info->argv);
+            } else {
+                res = call_back(info, tbl, fnd);
+            }
+        } while (*++opt && !res);
+        return res;
+    }
+
+    static int lng(struct optinfo *info, const struct opttbl *tbl, char *opt)
+    {
+        const struct optspec *fnd;
+        char *val = NULL;
+
+        if (Inline::values) {
+            for (val = opt; *val && *val != '='; val++) {
+            }
+            val = *val ? val + 1 : NULL;
+        }
+        fnd = Lookup::lng(tbl, opt, Inline::values ? '=' : '\0');
+        if (!fnd || (val && !fnd->args)) {
+            return info->errcb(1, '\0', opt, info->data);
+        } else if (val) {
+            return invoke(info, tbl, fnd, 1, &val);
+        }
+        return call_back(info, tbl, fnd);
+    }
+
+    static int read(struct optinfo *info, const struct opttbl *tbl)
+    {
+        char **base = info->argv, **end = info->argv + info->argc, **run;
+        unsigned npos = 0;
+        char *str;
+        int res = 0;
+
+        while (info->argc) {
+            /* Taken before the check, which is where opt_parse leaves argv
+             * when a callback stops it */
+            str = *info->argv++;
+            info->argc--;
+            if (res) {
+                break;
+            }
+            switch (classify(str)) {
+            case ARG_TOKEN:
+                if (!Order::permute) {
+                    info->argc++;
+                    info->argv--;
+                    return info->poscb(-1, (unsigned)info->argc, info->argv,
+                                       info->data);
+                }
+                /* Move the run of positional arguments here to the others */
+                for (run = info->argv; run < end; run++) {
+                    if (classify(*run) != ARG_TOKEN) {
+                        break;
+                    }
+                }
+                std::rotate(base + npos, info->argv - 1, run);
+                npos += (unsigned)(run - info->argv) + 1;
+                info->argc = (int)(end - run);
+                info->argv = run;
+                break;
+            case ARG_END:
+                /* The others go just before the rest */
+                if (Order::permute) {
+                    std::rotate(base, base + npos, info->argv);
+                }
+                return info->poscb(-1, npos + (unsigned)info->argc,
+                                   info->argv - npos, info->data);
+            case ARG_SHORT:
+                res = shrt(info, tbl, str + 1);
+                break;
+            case ARG_LONG:
+                res = lng(info, tbl, str + 2);
+                break;
+            }
+        }
+        if (Order::permute && npos && !res) {
+            return info->poscb(-1, npos, base, info->data);
+        }
+        return res;
+    }
+};
+
+} /* namespace opt_pol_detail */
+
+
+/** @brief Parse command-line arguments as opt_parse_tbl does, with the
+ *      features chosen by the policies. See the top of this file
+ *  @param info
+ *      Option context structure
+ *  @param tbl
+ *      Options table, or for opt_lookup_linear one with just nopt and opts
+ *  @returns Zero on complete success, nonzero if it was told to by a
+ *      callback. The return value is exactly the same as the terminating
+ *      callback's return value
+ */
+template <class First  = opt_first_info,
+          class End    = opt_end_allow,
+          class Order  = opt_order_posix,
+          class Inline = opt_inline_none,
+          class Lookup = opt_lookup_sorted>
+int opt_parse_pol(struct optinfo *info, const struct opttbl *tbl)
+{
+    if (First::skip(info) && info->argc) {
+        info->argc--;
+        info->argv++;
+    }
+    return opt_pol_detail::parser<First, End, Order, Inline, Lookup>::read(
+        info, tbl);
+}
+
+#endif /* OPT_POLICY_H */
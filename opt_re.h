@@ -0,0 +1,1211 @@
+#pragma once
+/** @file opt_re.h option values validated by patterns compiled to DFAs.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  Give the options whose values must match a pattern one in an array that
+ *  runs parallel to the option table, and compile it with the table once:
+ *
+ *  static const struct optpat pats[] = {
+ *      { "^[a-z0-9-]{1,63}$", 0             },     --label
+ *      { "*.json",            OPT_PAT_GLOB  },     --policy
+ *      { NULL,                0             }      --verbose, no check
+ *  };
+ *  struct optretbl rt;
+ *
+ *  if (opt_re_tbl_init(&rt, &tbl, pats, &bad)) { ... pats[bad] is bad ... }
+ *  ...
+ *  res = opt_re_parse(&info, &rt);
+ *  ...
+ *  opt_re_tbl_free(&rt);
+ *
+ *  opt_re_parse is opt_parse_tbl, except that every argument collected for
+ *  an option with a pattern is checked before its callback is called. A
+ *  value that does not match is passed to the error callback as type
+ *  OPT_ERR_VALUE, with the option's short character (or nul) and the value
+ *  in place of the long option. If that returns nonzero the parse stops.
+ *  Otherwise the option's callback is skipped and the parse goes on.
+ *
+ *  Each pattern is compiled to a deterministic automaton over byte classes,
+ *  so checking a value is one table lookup per byte, however the pattern is
+ *  written. No regex_t is compiled or run per value, and there is no
+ *  backtracking. Regexes are POSIX extended regexes without
+ *  backreferences, like regexec(3) they match anywhere in the value unless
+ *  anchored, and they support:
+ *
+ *  - literals, ., [...] and [^...] with ranges and [:class:] names
+ *  - \d \w \s and their negations \D \W \S, \ before any other character
+ *    for that character, and \n \t \r
+ *  - grouping (), alternation |, and * + ? {m} {m,} {m,n} (n up to 255)
+ *  - the anchors ^ and $
+ *
+ *  Globs match the whole value, as fnmatch(3) without flags: * ? [...] [!...]
+ *  and \ to escape. OPT_PAT_ICASE ignores ASCII case in either.
+ *
+ *  opt_re_compile and opt_re_match also work alone, for values that come
+ *  from elsewhere. This uses the heap.
+ */
+#ifndef OPT_RE_H
+#define OPT_RE_H
+
+#include "opt.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+#define OPT_ERR_VALUE   2   /* Error callback type of a value that failed */
+
+#define OPT_PAT_GLOB    0x1 /* The pattern is a glob, not a regex */
+#define OPT_PAT_ICASE   0x2 /* Ignore ASCII case */
+
+#define OPT_RE_MAXSTATE 4096    /* Automaton states, at most */
+
+
+/** @brief Pattern of one option */
+struct optpat {
+    const char *pat;    /* Pattern (NULL: no check) */
+    unsigned    flags;  /* OPT_PAT_* */
+};
+
+
+/** @brief A compiled pattern. State 0 rejects */
+struct optre {
+    unsigned        nstate; /* States, zero if there is no pattern */
+    unsigned        ncls;   /* Byte classes */
+    unsigned        start;  /* Start state */
+    unsigned char   cls[256];   /* Byte class of each byte */
+    unsigned short *next;   /* nstate * ncls transitions */
+    unsigned char  *acc;    /* Whether each state accepts */
+};
+
+
+/** @brief An option table compiled with its patterns */
+struct optretbl {
+    struct opttbl          tbl;     /* The table, with checking callbacks */
+
+    /* Private */
+    const struct opttbl   *orig;
+    struct optre          *re;      /* One per option */
+    struct optspec        *opts;
+    const struct optspec **shrt;
+    const struct optspec **lng;
+};
+
+
+/** @brief Compile one pattern
+ *  @param re
+ *      Compiled pattern
+ *  @param pat
+ *      Pattern
+ *  @param flags
+ *      OPT_PAT_*
+ *  @returns Zero, or an errno value: EINVAL for a malformed pattern, ENOSPC
+ *      for one that needs more than OPT_RE_MAXSTATE states, ENOMEM
+ */
+int opt_re_compile(struct optre *re, const char *pat, unsigned flags);
+
+
+/** @brief Check @p len bytes of @p str against @p re
+ *  @returns Nonzero if they match
+ */
+int opt_re_match(const struct optre *re, const char *str, size_t len);
+
+
+/** @brief Free a compiled pattern
+ *  @param re
+ *      Compiled pattern
+ */
+void opt_re_free(struct optre *re);
+
+
+/** @brief Compile the patterns for @p tbl
+ *  @param rt
+ *      Table to initialize, which refers to @p tbl
+ *  @param tbl
+ *      Sorted option table
+ *  @param pats
+ *      A pattern per option
+ *  @param bad
+ *      Set to the index of the pattern at fault on error
+ *  @returns Zero, or an errno value as from opt_re_compile
+ */
+int opt_re_tbl_init(struct optretbl     *rt,
+                    const struct opttbl *tbl,
+                    const struct optpat  pats[],
+                    unsigned            *bad);
+
+
+/** @brief opt_parse_tbl, checking values against their patterns
+ *  @param info
+ *      Option context structure
+ *  @param rt
+ *      Table with its patterns
+ *  @returns See opt_parse
+ */
+int opt_re_parse(struct optinfo *info, const struct optretbl *rt);
+
+
+/** @brief Free a table's patterns
+ *  @param rt
+ *      Table
+ */
+void opt_re_tbl_free(struct optretbl *rt);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_RE_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define OPT_RE_MAXREP   255     /* Largest {m,n} bound */
+#define OPT_RE_MAXDEPTH 64      /* Group nesting */
+#define OPT_RE_MAXNFA   65536   /* NFA states, before determinization */
+
+/* Syntax tree nodes */
+#define OPT_RE_EMPTY    0
+#define OPT_RE_SET      1
+#define OPT_RE_CAT      2
+#define OPT_RE_ALT      3
+#define OPT_RE_REP      4
+#define OPT_RE_BOL      5
+#define OPT_RE_EOL      6
+
+/* NFA states */
+#define OPT_RE_NSET     0       /* Consume a byte in set, go to out */
+#define OPT_RE_NSPLIT   1       /* Go to out and out1 */
+#define OPT_RE_NMATCH   2
+#define OPT_RE_NBOL     3       /* Go to out at the start of the value */
+#define OPT_RE_NEOL     4       /* Go to out at the end of the value */
+
+
+/** @brief Syntax tree node */
+struct optrenode {
+    int             kind;   /* OPT_RE_EMPTY... */
+    unsigned        a, b;   /* Children, for CAT, ALT and REP (a only) */
+    unsigned        min;    /* REP bounds, max ~0u for none */
+    unsigned        max;
+    unsigned char   set[32];
+};
+
+
+/** @brief NFA state */
+struct optrenfa {
+    int             kind;   /* OPT_RE_NSET... */
+    unsigned        out;
+    unsigned        out1;
+    unsigned        set;    /* Node holding the byte set */
+};
+
+
+/** @brief Compiler state */
+struct optrec {
+    const char         *p;      /* Pattern position */
+    unsigned            flags;
+    int                 err;
+    unsigned            depth;
+    struct optrenode   *node;
+    unsigned            nnode;
+    unsigned            capnode;
+    struct optrenfa    *nfa;
+    unsigned            nnfa;
+    unsigned            capnfa;
+};
+
+
+/** @brief Add a node of @p kind, returning its index or ~0u */
+static unsigned opt_re_node(struct optrec *c, int kind)
+{
+    struct optrenode *n;
+    unsigned cap;
+    void *p;
+
+    if (c->err) {
+        return ~0u;
+    }
+    if (c->nnode == c->capnode) {
+        cap = c->capnode ? c->capnode * 2 : 64;
+        if (!(p = realloc(c->node, cap * sizeof *c->node))) {
+            c->err = ENOMEM;
+            return ~0u;
+        }
+        c->node = (struct optrenode *)p;
+        c->capnode = cap;
+    }
+    n = &c->node[c->nnode];
+    memset(n, 0, sizeof *n);
+    n->kind = kind;
+    return c->nnode++;
+}
+
+
+/** @brief Add a node of @p kind with children @p a and @p b */
+static unsigned opt_re_pair(struct optrec *c, int kind, unsigned a, unsigned b)
+{
+    unsigned n = opt_re_node(c, kind);
+
+    if (n != ~0u) {
+        c->node[n].a = a;
+        c->node[n].b = b;
+    }
+    return n;
+}
+
+
+static void opt_re_add(unsigned char *set, unsigned ch)
+{
+    set[ch >> 3] |= (unsigned char)(1u << (ch & 7));
+}
+
+
+static int opt_re_has(const unsigned char *set, unsigned ch)
+{
+    return set[ch >> 3] >> (ch & 7) & 1;
+}
+
+
+/** @brief Add the bytes from @p lo to @p hi, and their other case with
+ *      OPT_PAT_ICASE */
+static void opt_re_range(struct optrec *c, unsigned char *set, unsigned lo,
+                         unsigned hi)
+{
+    unsigned ch;
+
+    for (ch = lo; ch <= hi; ch++) {
+        opt_re_add(set, ch);
+        if (!(c->flags & OPT_PAT_ICASE)) {
+            continue;
+        } else if (ch >= 'a' && ch <= 'z') {
+            opt_re_add(set, ch - 'a' + 'A');
+        } else if (ch >= 'A' && ch <= 'Z') {
+            opt_re_add(set, ch - 'A' + 'a');
+        }
+    }
+}
+
+
+static void opt_re_invert(unsigned char *set)
+{
+    unsigned i;
+
+    for (i = 0; i < 32; i++) {
+        set[i] = (unsigned char)~set[i];
+    }
+}
+
+
+/** @brief Add the class named by @p name, of length @p len
+ *  @returns Zero, or -1 if there is no such class
+ */
+static int opt_re_named(struct optrec *c, unsigned char *set,
+                        const char *name, size_t len)
+{
+    static const char *const names[] = {
+        "alnum", "alpha", "blank", "cntrl", "digit", "graph",
+        "lower", "print", "punct", "space", "upper", "xdigit"
+    };
+    unsigned i, ch;
+    int in;
+
+    for (i = 0; i < sizeof names / sizeof *names; i++) {
+        if (strlen(names[i]) == len && !memcmp(names[i], name, len)) {
+            break;
+        }
+    }
+    if (i == sizeof names / sizeof *names) {
+        return -1;
+    }
+    /* ASCII only, whatever the locale */
+    for (ch = 0; ch < 128; ch++) {
+        switch (i) {
+        case 0:  in = (ch | 32) - 'a' < 26 || ch - '0' < 10; break;
+        case 1:  in = (ch | 32) - 'a' < 26; break;
+        case 2:  in = ch == ' ' || ch == '\t'; break;
+        case 3:  in = ch < 32 || ch == 127; break;
+        case 4:  in = ch - '0' < 10; break;
+        case 5:  in = ch > 32 && ch < 127; break;
+        case 6:  in = ch - 'a' < 26; break;
+        case 7:  in = ch >= 32 && ch < 127; break;
+        case 8:  in = ch > 32 && ch < 127 && (ch | 32) - 'a' >= 26
+                      && ch - '0' >= 10; break;
+        case 9:  in = ch == ' ' || ch - '\t' < 5; break;
+        case 10: in = ch - 'A' < 26; break;
+        default: in = ch - '0' < 10 || (ch | 32) - 'a' < 6; break;
+        }
+        if (in) {
+            opt_re_range(c, set, ch, ch);
+        }
+    }
+    return 0;
+}
+
+
+/** @brief Add the class of the escape \@p ch
+ *  @returns Zero, or -1 if it is not a class escape
+ */
+static int opt_re_escape(struct optrec *c, unsigned char *set, char ch)
+{
+    unsigned char tmp[32];
+    const char *name;
+    unsigned i;
+
+    switch (ch | 32) {
+    case 'd':
+        name = "digit";
+        break;
+    case 's':
+        name = "space";
+        break;
+    case 'w':
+        name = "alnum";
+        break;
+    default:
+        return -1;
+    }
+    memset(tmp, 0, sizeof tmp);
+    opt_re_named(c, tmp, name, strlen(name));
+    if ((ch | 32) == 'w') {
+        opt_re_add(tmp, '_');
+    }
+    if (ch >= 'A' && ch <= 'Z') {
+        opt_re_invert(tmp);
+    }
+    for (i = 0; i < 32; i++) {
+        set[i] |= tmp[i];
+    }
+    return 0;
+}
+
+
+/** @brief The byte an escape \@p ch stands for */
+static unsigned char opt_re_literal(char ch)
+{
+    switch (ch) {
+    case 'n':
+        return '\n';
+    case 't':
+        return '\t';
+    case 'r':
+        return '\r';
+    default:
+        return (unsigned char)ch;
+    }
+}
+
+
+/** @brief Parse a bracket expression, after its '[' */
+static unsigned opt_re_bracket(struct optrec *c, int glob)
+{
+    unsigned n = opt_re_node(c, OPT_RE_SET), lo, hi;
+    unsigned char *set;
+    const char *end;
+    int neg = 0, first;
+
+    if (n == ~0u) {
+        return n;
+    }
+    set = c->node[n].set;
+    if (*c->p == '^' || (glob && *c->p == '!')) {
+        neg = 1;
+        c->p++;
+    }
+    /* A leading ] is literal */
+    for (first = 1; *c->p != ']' || first; first = 0) {
+        if (!*c->p) {
+            c->err = EINVAL;
+            return ~0u;
+        }
+        if (c->p[0] == '[' && c->p[1] == ':') {
+            end = strstr(c->p + 2, ":]");
+            if (!end || opt_re_named(c, set, c->p + 2,
+                                     (size_t)(end - c->p - 2))) {
+                c->err = EINVAL;
+                return ~0u;
+            }
+            c->p = end + 2;
+            continue;
+        }
+        if (*c->p == '\\' && c->p[1]) {
+            c->p++;
+            if (!glob && !opt_re_escape(c, set, *c->p)) {
+                c->p++;
+                continue;
+            }
+            lo = glob ? (unsigned char)*c->p : opt_re_literal(*c->p);
+        } else {
+            lo = (unsigned char)*c->p;
+        }
+        c->p++;
+        hi = lo;
+        if (c->p[0] == '-' && c->p[1] && c->p[1] != ']') {
+            hi = (unsigned char)c->p[1];
+            c->p += 2;
+            if (hi < lo) {
+                c->err = EINVAL;
+                return ~0u;
+            }
+        }
+        opt_re_range(c, set, lo, hi);
+    }
+    c->p++;
+    if (neg) {
+        opt_re_invert(set);
+    }
+    return n;
+}
+
+
+static unsigned opt_re_alt(struct optrec *c);
+
+
+/** @brief Parse an atom */
+static unsigned opt_re_atom(struct optrec *c)
+{
+    unsigned n;
+
+    switch (*c->p) {
+    case '(':
+        if (++c->depth > OPT_RE_MAXDEPTH) {
+            c->err = EINVAL;
+            return ~0u;
+        }
+        c->p++;
+        n = opt_re_alt(c);
+        if (*c->p != ')') {
+            c->err = EINVAL;
+            return ~0u;
+        }
+        c->p++;
+        c->depth--;
+        return n;
+    case '[':
+        c->p++;
+        return opt_re_bracket(c, 0);
+    case '.':
+        c->p++;
+        if ((n = opt_re_node(c, OPT_RE_SET)) != ~0u) {
+            memset(c->node[n].set, 0xff, sizeof c->node[n].set);
+        }
+        return n;
+    case '\\':
+        if (!c->p[1]) {
+            c->err = EINVAL;
+            return ~0u;
+        }
+        c->p++;
+        if ((n = opt_re_node(c, OPT_RE_SET)) == ~0u) {
+            return n;
+        }
+        if (opt_re_escape(c, c->node[n].set, *c->p)) {
+            opt_re_range(c, c->node[n].set, opt_re_literal(*c->p),
+                         opt_re_literal(*c->p));
+        }
+        c->p++;
+        return n;
+    case '^':
+        c->p++;
+        return opt_re_node(c, OPT_RE_BOL);
+    case '$':
+        c->p++;
+        return opt_re_node(c, OPT_RE_EOL);
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+    case ')':
+    case '|':
+        /* Quantifiers need an atom */
+        c->err = EINVAL;
+        return ~0u;
+    default:
+        if ((n = opt_re_node(c, OPT_RE_SET)) != ~0u) {
+            opt_re_range(c, c->node[n].set, (unsigned char)*c->p,
+                         (unsigned char)*c->p);
+        }
+        c->p++;
+        return n;
+    }
+}
+
+
+/** @brief Parse a decimal bound of {m,n} */
+static unsigned opt_re_bound(struct optrec *c)
+{
+    unsigned v = 0;
+
+    if (*c->p < '0' || *c->p > '9') {
+        c->err = EINVAL;
+        return 0;
+    }
+    while (*c->p >= '0' && *c->p <= '9') {
+        v = v * 10 + (unsigned)(*c->p++ - '0');
+        if (v > OPT_RE_MAXREP) {
+            c->err = EINVAL;
+            return 0;
+        }
+    }
+    return v;
+}
+
+
+/** @brief Parse an atom and its quantifiers */
+static unsigned opt_re_repeat(struct optrec *c)
+{
+    unsigned n = opt_re_atom(c), r, min, max;
+
+    while (!c->err) {
+        switch (*c->p) {
+        case '*':
+            min = 0;
+            max = ~0u;
+            break;
+        case '+':
+            min = 1;
+            max = ~0u;
+            break;
+        case '?':
+            min = 0;
+            max = 1;
+            break;
+        case '{':
+            c->p++;
+            min = max = opt_re_bound(c);
+            if (*c->p == ',') {
+                c->p++;
+                max = *c->p == '}' ? ~0u : opt_re_bound(c);
+            }
+            if (c->err || *c->p != '}' || max < min) {
+                c->err = EINVAL;
+                return ~0u;
+            }
+            break;
+        default:
+            return n;
+        }
+        if (c->node[n].kind == OPT_RE_BOL || c->node[n].kind == OPT_RE_EOL) {
+            c->err = EINVAL;
+            return ~0u;
+        }
+        c->p++;
+        if ((r = opt_re_pair(c, OPT_RE_REP, n, 0)) != ~0u) {
+            c->node[r].min = min;
+            c->node[r].max = max;
+        }
+        n = r;
+    }
+    return ~0u;
+}
+
+
+/** @brief Parse a concatenation */
+static unsigned opt_re_cat(struct optrec *c)
+{
+    unsigned n = opt_re_node(c, OPT_RE_EMPTY);
+
+    while (!c->err && *c->p && *c->p != '|' && *c->p != ')') {
+        n = opt_re_pair(c, OPT_RE_CAT, n, opt_re_repeat(c));
+    }
+    return n;
+}
+
+
+/** @brief Parse an alternation */
+static unsigned opt_re_alt(struct optrec *c)
+{
+    unsigned n = opt_re_cat(c);
+
+    while (!c->err && *c->p == '|') {
+        c->p++;
+        n = opt_re_pair(c, OPT_RE_ALT, n, opt_re_cat(c));
+    }
+    return n;
+}
+
+
+/** @brief Parse a glob */
+static unsigned opt_re_glob(struct optrec *c)
+{
+    unsigned n = opt_re_node(c, OPT_RE_EMPTY), m;
+
+    while (!c->err && *c->p) {
+        if (*c->p == '[' && strchr(c->p + 1 + (c->p[1] == ']'), ']')) {
+            c->p++;
+            m = opt_re_bracket(c, 1);
+        } else if ((m = opt_re_node(c, OPT_RE_SET)) == ~0u) {
+            break;
+        } else if (*c->p == '*' || *c->p == '?') {
+            memset(c->node[m].set, 0xff, sizeof c->node[m].set);
+            if (*c->p == '*') {
+                m = opt_re_pair(c, OPT_RE_REP, m, 0);
+                if (m != ~0u) {
+                    c->node[m].max = ~0u;
+                }
+            }
+            c->p++;
+        } else {
+            c->p += *c->p == '\\' && c->p[1];
+            opt_re_range(c, c->node[m].set, (unsigned char)*c->p,
+                         (unsigned char)*c->p);
+            c->p++;
+        }
+        n = opt_re_pair(c, OPT_RE_CAT, n, m);
+    }
+    return n;
+}
+
+
+/** @brief Add an NFA state, returning its index or ~0u */
+static unsigned opt_re_state(struct optrec *c, int kind, unsigned out,
+                             unsigned out1, unsigned set)
+{
+    unsigned cap;
+    void *p;
+
+    if (c->err || c->nnfa >= OPT_RE_MAXNFA) {
+        c->err = c->err ? c->err : ENOSPC;
+        return ~0u;
+    }
+    if (c->nnfa == c->capnfa) {
+        cap = c->capnfa ? c->capnfa * 2 : 64;
+        if (!(p = realloc(c->nfa, cap * sizeof *c->nfa))) {
+            c->err = ENOMEM;
+            return ~0u;
+        }
+        c->nfa = (struct optrenfa *)p;
+        c->capnfa = cap;
+    }
+    c->nfa[c->nnfa].kind = kind;
+    c->nfa[c->nnfa].out = out;
+    c->nfa[c->nnfa].out1 = out1;
+    c->nfa[c->nnfa].set = set;
+    return c->nnfa++;
+}
+
+
+/** @brief Build the NFA for node @p n backwards, ending in state @p next
+ *  @returns The state it starts in
+ */
+static unsigned opt_re_emit(struct optrec *c, unsigned n, unsigned next)
+{
+    const struct optrenode *node;
+    unsigned s, i;
+
+    if (c->err) {
+        return ~0u;
+    }
+    node = &c->node[n];
+    switch (node->kind) {
+    case OPT_RE_SET:
+        return opt_re_state(c, OPT_RE_NSET, next, 0, n);
+    case OPT_RE_BOL:
+        return opt_re_state(c, OPT_RE_NBOL, next, 0, 0);
+    case OPT_RE_EOL:
+        return opt_re_state(c, OPT_RE_NEOL, next, 0, 0);
+    case OPT_RE_CAT:
+        return opt_re_emit(c, node->a, opt_re_emit(c, node->b, next));
+    case OPT_RE_ALT:
+        s = opt_re_emit(c, node->a, next);
+        return opt_re_state(c, OPT_RE_NSPLIT, s, opt_re_emit(c, node->b, next),
+                            0);
+    case OPT_RE_REP:
+        if (node->max == ~0u) {
+            /* A loop, then the copies that must be there */
+            s = opt_re_state(c, OPT_RE_NSPLIT, 0, next, 0);
+            if (s != ~0u) {
+                i = opt_re_emit(c, node->a, s);
+                c->nfa[s].out = i;
+            }
+            next = s;
+        } else {
+            /* Nested optional copies, x(x(x)?)? */
+            for (i = node->min; i < node->max; i++) {
+                s = opt_re_emit(c, node->a, next);
+                next = opt_re_state(c, OPT_RE_NSPLIT, s, next, 0);
+            }
+        }
+        for (i = 0; i < node->min; i++) {
+            next = opt_re_emit(c, node->a, next);
+        }
+        return next;
+    default:
+        return next;
+    }
+}
+
+
+/** @brief Determinization state */
+struct optredet {
+    struct optrec  *c;
+    unsigned       *mark;   /* Last closure each NFA state was added to */
+    unsigned        gen;
+    unsigned       *stack;
+    unsigned       *list;   /* Members of every DFA state, concatenated */
+    size_t          nlist;
+    size_t          caplist;
+    size_t         *off;    /* Members of DFA state i: off[i] to off[i + 1] */
+    unsigned       *hash;   /* Open addressing, DFA state + 1 */
+    unsigned        nhash;
+    unsigned        start;  /* Start state, which no other state shares */
+};
+
+
+/** @brief Append the closure of @p from to the list, passing ^ if @p bol,
+ *      and return its length or -1 if memory ran out */
+static long opt_re_closure(struct optredet *d, const unsigned *from,
+                           unsigned nfrom, int bol)
+{
+    const struct optrenfa *nfa = d->c->nfa;
+    unsigned sp = 0, s, i;
+    size_t start = d->nlist;
+    void *p;
+
+    d->gen++;
+    for (i = 0; i < nfrom; i++) {
+        d->stack[sp++] = from[i];
+    }
+    while (sp) {
+        s = d->stack[--sp];
+        if (d->mark[s] == d->gen) {
+            continue;
+        }
+        d->mark[s] = d->gen;
+        if (nfa[s].kind == OPT_RE_NSPLIT) {
+            d->stack[sp++] = nfa[s].out1;
+            d->stack[sp++] = nfa[s].out;
+            continue;
+        } else if (nfa[s].kind == OPT_RE_NBOL) {
+            /* Past the start, ^ is a dead end */
+            if (bol) {
+                d->stack[sp++] = nfa[s].out;
+            }
+            continue;
+        }
+        if (d->nlist == d->caplist) {
+            d->caplist = d->caplist ? d->caplist * 2 : 1024;
+            if (!(p = realloc(d->list, d->caplist * sizeof *d->list))) {
+                return -1;
+            }
+            d->list = (unsigned *)p;
+        }
+        d->list[d->nlist++] = s;
+    }
+    return (long)(d->nlist - start);
+}
+
+
+/** @brief Whether DFA state @p s accepts at the end of the value, passing ^
+ *      if @p bol */
+static int opt_re_accepts(struct optredet *d, unsigned s, int bol)
+{
+    const struct optrenfa *nfa = d->c->nfa;
+    unsigned sp = 0, t;
+    size_t j;
+
+    d->gen++;
+    for (j = d->off[s]; j < d->off[s + 1]; j++) {
+        d->stack[sp++] = d->list[j];
+    }
+    while (sp) {
+        t = d->stack[--sp];
+        if (d->mark[t] == d->gen) {
+            continue;
+        }
+        d->mark[t] = d->gen;
+        switch (nfa[t].kind) {
+        case OPT_RE_NMATCH:
+            return 1;
+        case OPT_RE_NSPLIT:
+            d->stack[sp++] = nfa[t].out1;
+            /* Fall through */
+        case OPT_RE_NEOL:
+            d->stack[sp++] = nfa[t].out;
+            break;
+        case OPT_RE_NBOL:
+            if (bol) {
+                d->stack[sp++] = nfa[t].out;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+
+static int opt_re_ucmp(const void *p1, const void *p2)
+{
+    unsigned x = *(const unsigned *)p1, y = *(const unsigned *)p2;
+
+    return (x > y) - (x < y);
+}
+
+
+/** @brief Hash of @p n members */
+static unsigned opt_re_hash(const unsigned *list, size_t n)
+{
+    unsigned h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        h = (h ^ list[i]) * 16777619u;
+    }
+    return h;
+}
+
+
+/** @brief Find or add the DFA state of the closure just appended to the list
+ *  @returns The state, or ~0u on error with c->err set
+ */
+static unsigned opt_re_intern(struct optredet *d, struct optre *re,
+                              size_t start)
+{
+    size_t n = d->nlist - start, m;
+    unsigned h, slot, s;
+
+    if (n) {
+        qsort(d->list + start, n, sizeof *d->list, opt_re_ucmp);
+    }
+    h = opt_re_hash(d->list + start, n);
+    for (slot = h & (d->nhash - 1); d->hash[slot];
+         slot = (slot + 1) & (d->nhash - 1)) {
+        s = d->hash[slot] - 1;
+        m = d->off[s + 1] - d->off[s];
+        /* The start state alone may pass a ^ after a $ */
+        if (s != d->start && m == n
+                && !memcmp(d->list + d->off[s], d->list + start,
+                           n * sizeof *d->list)) {
+            d->nlist = start;
+            return s;
+        }
+    }
+    if (re->nstate == OPT_RE_MAXSTATE) {
+        d->c->err = ENOSPC;
+        return ~0u;
+    }
+    s = re->nstate++;
+    d->off[s + 1] = d->nlist;
+    d->hash[slot] = s + 1;
+    return s;
+}
+
+
+/** @brief Split the bytes into classes that every set treats alike */
+static void opt_re_classes(struct optrec *c, struct optre *re)
+{
+    unsigned short map[2][256];
+    unsigned n, ch, k, set;
+
+    memset(re->cls, 0, sizeof re->cls);
+    re->ncls = 1;
+    for (n = 0; n < c->nnode; n++) {
+        if (c->node[n].kind != OPT_RE_SET) {
+            continue;
+        }
+        /* Refine: (class, in set) pairs become the new classes */
+        memset(map, 0xff, sizeof map);
+        k = 0;
+        for (ch = 0; ch < 256; ch++) {
+            set = (unsigned)opt_re_has(c->node[n].set, ch);
+            if (map[set][re->cls[ch]] == 0xffff) {
+                map[set][re->cls[ch]] = (unsigned short)k++;
+            }
+            re->cls[ch] = (unsigned char)map[set][re->cls[ch]];
+        }
+        re->ncls = k;
+    }
+}
+
+
+/** @brief Determinize the NFA starting at @p start into @p re */
+static void opt_re_dfa(struct optrec *c, struct optre *re, unsigned start)
+{
+    unsigned rep[256], *from, nfrom, s, cls, i, t;
+    struct optredet d;
+    size_t j, base;
+    long len;
+    void *p;
+
+    memset(&d, 0, sizeof d);
+    d.c = c;
+    d.start = ~0u;
+    d.nhash = 2 * OPT_RE_MAXSTATE;
+    d.mark = (unsigned *)calloc(c->nnfa, sizeof *d.mark);
+    d.stack = (unsigned *)malloc(3 * c->nnfa * sizeof *d.stack + 1);
+    d.off = (size_t *)malloc((OPT_RE_MAXSTATE + 1) * sizeof *d.off);
+    d.hash = (unsigned *)calloc(d.nhash, sizeof *d.hash);
+    from = (unsigned *)malloc(c->nnfa * sizeof *from + 1);
+    opt_re_classes(c, re);
+    re->next = (unsigned short *)malloc(OPT_RE_MAXSTATE * re->ncls
+                                        * sizeof *re->next);
+    re->acc = (unsigned char *)calloc(OPT_RE_MAXSTATE, 1);
+    if (!d.mark || !d.stack || !d.off || !d.hash || !from || !re->next
+            || !re->acc) {
+        c->err = ENOMEM;
+        goto out;
+    }
+    for (i = 256; i--; ) {
+        rep[re->cls[i]] = i;
+    }
+    /* State 0 is the empty set, which rejects */
+    re->nstate = 0;
+    d.off[0] = 0;
+    opt_re_intern(&d, re, 0);
+    if (opt_re_closure(&d, &start, 1, 1) < 0) {
+        c->err = ENOMEM;
+        goto out;
+    }
+    re->start = d.start = opt_re_intern(&d, re, d.off[1]);
+    /* Each new state adds its row of transitions */
+    for (s = 0; !c->err && s < re->nstate; s++) {
+        for (cls = 0; cls < re->ncls; cls++) {
+            nfrom = 0;
+            for (j = d.off[s]; j < d.off[s + 1]; j++) {
+                t = d.list[j];
+                if (c->nfa[t].kind == OPT_RE_NSET
+                        && opt_re_has(c->node[c->nfa[t].set].set, rep[cls])) {
+                    from[nfrom++] = c->nfa[t].out;
+                }
+            }
+            base = d.nlist;
+            if ((len = opt_re_closure(&d, from, nfrom, 0)) < 0) {
+                c->err = ENOMEM;
+                break;
+            }
+            t = opt_re_intern(&d, re, base);
+            if (t == ~0u) {
+                break;
+            }
+            re->next[s * re->ncls + cls] = (unsigned short)t;
+        }
+        re->acc[s] = (unsigned char)opt_re_accepts(&d, s, s == re->start);
+    }
+    /* Shrink to fit */
+    if (!c->err) {
+        p = realloc(re->next, re->nstate * re->ncls * sizeof *re->next);
+        re->next = p ? (unsigned short *)p : re->next;
+    }
+out:
+    free(d.mark);
+    free(d.stack);
+    free(d.list);
+    free(d.off);
+    free(d.hash);
+    free(from);
+}
+
+
+OPT_EXTERN_C
+int opt_re_compile(struct optre *re, const char *pat, unsigned flags)
+{
+    unsigned tree, match, start, any, loop;
+    struct optrec c;
+    int glob = flags & OPT_PAT_GLOB;
+
+    memset(re, 0, sizeof *re);
+    memset(&c, 0, sizeof c);
+    c.flags = flags;
+    c.p = pat;
+    if (glob) {
+        tree = opt_re_glob(&c);
+    } else if ((tree = opt_re_alt(&c)) != ~0u && *c.p) {
+        /* A ) without its ( */
+        c.err = EINVAL;
+    }
+    /* A regex matches anywhere, so both ends of it match anything */
+    any = opt_re_node(&c, OPT_RE_SET);
+    if (any != ~0u) {
+        memset(c.node[any].set, 0xff, sizeof c.node[any].set);
+    }
+    match = opt_re_state(&c, OPT_RE_NMATCH, 0, 0, 0);
+    if (!glob) {
+        loop = opt_re_state(&c, OPT_RE_NSPLIT, 0, match, 0);
+        if (loop != ~0u) {
+            c.nfa[loop].out = opt_re_state(&c, OPT_RE_NSET, loop, 0, any);
+        }
+        match = loop;
+    }
+    start = opt_re_emit(&c, tree, match);
+    if (!glob) {
+        loop = opt_re_state(&c, OPT_RE_NSPLIT, 0, start, 0);
+        if (loop != ~0u) {
+            c.nfa[loop].out = opt_re_state(&c, OPT_RE_NSET, loop, 0, any);
+        }
+        start = loop;
+    }
+    if (!c.err) {
+        opt_re_dfa(&c, re, start);
+    }
+    free(c.node);
+    free(c.nfa);
+    if (c.err) {
+        opt_re_free(re);
+    }
+    return c.err;
+}
+
+
+OPT_EXTERN_C
+int opt_re_match(const struct optre *re, const char *str, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)str;
+    unsigned s = re->start;
+    size_t i;
+
+    if (!re->nstate) {
+        return 1;
+    }
+    for (i = 0; s && i < len; i++) {
+        s = re->next[s * re->ncls + re->cls[p[i]]];
+    }
+    return re->acc[s];
+}
+
+
+OPT_EXTERN_C
+void opt_re_free(struct optre *re)
+{
+    free(re->next);
+    free(re->acc);
+    re->next = NULL;
+    re->acc = NULL;
+    re->nstate = 0;
+}
+
+
+/** @brief Parse state of opt_re_parse, as the callbacks' data */
+struct optrectx {
+    const struct optretbl  *rt;
+    struct optinfo         *info;
+};
+
+
+static int opt_re_call(int idx, unsigned count, char *args[], void *data)
+{
+    const struct optrectx *ctx = (const struct optrectx *)data;
+    const struct optre *re = &ctx->rt->re[idx];
+    const struct optspec *opt = &ctx->rt->orig->opts[idx];
+    unsigned i;
+
+    for (i = 0; re->nstate && i < count; i++) {
+        if (!opt_re_match(re, args[i], strlen(args[i]))) {
+            /* Zero skips the option and goes on. Through opt_error, for
+             * its probes and profile as any other error */
+            return opt_error(ctx->info, OPT_ERR_VALUE, opt->shrt, args[i]);
+        }
+    }
+    return opt->func(idx, count, args, ctx->info->data);
+}
+
+
+static int opt_re_pos(int idx, unsigned count, char *args[], void *data)
+{
+    const struct optrectx *ctx = (const struct optrectx *)data;
+
+    return ctx->info->poscb(idx, count, args, ctx->info->data);
+}
+
+
+static int opt_re_err(int type, char shrt, char *lng, void *data)
+{
+    const struct optrectx *ctx = (const struct optrectx *)data;
+
+    return ctx->info->errcb(type, shrt, lng, ctx->info->data);
+}
+
+
+OPT_EXTERN_C
+int opt_re_tbl_init(struct optretbl     *rt,
+                    const struct opttbl *tbl,
+                    const struct optpat  pats[],
+                    unsigned            *bad)
+{
+    unsigned n = tbl->nopt, i;
+    int err = 0;
+
+    memset(rt, 0, sizeof *rt);
+    rt->orig = tbl;
+    rt->re = (struct optre *)calloc(n + 1, sizeof *rt->re);
+    rt->opts = (struct optspec *)malloc((n + 1) * sizeof *rt->opts);
+    rt->shrt = (const struct optspec **)malloc((n + 1) * sizeof *rt->shrt);
+    rt->lng = (const struct optspec **)malloc((n + 1) * sizeof *rt->lng);
+    if (!rt->re || !rt->opts || !rt->shrt || !rt->lng) {
+        opt_re_tbl_free(rt);
+        *bad = 0;
+        return ENOMEM;
+    }
+    for (i = 0; i < n; i++) {
+        if (pats[i].pat && (err = opt_re_compile(&rt->re[i], pats[i].pat,
+                                                 pats[i].flags))) {
+            opt_re_tbl_free(rt);
+            *bad = i;
+            return err;
+        }
+        rt->opts[i] = tbl->opts[i];
+        rt->opts[i].func = opt_re_call;
+    }
+    /* Same order as the original index, no sort needed */
+    for (i = 0; i < tbl->nshrt; i++) {
+        rt->shrt[i] = rt->opts + (tbl->shrt[i] - tbl->opts);
+    }
+    for (i = 0; i < tbl->nlng; i++) {
+        rt->lng[i] = rt->opts + (tbl->lng[i] - tbl->opts);
+    }
+    rt->tbl = *tbl;
+    rt->tbl.opts = rt->opts;
+    rt->tbl.shrt = rt->shrt;
+    rt->tbl.lng = rt->lng;
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_re_parse(struct optinfo *info, const struct optretbl *rt)
+{
+    struct optinfo sub = *info;
+    struct optrectx ctx;
+    int res;
+
+    ctx.rt = rt;
+    ctx.info = info;
+    sub.errcb = opt_re_err;
+    sub.poscb = opt_re_pos;
+    sub.data = &ctx;
+    res = opt_parse_tbl(&sub, &rt->tbl);
+    info->argc = sub.argc;
+    info->argv = sub.argv;
+    return res;
+}
+
+
+OPT_EXTERN_C
+void opt_re_tbl_free(struct optretbl *rt)
+{
+    unsigned i;
+
+    for (i = 0; rt->re && i < rt->orig->nopt; i++) {
+        opt_re_free(&rt->re[i]);
+    }
+    free(rt->re);
+    free(rt->opts);
+    free(rt->shrt);
+    free(rt->lng);
+    rt->re = NULL;
+    rt->opts = NULL;
+    rt->shrt = NULL;
+    rt->lng = NULL;
+}
+
+#endif /* OPT_IMPLEMENTATION */
@@ -0,0 +1,151 @@
+#pragma once
+/** @file opt_reg.h options registered where they are defined.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  A program built from many libraries either keeps one option table that
+ *  lists every library's options, or registers them from static
+ *  constructors, which run before main, in no reliable order. OPT_REGISTER
+ *  instead puts an option into the "optreg" ELF section of the object file
+ *  that defines it:
+ *
+ *  OPT_REGISTER(opt_cache_size, 0, "cache-size", 1, cache_size_callback);
+ *
+ *  The linker gathers the sections of all modules into one array of struct
+ *  optspec between __start_optreg and __stop_optreg. Nothing runs at start
+ *  up: opt_reg_tbl_init indexes the array when the program asks, into
+ *  buffers of the caller's, and finds any name registered twice:
+ *
+ *  const struct optspec *shrt[256], *lng[256];
+ *  struct opttbl tbl;
+ *
+ *  if (opt_reg_count() > 256 || opt_reg_tbl_init(&tbl, shrt, lng)) {
+ *      ... a duplicate, see opt_reg_tbl_init ...
+ *  }
+ *  res = opt_parse_tbl(&info, &tbl);
+ *
+ *  The order of the array, and so the idx given to callbacks, is not stable:
+ *  it depends on the link order, and within an object file on how the
+ *  compiler lays out its variables, which GCC changes at -O2. Give each
+ *  registered option its own callback rather than telling them apart by idx.
+ *
+ *  The linker keeps the section when linking with --gc-sections, since
+ *  __start_optreg refers to it. An object file in a static library is only
+ *  linked if something else in it is used, so either keep options next to
+ *  code that is, or link the library with --whole-archive. Each shared
+ *  library and the executable have their own sections, and see only their
+ *  own options.
+ *
+ *  This needs ELF and GCC or Clang. It does not use any heap memory nor
+ *  issue any stdio calls.
+ */
+#ifndef OPT_REG_H
+#define OPT_REG_H
+
+#include "opt.h"
+
+#include <stddef.h>
+
+#if !defined(__ELF__) || !(defined(__GNUC__) || defined(__clang__))
+#   error "opt_reg.h needs ELF sections and GCC or Clang"
+#endif
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+#if defined(__has_attribute)
+#   if __has_attribute(retain)
+#       define OPT_REG_RETAIN , retain
+#   endif
+#endif
+#ifndef OPT_REG_RETAIN
+#   define OPT_REG_RETAIN
+#endif
+
+/** @brief Register an option, as the static struct optspec @p name. Use it
+ *      at file scope. Entries are aligned as in an array, so that the linker
+ *      packs them into one
+ */
+#define OPT_REGISTER(name, shrt, lng, args, func)                             \
+    static const struct optspec name                                          \
+    __attribute__((used, section("optreg"),                                   \
+                   aligned(__alignof__(struct optspec)) OPT_REG_RETAIN)) =    \
+        { shrt, lng, args, func }
+
+
+/** @brief Registered options
+ *  @returns The number of options registered in the executable or shared
+ *      library that calls it
+ */
+unsigned opt_reg_count(void);
+
+
+/** @brief Index the registered options, as opt_tbl_init does
+ *  @param tbl
+ *      Set to the table of all registered options
+ *  @param shrt
+ *      Buffer of at least opt_reg_count() pointers for the sorted short
+ *      options
+ *  @param lng
+ *      Buffer of at least opt_reg_count() pointers for the sorted long
+ *      options
+ *  @returns Zero, or like opt_tbl_check, -(i + 1) if tbl->shrt[i] and
+ *      tbl->shrt[i - 1] have the same short name, and i + 1 if tbl->lng[i]
+ *      and tbl->lng[i - 1] have the same long name. The table is usable
+ *      either way, but which of the two options a name finds is undefined
+ */
+int opt_reg_tbl_init(struct opttbl        *tbl,
+                     const struct optspec *shrt[],
+                     const struct optspec *lng[]);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_REG_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+/* Bounds of the section, set by the linker. They are weak so that a program
+ * with no options registered still links, and hidden so that every shared
+ * library finds its own */
+extern const struct optspec __start_optreg[]
+    __attribute__((weak, visibility("hidden")));
+extern const struct optspec __stop_optreg[]
+    __attribute__((weak, visibility("hidden")));
+
+
+OPT_EXTERN_C
+unsigned opt_reg_count(void)
+{
+    return __start_optreg ? (unsigned)(__stop_optreg - __start_optreg) : 0;
+}
+
+
+OPT_EXTERN_C
+int opt_reg_tbl_init(struct opttbl        *tbl,
+                     const struct optspec *shrt[],
+                     const struct optspec *lng[])
+{
+    unsigned i;
+
+    opt_tbl_init(tbl, opt_reg_count(), __start_optreg, shrt, lng);
+    /* Sorted, so duplicates are next to each other */
+    for (i = 1; i < tbl->nshrt; i++) {
+        if (!optspec_shrtcmp(&tbl->shrt[i - 1], &tbl->shrt[i])) {
+            return -(int)(i + 1);
+        }
+    }
+    for (i = 1; i < tbl->nlng; i++) {
+        if (!optspec_lngcmp(&tbl->lng[i - 1], &tbl->lng[i])) {
+            return (int)(i + 1);
+        }
+    }
+    return 0;
+}
+
+#endif /* OPT_IMPLEMENTATION */
@@ -0,0 +1,707 @@
+#pragma once
+/** @file opt_rsp.h response files, with a persistent parse cache.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  A response file holds a command line too long for the real one, written
+ *  the way gcc(1) reads @file: arguments are separated by whitespace, may be
+ *  quoted with ' or ", and \ includes any character literally. A tool called
+ *  as "tool @args.rsp" can parse it in place of argv:
+ *
+ *  struct optrsp rsp = { ".cache/tool", 0, 0 };
+ *
+ *  if (argc == 2 && argv[1][0] == '@') {
+ *      res = opt_rsp_parse(&info, &tbl, argv[1] + 1, &rsp);
+ *  }
+ *  ...
+ *  opt_rsp_free(&rsp);
+ *
+ *  The callbacks see exactly what opt_parse_tbl would have given them for the
+ *  same arguments, and the strings stay valid until opt_rsp_free.
+ *
+ *  Tools rerun against the same large response file re-read and re-tokenize
+ *  it every time. With a cache directory, the first successful parse also
+ *  records what it called back, in order, with the arguments of each call,
+ *  into a binary cache file keyed by:
+ *
+ *  - the fingerprint of the option table (opt_rsp_fingerprint) and endact
+ *  - the response file's device, inode, size, mtime and ctime
+ *
+ *  A later parse with the same key maps the cache file and replays the calls
+ *  from it. The response file itself is not read at all, only stat(2)ed. If
+ *  files can change without their mtime or ctime changing, set
+ *  OPT_RSP_VERIFY. The cache then also checks the content hash it recorded,
+ *  which reads the file but still skips tokenizing it.
+ *
+ *  A cache file is validated before anything is replayed from it: its header
+ *  must match, and its events and strings must lie exactly within it. Cache
+ *  files are written to a temporary name and renamed into place, so
+ *  concurrent runs share a directory safely. Parses that a callback stopped
+ *  are never cached, since the calls after it were never seen. What the
+ *  callbacks do with their arguments, e.g. decoding numbers, is theirs
+ *  and is done again on replay.
+ *
+ *  This is POSIX-only and uses the heap. With a strict -std, define
+ *  _GNU_SOURCE (or _DEFAULT_SOURCE) before the first include for st_mtim and
+ *  mkstemp(3).
+ */
+#ifndef OPT_RSP_H
+#define OPT_RSP_H
+
+#include "opt.h"
+#include "opt_token.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+#define OPT_RSP_VERIFY  0x1 /* Check the content hash on cache hits */
+
+
+/** @brief Response file parse. Zero it apart from the parameters */
+struct optrsp {
+    const char *cache;  /* Cache directory (NULL: no cache) */
+    unsigned    flags;  /* OPT_RSP_* */
+    int         hit;    /* Set if the parse was replayed from the cache */
+
+    /* Private: what the argument strings live in */
+    void       *map;    /* Cache file mapping */
+    size_t      maplen;
+    char       *buf;    /* Response file contents */
+    char      **argv;   /* Arguments */
+};
+
+
+/** @brief Hash @p len bytes of @p buf
+ *  @param buf
+ *      Data
+ *  @param len
+ *      Its length
+ *  @param seed
+ *      Seed, or a previous hash to chain from
+ *  @returns A 64-bit hash
+ */
+unsigned long long opt_rsp_hash(const void *buf, size_t len,
+                                unsigned long long seed);
+
+
+/** @brief Fingerprint an option table: its names and argument counts, in
+ *      order, but not its callbacks
+ *  @param nopt
+ *      Length of @p opts
+ *  @param opts
+ *      Option specification table
+ *  @returns A 64-bit fingerprint
+ */
+unsigned long long opt_rsp_fingerprint(unsigned             nopt,
+                                       const struct optspec opts[]);
+
+
+/** @brief Parse the arguments in response file @p path as opt_parse_tbl
+ *      would parse them on the command line. info->argc, info->argv and
+ *      info->fstact are not used
+ *  @param info
+ *      Option context structure
+ *  @param tbl
+ *      Sorted option table
+ *  @param path
+ *      The response file
+ *  @param rsp
+ *      Cache parameters, and where the arguments are kept
+ *  @returns See opt_parse, or -1 with errno set if @p path cannot be read
+ */
+int opt_rsp_parse(struct optinfo      *info,
+                  const struct opttbl *tbl,
+                  const char          *path,
+                  struct optrsp       *rsp);
+
+
+/** @brief Free the arguments of a parse
+ *  @param rsp
+ *      The parse
+ */
+void opt_rsp_free(struct optrsp *rsp);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_RSP_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define OPT_RSP_MAGIC   0x4f505243u     /* "OPRC" */
+#define OPT_RSP_VERSION 1u
+
+/* Event indices other than options */
+#define OPT_RSP_POS     (-1)    /* Positional callback */
+#define OPT_RSP_ESHRT   (-2)    /* Unknown short option, in count */
+#define OPT_RSP_ELNG    (-3)    /* Unknown long option, in one string */
+
+
+/** @brief Cache file header, followed by the events and then the strings */
+struct optrsphdr {
+    unsigned           magic;
+    unsigned           version;
+    unsigned long long fprint;  /* Table and endact */
+    unsigned long long dev;     /* Response file */
+    unsigned long long ino;
+    unsigned long long size;
+    unsigned long long mtime;   /* ns */
+    unsigned long long ctime;   /* ns */
+    unsigned long long hash;    /* Of its contents */
+    unsigned long long nev;     /* Events */
+    unsigned long long nstr;    /* Strings */
+    unsigned long long strlen;  /* Bytes of strings */
+};
+
+
+/** @brief One recorded call */
+struct optrspev {
+    int      idx;       /* Option index, or OPT_RSP_POS... */
+    unsigned count;     /* Its argument count, which are the next strings */
+};
+
+
+/** @brief Calls recorded while parsing */
+struct optrsprec {
+    const struct optspec *opts; /* The real callbacks */
+    optcbfn_t            *poscb;
+    opterrfn_t           *errcb;
+    void                 *data;
+    struct optrspev      *ev;
+    size_t                nev;
+    size_t                evcap;
+    char                 *str;
+    size_t                strlen;
+    size_t                strcap;
+    unsigned long long    nstr;
+    int                   nomem;
+};
+
+
+/** @brief Finalize a hash */
+static unsigned long long opt_rsp_mix(unsigned long long h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+
+OPT_EXTERN_C
+unsigned long long opt_rsp_hash(const void *buf, size_t len,
+                                unsigned long long seed)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    unsigned long long h = seed ^ (len * 0x9e3779b97f4a7c15ull), w;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&w, p + i, 8);
+        h = ((h << 31 | h >> 33) ^ (w * 0x87c37b91114253d5ull))
+          * 0x4cf5ad432745937full;
+    }
+    for (w = 0; i < len; i++) {
+        w = w << 8 | p[i];
+    }
+    return opt_rsp_mix(h ^ w);
+}
+
+
+OPT_EXTERN_C
+unsigned long long opt_rsp_fingerprint(unsigned             nopt,
+                                       const struct optspec opts[])
+{
+    unsigned long long h = OPT_RSP_VERSION;
+    unsigned char head[5];
+    unsigned i;
+
+    for (i = 0; i < nopt; i++) {
+        head[0] = (unsigned char)opts[i].shrt;
+        head[1] = (unsigned char)((unsigned)opts[i].args >> 24);
+        head[2] = (unsigned char)((unsigned)opts[i].args >> 16);
+        head[3] = (unsigned char)((unsigned)opts[i].args >> 8);
+        head[4] = (unsigned char)opts[i].args;
+        h = opt_rsp_hash(head, sizeof head, h);
+        /* A null name is not the empty name */
+        h = opts[i].lng ? opt_rsp_hash(opts[i].lng, strlen(opts[i].lng) + 1, h)
+                        : opt_rsp_hash("\377", 1, h);
+    }
+    return h;
+}
+
+
+/** @brief Modification and change times in ns */
+static void opt_rsp_times(const struct stat  *st,
+                          unsigned long long *mtime,
+                          unsigned long long *ctime)
+{
+#if defined(__APPLE__)
+    *mtime = (unsigned long long)st->st_mtimespec.tv_sec * 1000000000ull
+           + (unsigned long long)st->st_mtimespec.tv_nsec;
+    *ctime = (unsigned long long)st->st_ctimespec.tv_sec * 1000000000ull
+           + (unsigned long long)st->st_ctimespec.tv_nsec;
+#else
+    *mtime = (unsigned long long)st->st_mtim.tv_sec * 1000000000ull
+           + (unsigned long long)st->st_mtim.tv_nsec;
+    *ctime = (unsigned long long)st->st_ctim.tv_sec * 1000000000ull
+           + (unsigned long long)st->st_ctim.tv_nsec;
+#endif
+}
+
+
+/** @brief Fill in the key fields of @p hdr */
+static void opt_rsp_key(struct optrsphdr *hdr, const struct stat *st,
+                        unsigned long long fprint)
+{
+    memset(hdr, 0, sizeof *hdr);
+    hdr->magic = OPT_RSP_MAGIC;
+    hdr->version = OPT_RSP_VERSION;
+    hdr->fprint = fprint;
+    hdr->dev = (unsigned long long)st->st_dev;
+    hdr->ino = (unsigned long long)st->st_ino;
+    hdr->size = (unsigned long long)st->st_size;
+    opt_rsp_times(st, &hdr->mtime, &hdr->ctime);
+}
+
+
+/** @brief Read all of @p fd into a new buffer, with a spare byte at the end */
+static char *opt_rsp_read(int fd, size_t size)
+{
+    size_t got = 0;
+    ssize_t n;
+    char *buf;
+
+    if (!(buf = (char *)malloc(size + 1))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    while (got < size) {
+        n = read(fd, buf + got, size - got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            free(buf);
+            errno = n ? errno : EIO;
+            return NULL;
+        }
+        got += (size_t)n;
+    }
+    return buf;
+}
+
+
+/** @brief Split [@p p, @p end) into arguments in place, as gcc reads @file
+ *  @returns The arguments, NULL-terminated, or NULL with errno set
+ */
+static char **opt_rsp_split(char *p, char *end, int *argc)
+{
+    struct opttokspan span[256];
+    struct opttok tok;
+    char **argv = NULL, **tmp, *w;
+    size_t n = 0, cap = 0, got, i;
+
+    memset(&tok, 0, sizeof tok);
+    do {
+        got = opt_tok_spans(&tok, p, (size_t)(end - p), span, 256);
+        while (n + got >= cap) {
+            cap = cap ? cap * 2 : 256;
+            if (!(tmp = (char **)realloc(argv, cap * sizeof *argv))) {
+                free(argv);
+                errno = ENOMEM;
+                return NULL;
+            }
+            argv = tmp;
+        }
+        /* The words never outgrow their input, and lie before what is still
+         * to be read. The buffer has a spare byte for the last one */
+        for (i = 0; i < got; i++) {
+            argv[n++] = w = p + span[i].off;
+            w[span[i].flags & OPT_TOK_PLAIN ? span[i].len
+              : opt_tok_unquote(w, w, span[i].len)] = '\0';
+        }
+    } while (got);
+    argv[n] = NULL;
+    *argc = (int)n;
+    return argv;
+}
+
+
+/** @brief Record a call with @p count strings from @p args */
+static void opt_rsp_log(struct optrsprec *rec, int idx, unsigned count,
+                        char *args[])
+{
+    struct optrspev *ev;
+    size_t len, i;
+    char *str;
+
+    if (rec->nomem) {
+        return;
+    }
+    if (rec->nev == rec->evcap) {
+        rec->evcap = rec->evcap ? rec->evcap * 2 : 256;
+        if (!(ev = (struct optrspev *)realloc(rec->ev, rec->evcap
+                                              * sizeof *ev))) {
+            rec->nomem = 1;
+            return;
+        }
+        rec->ev = ev;
+    }
+    rec->ev[rec->nev].idx = idx;
+    rec->ev[rec->nev++].count = count;
+    if (idx == OPT_RSP_ESHRT) {
+        return;
+    }
+    for (i = 0; i < (idx == OPT_RSP_ELNG ? 1 : count); i++) {
+        len = strlen(args[i]) + 1;
+        if (rec->strlen + len > rec->strcap) {
+            rec->strcap = (rec->strlen + len) * 2;
+            if (!(str = (char *)realloc(rec->str, rec->strcap))) {
+                rec->nomem = 1;
+                return;
+            }
+            rec->str = str;
+        }
+        memcpy(rec->str + rec->strlen, args[i], len);
+        rec->strlen += len;
+        rec->nstr++;
+    }
+}
+
+
+static int opt_rsp_rec(int idx, unsigned count, char *args[], void *data)
+{
+    struct optrsprec *rec = (struct optrsprec *)data;
+
+    opt_rsp_log(rec, idx, count, args);
+    return rec->opts[idx].func(idx, count, args, rec->data);
+}
+
+
+static int opt_rsp_recpos(int idx, unsigned count, char *args[], void *data)
+{
+    struct optrsprec *rec = (struct optrsprec *)data;
+
+    opt_rsp_log(rec, OPT_RSP_POS, count, args);
+    return rec->poscb(idx, count, args, rec->data);
+}
+
+
+static int opt_rsp_recerr(int type, char shrt, char *lng, void *data)
+{
+    struct optrsprec *rec = (struct optrsprec *)data;
+
+    opt_rsp_log(rec, type ? OPT_RSP_ELNG : OPT_RSP_ESHRT,
+                type ? 1 : (unsigned char)shrt, &lng);
+    return rec->errcb(type, shrt, lng, rec->data);
+}
+
+
+/** @brief Write the cache file for @p rec, ignoring failure */
+static void opt_rsp_store(const char             *path,
+                          const struct optrsphdr *key,
+                          const struct optrsprec *rec)
+{
+    struct optrsphdr hdr = *key;
+    char *tmp;
+    FILE *fp;
+    int fd;
+
+    if (rec->nomem || !(tmp = (char *)malloc(strlen(path) + 8))) {
+        return;
+    }
+    sprintf(tmp, "%s.XXXXXX", path);
+    if ((fd = mkstemp(tmp)) < 0) {
+        free(tmp);
+        return;
+    }
+    hdr.nev = rec->nev;
+    hdr.nstr = rec->nstr;
+    hdr.strlen = rec->strlen;
+    if ((fp = fdopen(fd, "wb"))) {
+        fwrite(&hdr, sizeof hdr, 1, fp);
+        fwrite(rec->ev, sizeof *rec->ev, rec->nev, fp);
+        fwrite(rec->str, 1, rec->strlen, fp);
+        /* Not &&: the stream must be closed either way */
+        if (!ferror(fp) & !fclose(fp) && !rename(tmp, path)) {
+            free(tmp);
+            return;
+        }
+    } else {
+        close(fd);
+    }
+    unlink(tmp);
+    free(tmp);
+}
+
+
+/** @brief Map the cache file @p path if it matches @p key, and index its
+ *      strings in rsp->argv
+ *  @returns The events, or NULL on a miss
+ */
+static const struct optrspev *opt_rsp_load(const char             *path,
+                                           const struct optrsphdr *key,
+                                           const struct opttbl    *tbl,
+                                           struct optrsp          *rsp)
+{
+    const struct optrsphdr *hdr;
+    const struct optrspev *ev;
+    unsigned long long i, k = 0;
+    struct stat st;
+    char *p, *end, *nul;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof *hdr) {
+        close(fd);
+        return NULL;
+    }
+    rsp->maplen = (size_t)st.st_size;
+    rsp->map = mmap(NULL, rsp->maplen, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, 0);
+    close(fd);
+    if (rsp->map == MAP_FAILED) {
+        rsp->map = NULL;
+        return NULL;
+    }
+    madvise(rsp->map, rsp->maplen, MADV_SEQUENTIAL | MADV_WILLNEED);
+    hdr = (const struct optrsphdr *)rsp->map;
+    ev = (const struct optrspev *)(hdr + 1);
+    /* The key, then the layout */
+    if (memcmp(hdr, key, offsetof(struct optrsphdr, hash))
+     || (rsp->flags & OPT_RSP_VERIFY && hdr->hash != key->hash)
+     || hdr->nev > (rsp->maplen - sizeof *hdr) / sizeof *ev
+     || hdr->strlen != rsp->maplen - sizeof *hdr - hdr->nev * sizeof *ev
+     || hdr->nstr > hdr->strlen
+     || !(rsp->argv = (char **)malloc((size_t)(hdr->nstr + 1)
+                                      * sizeof *rsp->argv))) {
+        goto miss;
+    }
+    /* Every event's strings, exactly */
+    for (i = 0; i < hdr->nev; i++) {
+        if (ev[i].idx >= (int)tbl->nopt || ev[i].idx < OPT_RSP_ELNG) {
+            goto miss;
+        }
+        k += ev[i].idx == OPT_RSP_ESHRT ? 0
+           : ev[i].idx == OPT_RSP_ELNG ? 1 : ev[i].count;
+    }
+    p = (char *)(ev + hdr->nev);
+    end = p + hdr->strlen;
+    for (i = 0; i < hdr->nstr; i++) {
+        if (!(nul = (char *)memchr(p, '\0', (size_t)(end - p)))) {
+            goto miss;
+        }
+        rsp->argv[i] = p;
+        p = nul + 1;
+    }
+    if (k != hdr->nstr || p != end) {
+        goto miss;
+    }
+    rsp->argv[hdr->nstr] = NULL;
+    return ev;
+miss:
+    free(rsp->argv);
+    rsp->argv = NULL;
+    munmap(rsp->map, rsp->maplen);
+    rsp->map = NULL;
+    return NULL;
+}
+
+
+/** @brief Replay @p nev recorded events */
+static int opt_rsp_replay(struct optinfo        *info,
+                          const struct opttbl   *tbl,
+                          const struct optrspev *ev,
+                          unsigned long long     nev,
+                          char                  *argv[])
+{
+    unsigned long long i;
+    int res = 0;
+
+    for (i = 0; !res && i < nev; i++) {
+        switch (ev[i].idx) {
+        case OPT_RSP_POS:
+            res = opt_invoke(info, info->poscb, -1, ev[i].count, argv);
+            break;
+        case OPT_RSP_ESHRT:
+            res = opt_error(info, 0, (char)ev[i].count, NULL);
+            break;
+        case OPT_RSP_ELNG:
+            res = opt_error(info, 1, '\0', *argv++);
+            break;
+        default:
+            res = opt_invoke(info, tbl->opts[ev[i].idx].func, ev[i].idx,
+                             ev[i].count, argv);
+            break;
+        }
+        argv += ev[i].idx >= OPT_RSP_POS ? ev[i].count : 0;
+    }
+    return res;
+}
+
+
+/** @brief Parse the split arguments, recording the calls into @p rec */
+static int opt_rsp_record(struct optinfo      *info,
+                          const struct opttbl *tbl,
+                          struct optrsprec    *rec,
+                          int                  argc,
+                          char                *argv[])
+{
+    const struct optspec **shrt, **lng;
+    struct optinfo sub = *info;
+    struct optspec *opts;
+    struct opttbl ptbl;
+    unsigned i;
+    int res;
+
+    opts = (struct optspec *)malloc((tbl->nopt + 1) * sizeof *opts);
+    shrt = (const struct optspec **)malloc((tbl->nopt + 1) * sizeof *shrt);
+    lng = (const struct optspec **)malloc((tbl->nopt + 1) * sizeof *lng);
+    if (!opts || !shrt || !lng) {
+        free(opts);
+        free(shrt);
+        free(lng);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < tbl->nopt; i++) {
+        opts[i] = tbl->opts[i];
+        opts[i].func = opt_rsp_rec;
+    }
+    opt_tbl_init(&ptbl, tbl->nopt, opts, shrt, lng);
+    rec->opts = tbl->opts;
+    rec->poscb = info->poscb;
+    rec->errcb = info->errcb;
+    rec->data = info->data;
+    sub.argc = argc;
+    sub.argv = argv;
+    sub.fstact = OPT_FIRST_PARSE;
+    sub.errcb = opt_rsp_recerr;
+    sub.poscb = opt_rsp_recpos;
+    sub.data = rec;
+    res = opt_parse_tbl(&sub, &ptbl);
+    free(opts);
+    free(shrt);
+    free(lng);
+    return res;
+}
+
+
+OPT_EXTERN_C
+int opt_rsp_parse(struct optinfo      *info,
+                  const struct opttbl *tbl,
+                  const char          *path,
+                  struct optrsp       *rsp)
+{
+    const struct optrspev *ev;
+    struct optrsprec rec;
+    struct optrsphdr key;
+    struct optinfo sub;
+    struct stat st;
+    char *cpath = NULL;
+    int fd, argc, res;
+
+    rsp->hit = 0;
+    rsp->map = NULL;
+    rsp->buf = NULL;
+    rsp->argv = NULL;
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st)) {
+        close(fd);
+        return -1;
+    }
+    if (rsp->cache) {
+        opt_rsp_key(&key, &st, opt_rsp_hash(&info->endact,
+                                            sizeof info->endact,
+                                            opt_rsp_fingerprint(tbl->nopt,
+                                                                tbl->opts)));
+        if (!(cpath = (char *)malloc(strlen(rsp->cache) + 80))) {
+            close(fd);
+            errno = ENOMEM;
+            return -1;
+        }
+        sprintf(cpath, "%s/opt-%016llx-%llx-%llx.cache", rsp->cache,
+                key.fprint, key.dev, key.ino);
+    }
+    /* Only a verified hit needs the contents */
+    if (!cpath || rsp->flags & OPT_RSP_VERIFY
+     || !(ev = opt_rsp_load(cpath, &key, tbl, rsp))) {
+        if (!(rsp->buf = opt_rsp_read(fd, (size_t)st.st_size))) {
+            close(fd);
+            free(cpath);
+            return -1;
+        }
+        key.hash = cpath ? opt_rsp_hash(rsp->buf, (size_t)st.st_size, 0) : 0;
+        ev = cpath && rsp->flags & OPT_RSP_VERIFY
+           ? opt_rsp_load(cpath, &key, tbl, rsp) : NULL;
+    }
+    close(fd);
+    if (ev) {
+        rsp->hit = 1;
+        free(rsp->buf);
+        rsp->buf = NULL;
+        free(cpath);
+        return opt_rsp_replay(info, tbl, ev,
+                              ((const struct optrsphdr *)rsp->map)->nev,
+                              rsp->argv);
+    }
+    if (!(rsp->argv = opt_rsp_split(rsp->buf, rsp->buf + st.st_size, &argc))) {
+        free(cpath);
+        return -1;
+    }
+    if (!cpath) {
+        sub = *info;
+        sub.argc = argc;
+        sub.argv = rsp->argv;
+        sub.fstact = OPT_FIRST_PARSE;
+        return opt_parse_tbl(&sub, tbl);
+    }
+    memset(&rec, 0, sizeof rec);
+    res = opt_rsp_record(info, tbl, &rec, argc, rsp->argv);
+    if (!res) {
+        opt_rsp_store(cpath, &key, &rec);
+    }
+    free(rec.ev);
+    free(rec.str);
+    free(cpath);
+    return res;
+}
+
+
+OPT_EXTERN_C
+void opt_rsp_free(struct optrsp *rsp)
+{
+    if (rsp->map) {
+        munmap(rsp->map, rsp->maplen);
+    }
+    free(rsp->buf);
+    free(rsp->argv);
+    rsp->map = NULL;
+    rsp->buf = NULL;
+    rsp->argv = NULL;
+}
+
+#endif /* OPT_IMPLEMENTATION */
@@ -0,0 +1,607 @@
+#pragma once
+/** @file opt_scan.h classify running processes against option tables.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  opt_scan reads /proc/PID/cmdline for every process on the host. It
+ *  matches each argv[0] basename against a registry of option tables and
+ *  parses the matches with opt.h exactly as the tools themselves would. The
+ *  registered tables' callbacks are never called: opt_scan parses against a
+ *  private copy of each table whose callbacks only record what was seen.
+ *
+ *  The PIDs are listed once and then read and parsed by a pool of threads.
+ *  Each thread claims PIDs in chunks and reuses its own cmdline, argv and hit
+ *  buffers, so after the first few processes a scan does no allocation and
+ *  no locking apart from the chunk claims. For example:
+ *
+ *  static unsigned long make_hist[NOPT + 2];
+ *  static struct optscanent ents[] = {
+ *      { "make", NOPT, make_opts, make_hist },
+ *      ...
+ *  };
+ *  struct optscan scan = { sizeof ents / sizeof *ents, ents };
+ *
+ *  opt_scan(&scan);
+ *
+ *  after which make_hist[i] counts the uses of make_opts[i] over every
+ *  running make, make_hist[NOPT] counts its unrecognized options and
+ *  make_hist[NOPT + 1] the running makes themselves. Set
+ *  "func" for one call per matching process instead, or as well.
+ *
+ *  This is Linux-only, uses the heap, and needs -pthread. With a strict -std,
+ *  define _POSIX_C_SOURCE to 200809L (or _GNU_SOURCE) before the first
+ *  include for openat(2), fdopendir(3) and O_DIRECTORY.
+ */
+#ifndef OPT_SCAN_H
+#define OPT_SCAN_H
+
+#include "opt.h"
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+/** @brief One option seen in a process's command line */
+struct optscanhit {
+    int       idx;      /* Option index, or -1 if unrecognized */
+    unsigned  count;    /* Argument count */
+    char    **args;     /* Arguments */
+    char      shrt;     /* The unrecognized short option, or nul */
+    char     *lng;      /* The unrecognized long option, or NULL */
+};
+
+
+/** @brief A process that matched a registered table */
+struct optscanproc {
+    long                     pid;   /* Process ID */
+    unsigned                 ent;   /* Index of the matching registry entry */
+    int                      argc;  /* Cmdarg count */
+    char                   **argv;  /* Cmdargs */
+    unsigned                 nhit;  /* Options seen */
+    const struct optscanhit *hits;  /* Options seen, in order */
+    unsigned                 npos;  /* Positional argument count */
+    char                   **pos;   /* Positional arguments */
+};
+
+
+/** @brief Per-process callback. This is called concurrently from every scan
+ *      thread, and everything @p proc points to is reused once it returns
+ *  @param proc
+ *      The process
+ *  @param data
+ *      User data given in struct optscan
+ */
+typedef void optscanfn_t(const struct optscanproc *proc, void *data);
+
+
+/** @brief A registered tool */
+struct optscanent {
+    const char           *name;     /* argv[0] basename to match */
+    unsigned              nopt;     /* Length of opts */
+    const struct optspec *opts;     /* The tool's option table */
+    unsigned long        *hist;     /* NULL, or nopt + 2 counters (above) */
+};
+
+
+/** @brief Scan parameters and totals */
+struct optscan {
+    unsigned           nent;    /* Registry length */
+    struct optscanent *ents;    /* Registry */
+    unsigned           nthread; /* Scan threads (0: one per online CPU) */
+    optscanfn_t       *func;    /* Per-process callback, or NULL */
+    void              *data;    /* Callback data */
+
+    unsigned long      nproc;   /* Processes read, set by opt_scan */
+    unsigned long      nmatch;  /* Processes that matched an entry */
+};
+
+
+/** @brief Scan every process on the host. Histograms and counts are added
+ *      to, so repeated scans accumulate
+ *  @param scan
+ *      Scan parameters
+ *  @returns Zero on success, -1 with errno set if /proc could not be listed
+ *      or memory or threads ran out
+ */
+int opt_scan(struct optscan *scan);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_SCAN_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define OPT_SCAN_CHUNK      32  /* PIDs claimed at once */
+#define OPT_SCAN_MAXTHREAD  64
+
+
+/** @brief Registry entry with its private table */
+struct optscantbl {
+    struct opttbl         tbl;  /* Sorted copy with recording callbacks */
+    struct optspec       *opts; /* The copy */
+    const struct optspec **idx; /* Sort buffers, 2 * nopt */
+    unsigned              hist; /* Offset of its counters in a thread */
+};
+
+
+/** @brief State shared by the scan threads */
+struct optscanctx {
+    struct optscan     *scan;
+    struct optscantbl  *tbls;
+    unsigned           *byname; /* Entries sorted by name */
+    unsigned            nhist;  /* Counters per thread */
+    int                 procfd;
+    long               *pids;
+    size_t              npid;
+    size_t              next;   /* Next unclaimed PID */
+    pthread_mutex_t     lock;
+};
+
+
+/** @brief One scan thread */
+struct optscanthr {
+    struct optscanctx *ctx;
+    pthread_t          thread;
+    unsigned long     *hist;    /* Counters of every entry */
+    unsigned long      nproc;
+    unsigned long      nmatch;
+    char              *buf;     /* Cmdline */
+    size_t             bufcap;
+    char             **argv;
+    size_t             argvcap;
+    struct optscanhit *hits;
+    unsigned           nhit;
+    unsigned           hitcap;
+    unsigned           npos;
+    char             **pos;
+    int                nomem;
+};
+
+
+/* The parse of the current process of a thread. Option callbacks only get
+ * the user data pointer, which is set to this */
+struct optscanrun {
+    struct optscanthr *thr;
+    unsigned long     *hist;    /* Counters of the matching entry */
+    unsigned           nopt;
+};
+
+
+/** @brief Append a hit, growing the thread's buffer */
+static int opt_scan_hit(struct optscanrun *run, const struct optscanhit *hit)
+{
+    struct optscanthr *thr = run->thr;
+    struct optscanhit *tmp;
+
+    if (thr->nhit == thr->hitcap) {
+        tmp = (struct optscanhit *)realloc(thr->hits, (thr->hitcap * 2 + 16)
+                                           * sizeof *thr->hits);
+        if (!tmp) {
+            thr->nomem = 1;
+            return 1;
+        }
+        thr->hits = tmp;
+        thr->hitcap = thr->hitcap * 2 + 16;
+    }
+    thr->hits[thr->nhit++] = *hit;
+    return 0;
+}
+
+
+/** @brief Recording option callback */
+static int opt_scan_opt(int idx, unsigned count, char *args[], void *data)
+{
+    struct optscanrun *run = (struct optscanrun *)data;
+    struct optscanhit hit;
+
+    hit.idx = idx;
+    hit.count = count;
+    hit.args = args;
+    hit.shrt = '\0';
+    hit.lng = NULL;
+    run->hist[idx]++;
+    return opt_scan_hit(run, &hit);
+}
+
+
+/** @brief Recording error callback */
+static int opt_scan_err(int type, char shrt, char *lng, void *data)
+{
+    struct optscanrun *run = (struct optscanrun *)data;
+    struct optscanhit hit;
+
+    (void)type;
+    hit.idx = -1;
+    hit.count = 0;
+    hit.args = NULL;
+    hit.shrt = shrt;
+    hit.lng = lng;
+    run->hist[run->nopt]++;
+    return opt_scan_hit(run, &hit);
+}
+
+
+/** @brief Recording positional callback */
+static int opt_scan_pos(int idx, unsigned count, char *args[], void *data)
+{
+    struct optscanrun *run = (struct optscanrun *)data;
+
+    (void)idx;
+    run->thr->npos = count;
+    run->thr->pos = args;
+    return 0;
+}
+
+
+/** @brief Read /proc/@p pid/cmdline into the thread's buffer
+ *  @returns Its length, zero for kernel threads and processes that are gone
+ */
+static size_t opt_scan_read(struct optscanthr *thr, long pid)
+{
+    char path[32], *tmp;
+    size_t len = 0;
+    ssize_t n;
+    int fd;
+
+    snprintf(path, sizeof path, "%ld/cmdline", pid);
+    fd = openat(thr->ctx->procfd, path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    for (;;) {
+        /* Keep a byte spare for a terminator */
+        if (thr->bufcap - len < 2) {
+            tmp = (char *)realloc(thr->buf, thr->bufcap * 2);
+            if (!tmp) {
+                thr->nomem = 1;
+                break;
+            }
+            thr->buf = tmp;
+            thr->bufcap *= 2;
+        }
+        n = read(fd, thr->buf + len, thr->bufcap - len - 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+    }
+    close(fd);
+    /* A process that rewrote its title may have dropped the terminator */
+    if (len && thr->buf[len - 1]) {
+        thr->buf[len++] = '\0';
+    }
+    return len;
+}
+
+
+/** @brief Split the thread's cmdline buffer into its argv
+ *  @returns argc, or -1 if out of memory
+ */
+static int opt_scan_split(struct optscanthr *thr, size_t len)
+{
+    char **tmp, *p = thr->buf, *end = thr->buf + len;
+    size_t argc = 0;
+
+    while (p < end) {
+        if (argc + 1 >= thr->argvcap) {
+            tmp = (char **)realloc(thr->argv, thr->argvcap * 2 * sizeof *tmp);
+            if (!tmp) {
+                thr->nomem = 1;
+                return -1;
+            }
+            thr->argv = tmp;
+            thr->argvcap *= 2;
+        }
+        thr->argv[argc++] = p;
+        p += strlen(p) + 1;
+    }
+    thr->argv[argc] = NULL;
+    return (int)argc;
+}
+
+
+/** @brief Find the registry entry for @p arg0
+ *  @returns Its index, or -1
+ */
+static int opt_scan_match(const struct optscanctx *ctx, const char *arg0)
+{
+    const struct optscanent *ents = ctx->scan->ents;
+    const char *base = strrchr(arg0, '/');
+    unsigned lo = 0, hi = ctx->scan->nent, mid;
+    int cmp;
+
+    base = base ? base + 1 : arg0;
+    /* Login shells */
+    base += *base == '-';
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = strcmp(base, ents[ctx->byname[mid]].name);
+        if (!cmp) {
+            return (int)ctx->byname[mid];
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return -1;
+}
+
+
+/** @brief Read, match and parse one process */
+static void opt_scan_proc(struct optscanthr *thr, long pid)
+{
+    struct optscanctx *ctx = thr->ctx;
+    struct optscanproc proc;
+    struct optscanrun run;
+    struct optinfo info;
+    size_t len;
+    int argc, ent;
+
+    if (!(len = opt_scan_read(thr, pid))) {
+        return;
+    }
+    thr->nproc++;
+    if ((ent = opt_scan_match(ctx, thr->buf)) < 0
+     || (argc = opt_scan_split(thr, len)) < 0) {
+        return;
+    }
+    thr->nmatch++;
+    thr->nhit = 0;
+    thr->npos = 0;
+    thr->pos = NULL;
+    run.thr = thr;
+    run.hist = thr->hist + ctx->tbls[ent].hist;
+    run.nopt = ctx->scan->ents[ent].nopt;
+    run.hist[run.nopt + 1]++;
+    memset(&info, 0, sizeof info);
+    info.argc = argc;
+    info.argv = thr->argv;
+    info.fstact = OPT_FIRST_SKIP;
+    info.endact = OPT_END_ALLOW;
+    info.errcb = opt_scan_err;
+    info.poscb = opt_scan_pos;
+    info.data = &run;
+    opt_parse_tbl(&info, &ctx->tbls[ent].tbl);
+    if (ctx->scan->func) {
+        proc.pid = pid;
+        proc.ent = (unsigned)ent;
+        proc.argc = argc;
+        proc.argv = thr->argv;
+        proc.nhit = thr->nhit;
+        proc.hits = thr->hits;
+        proc.npos = thr->npos;
+        proc.pos = thr->pos;
+        ctx->scan->func(&proc, ctx->scan->data);
+    }
+}
+
+
+/** @brief Scan thread: claim chunks of PIDs until there are none left */
+static void *opt_scan_thread(void *arg)
+{
+    struct optscanthr *thr = (struct optscanthr *)arg;
+    struct optscanctx *ctx = thr->ctx;
+    size_t i, end;
+
+    for (;;) {
+        pthread_mutex_lock(&ctx->lock);
+        i = ctx->next;
+        end = i + OPT_SCAN_CHUNK < ctx->npid ? i + OPT_SCAN_CHUNK : ctx->npid;
+        ctx->next = end;
+        pthread_mutex_unlock(&ctx->lock);
+        if (i == end) {
+            break;
+        }
+        for (; i < end; i++) {
+            opt_scan_proc(thr, ctx->pids[i]);
+        }
+    }
+    return NULL;
+}
+
+
+/** @brief List the PIDs in /proc */
+static int opt_scan_list(struct optscanctx *ctx)
+{
+    struct dirent *de;
+    size_t cap = 1024;
+    long *tmp;
+    DIR *dir;
+
+    if (!(dir = fdopendir(dup(ctx->procfd)))) {
+        return -1;
+    }
+    ctx->pids = (long *)malloc(cap * sizeof *ctx->pids);
+    while (ctx->pids && (de = readdir(dir))) {
+        if (*de->d_name < '1' || *de->d_name > '9') {
+            continue;
+        }
+        if (ctx->npid == cap) {
+            tmp = (long *)realloc(ctx->pids, cap * 2 * sizeof *tmp);
+            if (!tmp) {
+                free(ctx->pids);
+                ctx->pids = NULL;
+                break;
+            }
+            ctx->pids = tmp;
+            cap *= 2;
+        }
+        ctx->pids[ctx->npid++] = strtol(de->d_name, NULL, 10);
+    }
+    closedir(dir);
+    if (!ctx->pids) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+
+/** @brief Build the private tables and the name index */
+static int opt_scan_prepare(struct optscanctx *ctx)
+{
+    struct optscan *scan = ctx->scan;
+    struct optscantbl *t;
+    unsigned e, i, j, k;
+
+    ctx->tbls = (struct optscantbl *)calloc(scan->nent + 1, sizeof *ctx->tbls);
+    ctx->byname = (unsigned *)calloc(scan->nent + 1, sizeof *ctx->byname);
+    if (!ctx->tbls || !ctx->byname) {
+        return -1;
+    }
+    for (e = 0; e < scan->nent; e++) {
+        t = &ctx->tbls[e];
+        t->opts = (struct optspec *)malloc((scan->ents[e].nopt + 1)
+                                           * sizeof *t->opts);
+        t->idx = (const struct optspec **)malloc((scan->ents[e].nopt + 1) * 2
+                                                 * sizeof *t->idx);
+        if (!t->opts || !t->idx) {
+            return -1;
+        }
+        for (i = 0; i < scan->ents[e].nopt; i++) {
+            t->opts[i] = scan->ents[e].opts[i];
+            t->opts[i].func = opt_scan_opt;
+        }
+        opt_tbl_init(&t->tbl, scan->ents[e].nopt, t->opts, t->idx,
+                     t->idx + scan->ents[e].nopt + 1);
+        /* Options, unrecognized options, processes */
+        t->hist = ctx->nhist;
+        ctx->nhist += scan->ents[e].nopt + 2;
+    }
+    /* Insertion sort: registries are short */
+    for (i = 0; i < scan->nent; i++) {
+        k = i;
+        for (j = i; j > 0 && strcmp(scan->ents[k].name,
+                                    scan->ents[ctx->byname[j - 1]].name) < 0;
+             j--) {
+            ctx->byname[j] = ctx->byname[j - 1];
+        }
+        ctx->byname[j] = k;
+    }
+    return 0;
+}
+
+
+/** @brief Free everything but the threads' buffers */
+static void opt_scan_free(struct optscanctx *ctx)
+{
+    unsigned e;
+
+    for (e = 0; ctx->tbls && e < ctx->scan->nent; e++) {
+        free(ctx->tbls[e].opts);
+        free(ctx->tbls[e].idx);
+    }
+    free(ctx->tbls);
+    free(ctx->byname);
+    free(ctx->pids);
+    if (ctx->procfd >= 0) {
+        close(ctx->procfd);
+    }
+}
+
+
+OPT_EXTERN_C
+int opt_scan(struct optscan *scan)
+{
+    struct optscanctx ctx;
+    struct optscanthr *thr;
+    struct optscanent *ent;
+    unsigned nthr = scan->nthread, nrun, t, e, i;
+    long ncpu;
+    int res = 0;
+
+    memset(&ctx, 0, sizeof ctx);
+    ctx.scan = scan;
+    ctx.procfd = open("/proc", O_RDONLY | O_DIRECTORY);
+    if (ctx.procfd < 0 || opt_scan_list(&ctx) || opt_scan_prepare(&ctx)) {
+        res = errno ? errno : ENOMEM;
+        opt_scan_free(&ctx);
+        errno = res;
+        return -1;
+    }
+    if (!nthr) {
+        ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthr = ncpu > 0 ? (unsigned)ncpu : 1;
+    }
+    nthr = nthr < OPT_SCAN_MAXTHREAD ? nthr : OPT_SCAN_MAXTHREAD;
+    /* No point in threads that would not get a chunk */
+    if (nthr > ctx.npid / OPT_SCAN_CHUNK + 1) {
+        nthr = (unsigned)(ctx.npid / OPT_SCAN_CHUNK + 1);
+    }
+    if (!(thr = (struct optscanthr *)calloc(nthr, sizeof *thr))) {
+        opt_scan_free(&ctx);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (t = 0; t < nthr; t++) {
+        thr[t].ctx = &ctx;
+        thr[t].hist = (unsigned long *)calloc(ctx.nhist + 1,
+                                              sizeof *thr[t].hist);
+        thr[t].bufcap = 4096;
+        thr[t].buf = (char *)malloc(thr[t].bufcap);
+        thr[t].argvcap = 64;
+        thr[t].argv = (char **)malloc(thr[t].argvcap * sizeof *thr[t].argv);
+        if (!thr[t].hist || !thr[t].buf || !thr[t].argv) {
+            break;
+        }
+    }
+    /* Scan with whatever could be set up, the calling thread included */
+    pthread_mutex_init(&ctx.lock, NULL);
+    nrun = 0;
+    if (t) {
+        while (nrun + 1 < t && !pthread_create(&thr[nrun].thread, NULL,
+                                               opt_scan_thread, &thr[nrun])) {
+            nrun++;
+        }
+        opt_scan_thread(&thr[nrun]);
+        for (i = 0; i < nrun; i++) {
+            pthread_join(thr[i].thread, NULL);
+        }
+        nrun++;
+    }
+    for (t = 0; t < nrun; t++) {
+        for (e = 0; e < scan->nent; e++) {
+            ent = &scan->ents[e];
+            for (i = 0; ent->hist && i < ent->nopt + 2; i++) {
+                ent->hist[i] += thr[t].hist[ctx.tbls[e].hist + i];
+            }
+        }
+        scan->nproc += thr[t].nproc;
+        scan->nmatch += thr[t].nmatch;
+        res |= thr[t].nomem;
+    }
+    for (t = 0; t < nthr; t++) {
+        free(thr[t].hist);
+        free(thr[t].buf);
+        free(thr[t].argv);
+        free(thr[t].hits);
+    }
+    free(thr);
+    pthread_mutex_destroy(&ctx.lock);
+    opt_scan_free(&ctx);
+    if (res || !nrun) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+#endif /* OPT_IMPLEMENTATION */
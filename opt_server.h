@@ -0,0 +1,690 @@
+#pragma once
+/** @file opt_server.h warm parse server for short-lived opt.h tools.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  A tool invoked thousands of times a minute by scripts spends most of its
+ *  life in exec, dynamic linking and initialization. This lets a resident
+ *  process do all of that once: it sorts its option table and warms whatever
+ *  else it likes, then serves requests on a Unix domain socket. The client,
+ *  tools/optc.c, forwards its argv, working directory, environment and
+ *  standard descriptors (passed with SCM_RIGHTS), and exits with the status
+ *  the server sends back. This is the nailgun model.
+ *
+ *  Each request runs in a fork(2) of the warm server, so the sorted table and
+ *  everything else built before opt_serve is shared copy-on-write, while the
+ *  request's side effects stay isolated exactly as they would in a fresh
+ *  process. For example:
+ *
+ *  static struct opttbl tbl;
+ *
+ *  static int tool_main(int argc, char *argv[], void *data)
+ *  {
+ *      struct optinfo info = { ... };
+ *
+ *      info.argc = argc;
+ *      info.argv = argv;
+ *      if (opt_parse_tbl(&info, &tbl)) {
+ *          return 2;
+ *      }
+ *      ... do the work, writing to stdout/stderr as usual ...
+ *      return 0;
+ *  }
+ *
+ *  int main(void)
+ *  {
+ *      static const struct optspec *shrt[NOPT], *lng[NOPT];
+ *      char path[OPT_SRV_PATH_MAX];
+ *
+ *      opt_tbl_init(&tbl, NOPT, opts, shrt, lng);
+ *      opt_srv_path(path, sizeof path, "tool");
+ *      return opt_serve(path, tool_main, NULL);
+ *  }
+ *
+ *  Then "ln -s optc tool" and invoke tool as usual. Both ends run as the same
+ *  user: the socket is created with mode 0600 in a directory of that user's,
+ *  and each end checks the uid of the other (SO_PEERCRED or getpeereid)
+ *  before trusting it, the client before it sends its environment and
+ *  descriptors. Where the system does not report it, nothing is served.
+ *  Signals sent to a client are not forwarded to its request.
+ *
+ *  This is POSIX-only and uses the heap. With a strict -std, define
+ *  _GNU_SOURCE (or _DEFAULT_SOURCE) before the first include for the socket
+ *  and signal declarations.
+ */
+#ifndef OPT_SERVER_H
+#define OPT_SERVER_H
+
+#include "opt.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+/** @brief Largest socket path, including the terminator */
+#define OPT_SRV_PATH_MAX 108
+
+
+/** @brief Entry point of a request. This runs in a forked child of the
+ *      server, with the client's descriptors on 0, 1 and 2, its working
+ *      directory and its environment
+ *  @param argc
+ *      The client's argc
+ *  @param argv
+ *      The client's argv
+ *  @param data
+ *      User data given to opt_serve
+ *  @returns The exit status for the client
+ */
+typedef int optsrvfn_t(int argc, char *argv[], void *data);
+
+
+/** @brief Find the default socket path of @p name: $OPT_SERVER if it is set,
+ *      otherwise "$XDG_RUNTIME_DIR/opt-NAME.sock", or without that
+ *      "/tmp/opt-UID/NAME.sock". The last directory is created with mode 0700
+ *      if need be, and refused unless it is ours and closed to others. Start
+ *      the server with the same environment as its clients
+ *  @param buf
+ *      Path buffer
+ *  @param size
+ *      Size of @p buf
+ *  @param name
+ *      Tool name. Only its basename is used, so argv[0] will do
+ *  @returns Zero on success, or -1 with errno set if the path does not fit
+ *      (ENAMETOOLONG) or its directory is not safe to use
+ */
+int opt_srv_path(char *buf, size_t size, const char *name);
+
+
+/** @brief Serve requests on @p path until a fatal error. A stale socket at
+ *      @p path is replaced
+ *  @param path
+ *      Socket path
+ *  @param func
+ *      Request entry point
+ *  @param data
+ *      User data for @p func
+ *  @returns -1 with errno set. This does not return otherwise
+ */
+int opt_serve(const char *path, optsrvfn_t *func, void *data);
+
+
+/** @brief Forward the calling process to the server at @p path and wait for
+ *      the request to finish
+ *  @param path
+ *      Socket path
+ *  @param argc
+ *      Cmdarg count
+ *  @param argv
+ *      Cmdargs
+ *  @returns The request's exit status (0-255), -1 with errno set if the
+ *      server could not be reached, in which case a client may still run
+ *      the tool itself, or -2 with errno set if the request was handed over
+ *      but its status never came back. The request may then have run, so
+ *      it must not be run again
+ */
+int opt_srv_call(const char *path, int argc, char *argv[]);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_SERVER_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#if defined(__linux__) && !defined(SO_PEERCRED)
+/* glibc only has it from its own sys/socket.h with _DEFAULT_SOURCE */
+#   include <asm/socket.h>
+#endif
+#ifndef MSG_NOSIGNAL
+#   define MSG_NOSIGNAL 0
+#endif
+
+
+extern char **environ;
+
+
+/** Wire format. Both ends are on the same host, so integers are native.
+ *  A request is a struct optsrvhdr carrying the client's fds 0, 1 and 2 as
+ *  SCM_RIGHTS, followed by "len" bytes: the NUL-terminated cwd, then "argc"
+ *  argv strings, then "envc" environment strings. The reply is one int, the
+ *  exit status */
+#define OPT_SRV_MAGIC   0x4f505444u     /* "OPTD" */
+#define OPT_SRV_VERSION 1u
+#define OPT_SRV_MAXLEN  (16u << 20)     /* Sanity limit on a request */
+#define OPT_SRV_NFD     3
+
+
+/** @brief Request header */
+struct optsrvhdr {
+    unsigned magic;     /* OPT_SRV_MAGIC */
+    unsigned version;   /* OPT_SRV_VERSION */
+    unsigned argc;      /* Cmdarg count */
+    unsigned envc;      /* Environment string count */
+    unsigned len;       /* Payload length */
+};
+
+
+/** @brief A request in progress */
+struct optsrvconn {
+    pid_t pid;          /* Worker */
+    int   fd;           /* Client connection */
+};
+
+
+/* Self-pipe written by the SIGCHLD handler */
+static int opt_srv_sigfd = -1;
+
+
+OPT_EXTERN_C
+int opt_srv_path(char *buf, size_t size, const char *name)
+{
+    const char *env = getenv("OPT_SERVER"), *base = strrchr(name, '/');
+    const char *run = getenv("XDG_RUNTIME_DIR");
+    struct stat st;
+    int len;
+
+    base = base ? base + 1 : name;
+    if (env && *env) {
+        len = snprintf(buf, size, "%s", env);
+    } else if (run && *run == '/') {
+        len = snprintf(buf, size, "%s/opt-%s.sock", run, base);
+    } else {
+        /* Not the socket itself in /tmp, where anyone could bind it first */
+        len = snprintf(buf, size, "/tmp/opt-%lu", (unsigned long)getuid());
+        if (len > 0 && (size_t)len < size) {
+            if (mkdir(buf, 0700) && errno != EEXIST) {
+                return -1;
+            } else if (lstat(buf, &st) || !S_ISDIR(st.st_mode)
+                    || st.st_uid != getuid() || (st.st_mode & 077)) {
+                errno = EPERM;
+                return -1;
+            }
+            len += snprintf(buf + len, size - (size_t)len, "/%s.sock", base);
+        }
+    }
+    if (len < 0 || (size_t)len >= size || (size_t)len >= OPT_SRV_PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+
+/** @brief Fill a socket address for @p path */
+static int opt_srv_addr(struct sockaddr_un *addr, const char *path)
+{
+    size_t len = strlen(path);
+
+    if (len >= sizeof addr->sun_path) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, path, len + 1);
+    return 0;
+}
+
+
+/** @brief read(2) exactly @p len bytes */
+static int opt_srv_read(int fd, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+    ssize_t n;
+
+    while (len) {
+        n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            if (!n) {
+                errno = ECONNRESET;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+
+/** @brief write(2) exactly @p len bytes */
+static int opt_srv_write(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *)buf;
+    ssize_t n;
+
+    while (len) {
+        n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+
+/** @brief Receive the request header and the client's descriptors */
+static int opt_srv_recvhdr(int fd, struct optsrvhdr *hdr, int fds[])
+{
+    union {
+        struct cmsghdr align;
+        char           buf[CMSG_SPACE(sizeof(int) * OPT_SRV_NFD)];
+    } ctl;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t n;
+    int nfd = 0;
+
+    iov.iov_base = hdr;
+    iov.iov_len = sizeof *hdr;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof ctl.buf;
+    do {
+        n = recvmsg(fd, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return -1;
+    }
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            nfd = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * OPT_SRV_NFD);
+        }
+    }
+    /* The rest of a short header follows in the stream */
+    if (nfd != OPT_SRV_NFD
+     || opt_srv_read(fd, (char *)hdr + n, sizeof *hdr - (size_t)n)) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (hdr->magic != OPT_SRV_MAGIC || hdr->version != OPT_SRV_VERSION
+     || hdr->len > OPT_SRV_MAXLEN || hdr->argc >= hdr->len
+     || hdr->envc >= hdr->len || hdr->argc + hdr->envc >= hdr->len) {
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+
+/** @brief Split @p n NUL-terminated strings out of @p buf into @p vec, which
+ *      is then terminated with a null pointer
+ *  @returns The position after the last string, or NULL if @p buf ends first
+ */
+static char *opt_srv_split(char *buf, char *end, unsigned n, char *vec[])
+{
+    char *nul;
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        nul = buf < end ? (char *)memchr(buf, '\0', (size_t)(end - buf)) : NULL;
+        if (!nul) {
+            return NULL;
+        }
+        vec[i] = buf;
+        buf = nul + 1;
+    }
+    vec[n] = NULL;
+    return buf;
+}
+
+
+/** @brief Run one request in a forked worker. The connection is only used to
+ *      receive the request, the parent sends the status back
+ *  @returns The exit status of the worker
+ */
+static int opt_srv_worker(int fd, optsrvfn_t *func, void *data)
+{
+    struct optsrvhdr hdr;
+    int fds[OPT_SRV_NFD], i;
+    char *buf, *end, *cwd, **argv, **envp;
+
+    if (opt_srv_recvhdr(fd, &hdr, fds)) {
+        return 127;
+    }
+    buf = (char *)malloc(hdr.len);
+    argv = (char **)calloc(hdr.argc + 1, sizeof *argv);
+    envp = (char **)calloc(hdr.envc + 1, sizeof *envp);
+    if (!buf || !argv || !envp || opt_srv_read(fd, buf, hdr.len)) {
+        return 127;
+    }
+    close(fd);
+    end = buf + hdr.len;
+    cwd = buf;
+    buf = (char *)memchr(buf, '\0', hdr.len);
+    if (!buf || !(buf = opt_srv_split(buf + 1, end, hdr.argc, argv))
+     || !opt_srv_split(buf, end, hdr.envc, envp)) {
+        return 127;
+    }
+    /* Move them clear of 0-2 first, a server started with those closed may
+     * have received them there */
+    for (i = 0; i < OPT_SRV_NFD; i++) {
+        if (fds[i] < OPT_SRV_NFD) {
+            fds[i] = fcntl(fds[i], F_DUPFD, OPT_SRV_NFD);
+        }
+    }
+    for (i = 0; i < OPT_SRV_NFD; i++) {
+        if (fds[i] < 0 || dup2(fds[i], i) < 0) {
+            return 127;
+        }
+        close(fds[i]);
+    }
+    environ = envp;
+    if (chdir(cwd)) {
+        fprintf(stderr, "%s: %s: %s\n", hdr.argc ? argv[0] : "opt_serve",
+                cwd, strerror(errno));
+        return 127;
+    }
+    return func((int)hdr.argc, argv, data);
+}
+
+
+/** @brief SIGCHLD handler: wake up the accept loop */
+static void opt_srv_sigchld(int sig)
+{
+    int err = errno;
+
+    (void)sig;
+    (void)!write(opt_srv_sigfd, "", 1);
+    errno = err;
+}
+
+
+/** @brief Reap finished workers and send their clients the exit status */
+static void opt_srv_reap(struct optsrvconn *conn, unsigned *nconn)
+{
+    int status, res;
+    unsigned i;
+    pid_t pid;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (i = 0; i < *nconn && conn[i].pid != pid; i++) {
+            ;
+        }
+        if (i == *nconn) {
+            continue;
+        }
+        res = WIFEXITED(status) ? WEXITSTATUS(status)
+            : WIFSIGNALED(status) ? 128 + WTERMSIG(status) : 127;
+        (void)opt_srv_write(conn[i].fd, &res, sizeof res);
+        close(conn[i].fd);
+        conn[i] = conn[--*nconn];
+    }
+}
+
+
+/** @brief Check that the peer on @p fd runs as our user. Where the peer's
+ *      credentials are not available nobody is trusted
+ *  @returns Nonzero if it does, zero with errno set otherwise
+ */
+static int opt_srv_peer_ok(int fd)
+{
+#if defined(__linux__) && defined(SO_PEERCRED)
+    /* struct ucred, which glibc only declares with _GNU_SOURCE */
+    struct {
+        pid_t pid;
+        uid_t uid;
+        gid_t gid;
+    } cred;
+    socklen_t len = sizeof cred;
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len)) {
+        return 0;
+    } else if (cred.uid != getuid()) {
+        errno = EPERM;
+        return 0;
+    }
+    return 1;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) \
+   || defined(__NetBSD__)
+    uid_t uid;
+    gid_t gid;
+
+    if (getpeereid(fd, &uid, &gid)) {
+        return 0;
+    } else if (uid != getuid()) {
+        errno = EPERM;
+        return 0;
+    }
+    return 1;
+#else
+    (void)fd;
+    errno = ENOSYS;
+    return 0;
+#endif
+}
+
+
+/** @brief Set close-on-exec on @p fd, so requests do not inherit it */
+static int opt_srv_cloexec(int fd)
+{
+    return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+
+OPT_EXTERN_C
+int opt_serve(const char *path, optsrvfn_t *func, void *data)
+{
+    struct optsrvconn *conn = NULL, *tmp;
+    unsigned nconn = 0, cap = 0;
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    struct pollfd pfd[2];
+    int lfd, cfd, sig[2], err;
+    mode_t mask;
+    char drain[64];
+    pid_t pid;
+
+    if (opt_srv_addr(&addr, path)
+     || (lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+    opt_srv_cloexec(lfd);
+    unlink(path);
+    mask = umask(077);
+    err = bind(lfd, (struct sockaddr *)&addr, sizeof addr);
+    umask(mask);
+    if (err || listen(lfd, SOMAXCONN) || pipe(sig)) {
+        err = errno;
+        close(lfd);
+        errno = err;
+        return -1;
+    }
+    for (err = 0; err < 2; err++) {
+        opt_srv_cloexec(sig[err]);
+        fcntl(sig[err], F_SETFL, O_NONBLOCK);
+    }
+    opt_srv_sigfd = sig[1];
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = opt_srv_sigchld;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+    pfd[0].fd = lfd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = sig[0];
+    pfd[1].events = POLLIN;
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (pfd[1].revents) {
+            while (read(sig[0], drain, sizeof drain) > 0) {
+                ;
+            }
+            opt_srv_reap(conn, &nconn);
+        }
+        if (!pfd[0].revents) {
+            continue;
+        }
+        cfd = accept(lfd, NULL, NULL);
+        if (cfd < 0) {
+            continue;
+        } else if (opt_srv_cloexec(cfd) || !opt_srv_peer_ok(cfd)) {
+            close(cfd);
+            continue;
+        }
+        if (nconn == cap) {
+            cap = cap ? cap * 2 : 16;
+            tmp = (struct optsrvconn *)realloc(conn, cap * sizeof *conn);
+            if (!tmp) {
+                close(cfd);
+                cap = nconn;
+                continue;
+            }
+            conn = tmp;
+        }
+        fflush(NULL);
+        pid = fork();
+        if (!pid) {
+            signal(SIGCHLD, SIG_DFL);
+            close(lfd);
+            close(sig[0]);
+            close(sig[1]);
+            exit(opt_srv_worker(cfd, func, data));
+        } else if (pid < 0) {
+            close(cfd);
+            continue;
+        }
+        conn[nconn].pid = pid;
+        conn[nconn].fd = cfd;
+        nconn++;
+    }
+    err = errno;
+    close(lfd);
+    errno = err;
+    return -1;
+}
+
+
+OPT_EXTERN_C
+int opt_srv_call(const char *path, int argc, char *argv[])
+{
+    union {
+        struct cmsghdr align;
+        char           buf[CMSG_SPACE(sizeof(int) * OPT_SRV_NFD)];
+    } ctl;
+    static const int fds[OPT_SRV_NFD] = { 0, 1, 2 };
+    struct sockaddr_un addr;
+    struct optsrvhdr hdr;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    size_t len, pos, cwdcap = 256;
+    char *buf = NULL, *cwd = NULL, *tmp;
+    int fd = -1, res = -1, err, i;
+    ssize_t n;
+
+    /* Working directory */
+    while (!(tmp = (char *)realloc(cwd, cwdcap)) || !getcwd(tmp, cwdcap)) {
+        cwd = tmp;
+        if (!tmp || errno != ERANGE) {
+            goto out;
+        }
+        cwdcap *= 2;
+    }
+    cwd = tmp;
+    /* Payload */
+    hdr.magic = OPT_SRV_MAGIC;
+    hdr.version = OPT_SRV_VERSION;
+    hdr.argc = (unsigned)argc;
+    hdr.envc = 0;
+    len = strlen(cwd) + 1;
+    for (i = 0; i < argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    for (i = 0; environ[i]; i++) {
+        len += strlen(environ[i]) + 1;
+        hdr.envc++;
+    }
+    if (len > OPT_SRV_MAXLEN || !(buf = (char *)malloc(len))) {
+        errno = E2BIG;
+        goto out;
+    }
+    hdr.len = (unsigned)len;
+    pos = strlen(cwd) + 1;
+    memcpy(buf, cwd, pos);
+    for (i = 0; i < argc; i++) {
+        memcpy(buf + pos, argv[i], strlen(argv[i]) + 1);
+        pos += strlen(argv[i]) + 1;
+    }
+    for (i = 0; environ[i]; i++) {
+        memcpy(buf + pos, environ[i], strlen(environ[i]) + 1);
+        pos += strlen(environ[i]) + 1;
+    }
+    /* Connect and send the header with our descriptors, then the payload */
+    if (opt_srv_addr(&addr, path)
+     || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+     || connect(fd, (struct sockaddr *)&addr, sizeof addr)
+     || !opt_srv_peer_ok(fd)) {
+        goto out;
+    }
+    iov.iov_base = &hdr;
+    iov.iov_len = sizeof hdr;
+    memset(&msg, 0, sizeof msg);
+    memset(&ctl, 0, sizeof ctl);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof ctl.buf;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof fds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+    do {
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        goto out;
+    }
+    /* From here on the server may run the request */
+    if (opt_srv_write(fd, (const char *)&hdr + n, sizeof hdr - (size_t)n)
+     || opt_srv_write(fd, buf, len) || opt_srv_read(fd, &res, sizeof res)) {
+        res = -2;
+    }
+out:
+    err = errno;
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(buf);
+    free(cwd);
+    errno = err;
+    return res;
+}
+
+#endif /* OPT_IMPLEMENTATION */
@@ -0,0 +1,804 @@
+#pragma once
+/** @file opt_tmpl.h command line templates, parsed once and run many times.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  A parameter sweep is one command line with some of its arguments written
+ *  as axes, in shell brace syntax:
+ *
+ *  tool --lr {0.1,0.01,0.001} --bs {32,64} --seed {1..1000}
+ *
+ *  stands for the 6000 command lines that take every combination of the
+ *  axes' values. Rather than building and parsing each of them, parse the
+ *  template once:
+ *
+ *  struct optsweep sw;
+ *
+ *  info.argc = argc;
+ *  info.argv = argv;
+ *  if ((res = opt_sweep_init(&sw, &info, &tbl))) { ... }
+ *  ...
+ *  for (job = first; job < last; job++) {      e.g. a job array's slice
+ *      res = opt_sweep_run(&sw, job, &info);
+ *      ...
+ *  }
+ *  opt_sweep_free(&sw);
+ *
+ *  opt_sweep_init records what opt_parse_tbl calls back for the template,
+ *  without calling any option or positional callback. Unknown options go to
+ *  the error callback there, once, and are not seen again. Each argument
+ *  that a callback would get is then checked for an axis:
+ *
+ *  - {a,b,c}: the listed strings, where \ includes the next character
+ *    literally, e.g. a comma
+ *  - {m..n} or {m..n..s}: the integers from m to n, up or down, by s
+ *
+ *  Anything else, e.g. {} or {x}, is an ordinary argument. An axis is always
+ *  an argument of the option it follows (or a positional argument), whatever
+ *  its values look like, since the parse is not redone for them.
+ *
+ *  opt_sweep_run calls the callbacks of job @p job, 0 to sw.njob - 1, in the
+ *  template's order. The last axis varies fastest. Finding the job's values
+ *  is a division per axis, whatever the job's position, so any job array
+ *  task can go straight to its jobs. Listed values are the strings split
+ *  from the template, and integers are formatted into the sweep, so no
+ *  command line is built. The callbacks' strings stay valid until the next
+ *  run. The template's argv must outlive the sweep.
+ *
+ *  An executor that runs one command for each of a stream of inputs, like
+ *  GNU parallel(1), has placeholders in place of axes:
+ *
+ *  tool --input {} --shard {2} --log logs/{1}.txt
+ *
+ *  As in parallel, {} and {1} are the first of a task's values and {N} the
+ *  Nth, alone or within an argument. Parse the template once and bind each
+ *  task's values into it:
+ *
+ *  struct opttmpl tmpl;
+ *
+ *  if ((res = opt_tmpl_init(&tmpl, &info, &tbl))) { ... }
+ *  while (next_task(vals)) {                   tmpl.nval values each
+ *      res = opt_tmpl_run(&tmpl, vals, tmpl.nval, &info);
+ *      ...
+ *  }
+ *  opt_tmpl_free(&tmpl);
+ *
+ *  A run points each whole placeholder argument at its value, joins the
+ *  others into a buffer the template keeps, and calls the callbacks
+ *  directly. Nothing is tokenized or looked up per task, and the values
+ *  are not copied, so they must stay valid for the run.
+ *
+ *  A sweep or template runs one job at a time. Give each thread its own.
+ *  This uses the heap.
+ */
+#ifndef OPT_TMPL_H
+#define OPT_TMPL_H
+
+#include "opt.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+/** @brief A parsed parameter sweep */
+struct optsweep {
+    unsigned long long    njob;     /* Jobs, the product of the axes' sizes */
+    unsigned              naxis;    /* Axes */
+
+    /* Private */
+    const struct opttbl  *tbl;
+    struct opttmplev     *ev;       /* Recorded calls */
+    size_t                nev;
+    char                **args;     /* Their arguments, in order */
+    size_t                nargs;
+    struct opttmplaxis   *axis;
+};
+
+
+/** @brief A parsed command template with placeholders */
+struct opttmpl {
+    unsigned              nval;     /* Values a run needs: the largest {N} */
+
+    /* Private */
+    const struct opttbl  *tbl;
+    struct opttmplev     *ev;       /* Recorded calls */
+    size_t                nev;
+    char                **args;     /* Their arguments, in order */
+    size_t                nargs;
+    struct opttmplhole   *hole;     /* Arguments with placeholders */
+    size_t                nhole;
+    struct opttmplpart   *part;     /* Their pieces */
+    size_t                npart;
+    char                 *buf;      /* Joined arguments of the last run */
+    size_t                buflen;
+};
+
+
+/** @brief Parse a sweep template
+ *  @param sw
+ *      Sweep to initialize
+ *  @param info
+ *      Option context structure, with the template in argc and argv
+ *  @param tbl
+ *      Sorted option table
+ *  @returns See opt_parse, or -1 with errno set: ENOMEM, or ERANGE if there
+ *      are more than ULLONG_MAX jobs. On nonzero @p sw is freed
+ */
+int opt_sweep_init(struct optsweep     *sw,
+                   struct optinfo      *info,
+                   const struct opttbl *tbl);
+
+
+/** @brief Call back the options of one job
+ *  @param sw
+ *      Sweep
+ *  @param job
+ *      Job, from 0 to sw->njob - 1
+ *  @param info
+ *      Option context structure, for poscb and data
+ *  @returns See opt_parse, or -1 with errno EINVAL if there is no such job
+ */
+int opt_sweep_run(struct optsweep *sw, unsigned long long job,
+                  struct optinfo *info);
+
+
+/** @brief The value of an axis in a job, valid until the next run or value
+ *  @param sw
+ *      Sweep
+ *  @param job
+ *      Job, from 0 to sw->njob - 1
+ *  @param axis
+ *      Axis, from 0 to sw->naxis - 1, in template order
+ *  @returns The value, or NULL if there is no such job or axis
+ */
+const char *opt_sweep_value(struct optsweep *sw, unsigned long long job,
+                            unsigned axis);
+
+
+/** @brief Free a sweep
+ *  @param sw
+ *      Sweep
+ */
+void opt_sweep_free(struct optsweep *sw);
+
+
+/** @brief Parse a command template
+ *  @param tmpl
+ *      Template to initialize
+ *  @param info
+ *      Option context structure, with the template in argc and argv
+ *  @param tbl
+ *      Sorted option table
+ *  @returns See opt_parse, or -1 with errno ENOMEM. On nonzero @p tmpl is
+ *      freed
+ */
+int opt_tmpl_init(struct opttmpl      *tmpl,
+                  struct optinfo      *info,
+                  const struct opttbl *tbl);
+
+
+/** @brief Call back the options of the template with @p vals bound
+ *  @param tmpl
+ *      Template
+ *  @param vals
+ *      Values of {1} to {nval}
+ *  @param nval
+ *      Their count, at least tmpl->nval
+ *  @param info
+ *      Option context structure, for poscb and data
+ *  @returns See opt_parse, or -1 with errno set: EINVAL if there are too few
+ *      values, ENOMEM
+ */
+int opt_tmpl_run(struct opttmpl *tmpl, char *vals[], unsigned nval,
+                 struct optinfo *info);
+
+
+/** @brief Free a template
+ *  @param tmpl
+ *      Template
+ */
+void opt_tmpl_free(struct opttmpl *tmpl);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_TMPL_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define OPT_TMPL_POS    (-1)    /* Event index of the positional callback */
+
+
+/** @brief One recorded call */
+struct opttmplev {
+    int      idx;       /* Option index, or OPT_TMPL_POS */
+    unsigned count;     /* Its argument count, which are the next args */
+};
+
+
+/** @brief One axis of a sweep */
+struct opttmplaxis {
+    size_t              slot;   /* Its argument, in args */
+    unsigned long long  n;      /* Values */
+    unsigned long long  stride; /* Jobs per value */
+    char              **vals;   /* Listed values (NULL: a range) */
+    long long           from;   /* Range */
+    long long           step;
+    char                num[24];    /* The current integer */
+};
+
+
+/** @brief A piece of an argument with placeholders */
+struct opttmplpart {
+    const char *lit;    /* Literal text */
+    size_t      len;
+    unsigned    val;    /* Or value val - 1, if nonzero */
+};
+
+
+/** @brief An argument with placeholders */
+struct opttmplhole {
+    size_t      slot;   /* In args */
+    size_t      part;   /* Its first piece */
+    unsigned    npart;
+};
+
+
+/** @brief Calls recorded while parsing a template */
+struct opttmplrec {
+    opterrfn_t         *errcb;
+    void               *data;
+    struct opttmplev   *ev;
+    size_t              nev;
+    size_t              evcap;
+    char              **args;
+    size_t              nargs;
+    size_t              argcap;
+    int                 nomem;
+};
+
+
+static int opt_tmpl_log(struct opttmplrec *rec, int idx, unsigned count,
+                        char *args[])
+{
+    size_t cap;
+    void *p;
+
+    if (rec->nev == rec->evcap) {
+        cap = rec->evcap ? rec->evcap * 2 : 64;
+        if (!(p = realloc(rec->ev, cap * sizeof *rec->ev))) {
+            return rec->nomem = 1;
+        }
+        rec->ev = (struct opttmplev *)p;
+        rec->evcap = cap;
+    }
+    if (rec->nargs + count > rec->argcap) {
+        cap = (rec->nargs + count) * 2 + 64;
+        if (!(p = realloc(rec->args, cap * sizeof *rec->args))) {
+            return rec->nomem = 1;
+        }
+        rec->args = (char **)p;
+        rec->argcap = cap;
+    }
+    rec->ev[rec->nev].idx = idx;
+    rec->ev[rec->nev++].count = count;
+    if (count) {
+        memcpy(rec->args + rec->nargs, args, count * sizeof *args);
+    }
+    rec->nargs += count;
+    return 0;
+}
+
+
+static int opt_tmpl_rec(int idx, unsigned count, char *args[], void *data)
+{
+    return opt_tmpl_log((struct opttmplrec *)data, idx, count, args);
+}
+
+
+static int opt_tmpl_recpos(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    return opt_tmpl_log((struct opttmplrec *)data, OPT_TMPL_POS, count, args);
+}
+
+
+static int opt_tmpl_recerr(int type, char shrt, char *lng, void *data)
+{
+    struct opttmplrec *rec = (struct opttmplrec *)data;
+
+    return rec->errcb(type, shrt, lng, rec->data);
+}
+
+
+/** @brief Record the calls of the template in info->argv into @p rec
+ *  @returns See opt_parse, or -1 with errno set
+ */
+static int opt_tmpl_record(struct optinfo      *info,
+                           const struct opttbl *tbl,
+                           struct opttmplrec   *rec)
+{
+    const struct optspec **shrt, **lng;
+    struct optinfo sub = *info;
+    struct optspec *opts;
+    struct opttbl ptbl;
+    unsigned i;
+    int res;
+
+    memset(rec, 0, sizeof *rec);
+    opts = (struct optspec *)malloc((tbl->nopt + 1) * sizeof *opts);
+    shrt = (const struct optspec **)malloc((tbl->nopt + 1) * sizeof *shrt);
+    lng = (const struct optspec **)malloc((tbl->nopt + 1) * sizeof *lng);
+    if (!opts || !shrt || !lng) {
+        free(opts);
+        free(shrt);
+        free(lng);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < tbl->nopt; i++) {
+        opts[i] = tbl->opts[i];
+        opts[i].func = opt_tmpl_rec;
+    }
+    opt_tbl_init(&ptbl, tbl->nopt, opts, shrt, lng);
+    rec->errcb = info->errcb;
+    rec->data = info->data;
+    sub.errcb = opt_tmpl_recerr;
+    sub.poscb = opt_tmpl_recpos;
+    sub.data = rec;
+    res = opt_parse_tbl(&sub, &ptbl);
+    free(opts);
+    free(shrt);
+    free(lng);
+    if (rec->nomem) {
+        errno = ENOMEM;
+        res = -1;
+    }
+    if (res) {
+        free(rec->ev);
+        free(rec->args);
+    }
+    return res;
+}
+
+
+/** @brief Call back the recorded calls */
+static int opt_tmpl_replay(struct optinfo         *info,
+                           const struct opttbl    *tbl,
+                           const struct opttmplev *ev,
+                           size_t                  nev,
+                           char                   *args[])
+{
+    size_t i;
+    int res = 0;
+
+    for (i = 0; !res && i < nev; i++) {
+        if (ev[i].idx == OPT_TMPL_POS) {
+            res = opt_invoke(info, info->poscb, -1, ev[i].count, args);
+        } else {
+            res = opt_invoke(info, tbl->opts[ev[i].idx].func, ev[i].idx,
+                             ev[i].count, args);
+        }
+        args += ev[i].count;
+    }
+    return res;
+}
+
+
+/** @brief Parse a decimal integer of an axis range, ending at @p end */
+static int opt_tmpl_int(const char *p, const char *end, long long *v)
+{
+    char *stop;
+
+    if (p == end || *p == '+' || (*p != '-' && (*p < '0' || *p > '9'))) {
+        return -1;
+    }
+    errno = 0;
+    *v = strtoll(p, &stop, 10);
+    return errno || stop != end ? -1 : 0;
+}
+
+
+/** @brief Set up @p axis if @p arg is a range {m..n} or {m..n..s}
+ *  @returns Zero if it is
+ */
+static int opt_tmpl_range(struct opttmplaxis *axis, const char *arg,
+                          size_t len)
+{
+    const char *end = arg + len - 1, *dots, *dots2;
+    unsigned long long span, step;
+    long long from, to, by = 1;
+
+    if (!(dots = strstr(arg + 1, ".."))
+     || opt_tmpl_int(arg + 1, dots, &from)) {
+        return -1;
+    }
+    dots2 = strstr(dots + 2, "..");
+    if (opt_tmpl_int(dots + 2, dots2 && dots2 < end ? dots2 : end, &to)
+     || (dots2 && dots2 < end && (opt_tmpl_int(dots2 + 2, end, &by) || !by))) {
+        return -1;
+    }
+    /* Like the shell, the step's sign is ignored */
+    step = by < 0 ? 0ull - (unsigned long long)by : (unsigned long long)by;
+    span = to >= from ? (unsigned long long)to - (unsigned long long)from
+                      : (unsigned long long)from - (unsigned long long)to;
+    axis->n = span / step + 1;
+    axis->from = from;
+    axis->step = (long long)(to >= from ? step : 0ull - step);
+    axis->vals = NULL;
+    return 0;
+}
+
+
+/** @brief Set up @p axis if @p arg is a list {a,b,...}
+ *  @returns Zero if it is, -1 if it is not, and ENOMEM
+ */
+static int opt_tmpl_list(struct opttmplaxis *axis, const char *arg,
+                         size_t len)
+{
+    const char *p, *end = arg + len - 1;
+    size_t n = 1;
+    char *str;
+
+    for (p = arg + 1; p < end; p++) {
+        if (*p == '\\' && p + 1 < end) {
+            p++;
+        } else if (*p == ',') {
+            n++;
+        }
+    }
+    if (n < 2) {
+        return -1;
+    }
+    /* The pointers, then the strings, which are no longer than the list */
+    if (!(axis->vals = (char **)malloc(n * sizeof *axis->vals + len))) {
+        return ENOMEM;
+    }
+    str = (char *)(axis->vals + n);
+    axis->n = 0;
+    axis->vals[axis->n++] = str;
+    for (p = arg + 1; p < end; p++) {
+        if (*p == '\\' && p + 1 < end) {
+            *str++ = *++p;
+        } else if (*p == ',') {
+            *str++ = '\0';
+            axis->vals[axis->n++] = str;
+        } else {
+            *str++ = *p;
+        }
+    }
+    *str = '\0';
+    return 0;
+}
+
+
+/** @brief Find the axes among the recorded arguments */
+static int opt_tmpl_axes(struct optsweep *sw)
+{
+    struct opttmplaxis axis, *p;
+    unsigned long long njob = 1;
+    size_t i, len;
+    unsigned k;
+    int res;
+
+    for (i = 0; i < sw->nargs; i++) {
+        len = strlen(sw->args[i]);
+        if (len < 3 || sw->args[i][0] != '{' || sw->args[i][len - 1] != '}') {
+            continue;
+        }
+        if (opt_tmpl_range(&axis, sw->args[i], len)
+         && (res = opt_tmpl_list(&axis, sw->args[i], len))) {
+            if (res < 0) {
+                continue;
+            }
+            return res;
+        }
+        if (!axis.n) {
+            /* The whole of long long, one more than the count can hold */
+            return ERANGE;
+        }
+        axis.slot = i;
+        if (!(p = (struct opttmplaxis *)realloc(sw->axis, (sw->naxis + 1)
+                                                * sizeof *sw->axis))) {
+            free(axis.vals);
+            return ENOMEM;
+        }
+        sw->axis = p;
+        sw->axis[sw->naxis++] = axis;
+    }
+    /* The last axis varies fastest */
+    for (k = sw->naxis; k--; ) {
+        sw->axis[k].stride = njob;
+        if (sw->axis[k].n > ULLONG_MAX / njob) {
+            return ERANGE;
+        }
+        njob *= sw->axis[k].n;
+    }
+    sw->njob = njob;
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_sweep_init(struct optsweep     *sw,
+                   struct optinfo      *info,
+                   const struct opttbl *tbl)
+{
+    struct opttmplrec rec;
+    int res;
+
+    memset(sw, 0, sizeof *sw);
+    if ((res = opt_tmpl_record(info, tbl, &rec))) {
+        return res;
+    }
+    sw->tbl = tbl;
+    sw->ev = rec.ev;
+    sw->nev = rec.nev;
+    sw->args = rec.args;
+    sw->nargs = rec.nargs;
+    if ((res = opt_tmpl_axes(sw))) {
+        opt_sweep_free(sw);
+        errno = res;
+        return -1;
+    }
+    return 0;
+}
+
+
+OPT_EXTERN_C
+const char *opt_sweep_value(struct optsweep *sw, unsigned long long job,
+                            unsigned axis)
+{
+    struct opttmplaxis *a;
+    unsigned long long i;
+
+    if (job >= sw->njob || axis >= sw->naxis) {
+        return NULL;
+    }
+    a = &sw->axis[axis];
+    i = job / a->stride % a->n;
+    if (a->vals) {
+        return a->vals[i];
+    }
+    /* Wraps as two's complement, and the range is within long long */
+    sprintf(a->num, "%lld",
+            (long long)((unsigned long long)a->from
+                        + i * (unsigned long long)a->step));
+    return a->num;
+}
+
+
+OPT_EXTERN_C
+int opt_sweep_run(struct optsweep *sw, unsigned long long job,
+                  struct optinfo *info)
+{
+    unsigned k;
+
+    if (job >= sw->njob) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (k = 0; k < sw->naxis; k++) {
+        sw->args[sw->axis[k].slot] = (char *)opt_sweep_value(sw, job, k);
+    }
+    return opt_tmpl_replay(info, sw->tbl, sw->ev, sw->nev, sw->args);
+}
+
+
+OPT_EXTERN_C
+void opt_sweep_free(struct optsweep *sw)
+{
+    unsigned k;
+
+    for (k = 0; k < sw->naxis; k++) {
+        free(sw->axis[k].vals);
+    }
+    free(sw->axis);
+    free(sw->ev);
+    free(sw->args);
+    memset(sw, 0, sizeof *sw);
+}
+
+
+
+/** @brief Length of the placeholder {} or {N} at @p p, setting @p val to
+ *      N, or zero if there is none */
+static size_t opt_tmpl_ph(const char *p, unsigned *val)
+{
+    const char *q = p + 1;
+    unsigned long n = 0;
+
+    if (*p != '{') {
+        return 0;
+    } else if (*q == '}') {
+        *val = 1;
+        return 2;
+    }
+    for (; *q >= '0' && *q <= '9' && n <= 65536; q++) {
+        n = n * 10 + (unsigned long)(*q - '0');
+    }
+    if (q == p + 1 || *q != '}' || !n || n > 65536) {
+        return 0;
+    }
+    *val = (unsigned)n;
+    return (size_t)(q - p) + 1;
+}
+
+
+/** @brief Add a piece to @p tmpl
+ *  @returns Zero, or ENOMEM
+ */
+static int opt_tmpl_part(struct opttmpl *tmpl, size_t *cap, const char *lit,
+                         size_t len, unsigned val)
+{
+    void *p;
+
+    if (tmpl->npart == *cap) {
+        *cap = *cap ? *cap * 2 : 16;
+        if (!(p = realloc(tmpl->part, *cap * sizeof *tmpl->part))) {
+            return ENOMEM;
+        }
+        tmpl->part = (struct opttmplpart *)p;
+    }
+    tmpl->part[tmpl->npart].lit = lit;
+    tmpl->part[tmpl->npart].len = len;
+    tmpl->part[tmpl->npart++].val = val;
+    if (val > tmpl->nval) {
+        tmpl->nval = val;
+    }
+    return 0;
+}
+
+
+/** @brief Split the recorded arguments with placeholders into pieces
+ *  @returns Zero, or ENOMEM
+ */
+static int opt_tmpl_holes(struct opttmpl *tmpl)
+{
+    size_t i, len, first, pcap = 0, hcap = 0;
+    const char *arg, *lit;
+    unsigned val;
+    void *p;
+
+    for (i = 0; i < tmpl->nargs; i++) {
+        first = tmpl->npart;
+        for (arg = lit = tmpl->args[i]; *arg; ) {
+            if (!(len = opt_tmpl_ph(arg, &val))) {
+                arg++;
+                continue;
+            }
+            if ((arg > lit && opt_tmpl_part(tmpl, &pcap, lit,
+                                            (size_t)(arg - lit), 0))
+             || opt_tmpl_part(tmpl, &pcap, NULL, 0, val)) {
+                return ENOMEM;
+            }
+            lit = arg += len;
+        }
+        if (tmpl->npart == first) {
+            continue;
+        }
+        if (arg > lit && opt_tmpl_part(tmpl, &pcap, lit,
+                                       (size_t)(arg - lit), 0)) {
+            return ENOMEM;
+        }
+        if (tmpl->nhole == hcap) {
+            hcap = hcap ? hcap * 2 : 16;
+            if (!(p = realloc(tmpl->hole, hcap * sizeof *tmpl->hole))) {
+                return ENOMEM;
+            }
+            tmpl->hole = (struct opttmplhole *)p;
+        }
+        tmpl->hole[tmpl->nhole].slot = i;
+        tmpl->hole[tmpl->nhole].part = first;
+        tmpl->hole[tmpl->nhole++].npart = (unsigned)(tmpl->npart - first);
+    }
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_tmpl_init(struct opttmpl      *tmpl,
+                  struct optinfo      *info,
+                  const struct opttbl *tbl)
+{
+    struct opttmplrec rec;
+    int res;
+
+    memset(tmpl, 0, sizeof *tmpl);
+    if ((res = opt_tmpl_record(info, tbl, &rec))) {
+        return res;
+    }
+    tmpl->tbl = tbl;
+    tmpl->ev = rec.ev;
+    tmpl->nev = rec.nev;
+    tmpl->args = rec.args;
+    tmpl->nargs = rec.nargs;
+    if ((res = opt_tmpl_holes(tmpl))) {
+        opt_tmpl_free(tmpl);
+        errno = res;
+        return -1;
+    }
+    return 0;
+}
+
+
+OPT_EXTERN_C
+int opt_tmpl_run(struct opttmpl *tmpl, char *vals[], unsigned nval,
+                 struct optinfo *info)
+{
+    const struct opttmplhole *hole;
+    const struct opttmplpart *part;
+    size_t i, len = 0;
+    unsigned j;
+    char *buf;
+
+    if (nval < tmpl->nval) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* Size the joined arguments first, so the buffer moves at most once */
+    for (i = 0; i < tmpl->nhole; i++) {
+        hole = &tmpl->hole[i];
+        part = &tmpl->part[hole->part];
+        if (hole->npart == 1) {
+            continue;
+        }
+        for (j = 0; j < hole->npart; j++) {
+            len += part[j].val ? strlen(vals[part[j].val - 1]) : part[j].len;
+        }
+        len++;
+    }
+    if (len > tmpl->buflen) {
+        if (!(buf = (char *)realloc(tmpl->buf, len))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        tmpl->buf = buf;
+        tmpl->buflen = len;
+    }
+    buf = tmpl->buf;
+    for (i = 0; i < tmpl->nhole; i++) {
+        hole = &tmpl->hole[i];
+        part = &tmpl->part[hole->part];
+        if (hole->npart == 1) {
+            tmpl->args[hole->slot] = vals[part->val - 1];
+            continue;
+        }
+        tmpl->args[hole->slot] = buf;
+        for (j = 0; j < hole->npart; j++) {
+            len = part[j].val ? strlen(vals[part[j].val - 1]) : part[j].len;
+            memcpy(buf, part[j].val ? vals[part[j].val - 1] : part[j].lit,
+                   len);
+            buf += len;
+        }
+        *buf++ = '\0';
+    }
+    return opt_tmpl_replay(info, tmpl->tbl, tmpl->ev, tmpl->nev, tmpl->args);
+}
+
+
+OPT_EXTERN_C
+void opt_tmpl_free(struct opttmpl *tmpl)
+{
+    free(tmpl->ev);
+    free(tmpl->args);
+    free(tmpl->hole);
+    free(tmpl->part);
+    free(tmpl->buf);
+    memset(tmpl, 0, sizeof *tmpl);
+}
+
+#endif /* OPT_IMPLEMENTATION */
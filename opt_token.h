@@ -0,0 +1,612 @@
+#pragma once
+/** @file opt_token.h split recorded shell command lines into argv.
+ *
+ *  #define OPT_IMPLEMENTATION to nonzero to enable the implementation.
+ *
+ *  opt_tok_cmd splits one simple command into words the way sh(1) would
+ *  before expansion, so a logged command line can be handed to opt_parse:
+ *
+ *  - ' quotes everything up to the next '
+ *  - " quotes everything up to the next unescaped ", and inside it \ only
+ *    escapes $ ` " \ and newline
+ *  - \ outside quotes escapes the next character, and \ newline is removed
+ *  - # at the start of a word starts a comment that runs to the newline
+ *  - an unquoted ; & | or newline ends the command (&& and || too)
+ *  - an unquoted < or > starts a redirection, which is dropped along with
+ *    its target word and any all-digit descriptor word just before it
+ *
+ *  Nothing is expanded: $VAR, `cmd` and globs are kept as written, and
+ *  ( ) { } are ordinary characters. That is what a log records, and what
+ *  the logged tool's option table should be matched against.
+ *
+ *  opt_tok_spans splits large inputs in the simpler gcc(1) @file syntax of
+ *  response files: words are separated by whitespace, ' and " quote, and
+ *  \ includes any character literally, in quotes or not. It finds words 64
+ *  bytes at a time with bitmasks rather than a byte at a time:
+ *
+ *  - the bytes of interest (\, ", ' and whitespace) become one bit each,
+ *    from SSE2 or AVX2 compares where available, else a plain loop
+ *  - escaped bytes are those after odd runs of \, found with an add whose
+ *    carry links one block to the next
+ *  - quoted bytes are the prefix XOR of the quotes, by carry-less multiply
+ *    (PCLMUL) or six shifts. A block with both kinds of quote in play walks
+ *    just its quotes, since ' is literal within " and " within '
+ *  - separators are the unescaped whitespace outside quotes, and words are
+ *    the runs between them
+ *
+ *  It gives each word's span, and flags the spans with no quote or \ in
+ *  them, which are usable as they are. opt_tok_unquote decodes the others,
+ *  in place if need be:
+ *
+ *  struct opttokspan span[256];
+ *  struct opttok tok = { 0 };
+ *
+ *  while ((n = opt_tok_spans(&tok, buf, len, span, 256))) {
+ *      for (i = 0; i < n; i++) {
+ *          w = buf + span[i].off;
+ *          w[span[i].flags & OPT_TOK_PLAIN ? span[i].len
+ *            : opt_tok_unquote(w, w, span[i].len)] = '\0';
+ *          ...
+ *      }
+ *  }
+ *
+ *  Every span returned ends before the bytes still to be read, so writing
+ *  over a returned span and the byte after it is safe (with one spare byte
+ *  after the buffer). #define OPT_TOK_SIMD to 0 for the plain loop.
+ *
+ *  This does not use any heap memory nor issue any stdio calls.
+ */
+#ifndef OPT_TOKEN_H
+#define OPT_TOKEN_H
+
+#include "opt.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus) && __cplusplus
+extern "C" {
+#endif
+
+
+/** @brief Split the first command of [@p p, @p end) into words
+ *  @param p
+ *      Start of the input
+ *  @param end
+ *      End of the input
+ *  @param out
+ *      Buffer for the NUL-terminated words, of at least @p end - @p p + 1
+ *      bytes. Words never take more room than their input
+ *  @param argv
+ *      Array of @p max + 1 pointers for the words. It is NULL-terminated
+ *  @param max
+ *      Most words to store
+ *  @param argc
+ *      The number of words in the command. If this is more than @p max,
+ *      the rest were counted but not stored, and a caller with room for them
+ *      can split the command again from the same @p p
+ *  @returns The position after the command and its terminator, which is
+ *      @p end after the last command
+ */
+const char *opt_tok_cmd(const char *p,
+                        const char *end,
+                        char       *out,
+                        char       *argv[],
+                        unsigned    max,
+                        unsigned   *argc);
+
+
+#define OPT_TOK_PLAIN   0x1 /* The span has no quote or \ to decode */
+
+#define OPT_TOK_MINSPAN 64  /* Spans a call to opt_tok_spans needs room for */
+
+
+/** @brief A word of the input */
+struct opttokspan {
+    size_t      off;    /* Its offset */
+    size_t      len;    /* Its length, as written */
+    unsigned    flags;  /* OPT_TOK_* */
+};
+
+
+/** @brief Progress of opt_tok_spans through an input. Zero it to start */
+struct opttok {
+    size_t              pos;    /* Bytes read, in whole blocks */
+
+    /* Private: the state between blocks */
+    unsigned long long  esc;    /* Whether the next byte is escaped */
+    unsigned long long  word;   /* Whether the last byte was in a word */
+    size_t              start;  /* The open word */
+    int                 dirty;  /* Whether it has quotes or escapes */
+    char                quote;  /* The open quote */
+};
+
+
+/** @brief Find the next words of @p len bytes at @p p, in gcc @@file syntax
+ *  @param tok
+ *      Progress, zeroed for the first call
+ *  @param p
+ *      Input, the same for every call
+ *  @param len
+ *      Its length
+ *  @param span
+ *      Buffer for the words
+ *  @param max
+ *      Its length, at least OPT_TOK_MINSPAN
+ *  @returns The number of words stored, zero when the input is done
+ */
+size_t opt_tok_spans(struct opttok     *tok,
+                     const char        *p,
+                     size_t             len,
+                     struct opttokspan  span[],
+                     size_t             max);
+
+
+/** @brief Decode the quotes and escapes of a word
+ *  @param out
+ *      Buffer of at least @p len bytes, which may be @p p
+ *  @param p
+ *      The word, as written
+ *  @param len
+ *      Its length
+ *  @returns The decoded length, which is never more than @p len
+ */
+size_t opt_tok_unquote(char *out, const char *p, size_t len);
+
+
+#if defined(__cplusplus) && __cplusplus
+}
+#endif
+
+#endif /* OPT_TOKEN_H */
+
+
+#if defined(OPT_IMPLEMENTATION) && OPT_IMPLEMENTATION
+
+/** @brief Tokenizer state between characters */
+enum opttokst {
+    OPT_TOK_SPACE,      /* Between words */
+    OPT_TOK_WORD,       /* In a word */
+    OPT_TOK_SQUOTE,     /* In '' */
+    OPT_TOK_DQUOTE,     /* In "" */
+    OPT_TOK_COMMENT     /* After # */
+};
+
+
+OPT_EXTERN_C
+const char *opt_tok_cmd(const char *p,
+                        const char *end,
+                        char       *out,
+                        char       *argv[],
+                        unsigned    max,
+                        unsigned   *argc)
+{
+    enum opttokst st = OPT_TOK_SPACE;
+    char *word = out, c;
+    unsigned n = 0;
+    int redir = 0, digits = 0;
+
+/* Finish the word in progress, dropping redirection targets */
+#define OPT_TOK_END()                       \
+    do {                                    \
+        *out++ = '\0';                      \
+        if (redir) {                        \
+            out = word;                     \
+            redir = 0;                      \
+        } else {                            \
+            if (n < max) {                  \
+                argv[n] = word;             \
+            }                               \
+            n++;                            \
+        }                                   \
+        word = out;                         \
+        st = OPT_TOK_SPACE;                 \
+    } while (0)
+
+    for (; p < end; p++) {
+        c = *p;
+        switch (st) {
+        case OPT_TOK_SQUOTE:
+            if (c == '\'') {
+                st = OPT_TOK_WORD;
+            } else {
+                *out++ = c;
+            }
+            continue;
+        case OPT_TOK_DQUOTE:
+            if (c == '"') {
+                st = OPT_TOK_WORD;
+            } else if (c == '\\' && p + 1 < end
+                    && (p[1] == '$' || p[1] == '`' || p[1] == '"'
+                     || p[1] == '\\' || p[1] == '\n')) {
+                if (*++p != '\n') {
+                    *out++ = *p;
+                }
+            } else {
+                *out++ = c;
+            }
+            continue;
+        case OPT_TOK_COMMENT:
+            if (c == '\n') {
+                p++;
+                goto done;
+            }
+            continue;
+        case OPT_TOK_SPACE:
+            if (c == '#') {
+                st = OPT_TOK_COMMENT;
+                continue;
+            }
+            digits = 1;
+            break;
+        case OPT_TOK_WORD:
+            break;
+        }
+        /* Unquoted, in or between words */
+        switch (c) {
+        case ' ':
+        case '\t':
+        case '\r':
+            if (st == OPT_TOK_WORD) {
+                OPT_TOK_END();
+            }
+            break;
+        case '\n':
+        case ';':
+        case '&':
+        case '|':
+            if (st == OPT_TOK_WORD) {
+                OPT_TOK_END();
+            }
+            p += p + 1 < end && (c == '&' || c == '|') && p[1] == c;
+            p++;
+            goto done;
+        case '<':
+        case '>':
+            /* 2>file: the descriptor is part of the redirection */
+            if (st == OPT_TOK_WORD && !digits) {
+                OPT_TOK_END();
+            }
+            out = word;
+            st = OPT_TOK_SPACE;
+            /* >>, <<, >&, <&, <> */
+            p += p + 1 < end && (p[1] == '>' || p[1] == '<' || p[1] == '&');
+            redir = 1;
+            break;
+        case '\\':
+            if (p + 1 < end && p[1] == '\n') {
+                p++;
+                break;
+            }
+            st = OPT_TOK_WORD;
+            digits = 0;
+            if (++p < end) {
+                *out++ = *p;
+            } else {
+                p--;
+            }
+            break;
+        case '\'':
+            st = OPT_TOK_SQUOTE;
+            digits = 0;
+            break;
+        case '"':
+            st = OPT_TOK_DQUOTE;
+            digits = 0;
+            break;
+        default:
+            st = OPT_TOK_WORD;
+            digits = digits && c >= '0' && c <= '9';
+            *out++ = c;
+            break;
+        }
+    }
+    /* An unterminated quote ends with the input */
+    if (st == OPT_TOK_WORD || st == OPT_TOK_SQUOTE || st == OPT_TOK_DQUOTE) {
+        OPT_TOK_END();
+    }
+done:
+#undef OPT_TOK_END
+    argv[n < max ? n : max] = (char *)0;
+    *argc = n;
+    return p;
+}
+
+
+/* Set default for OPT_TOK_SIMD: 2 for AVX2, 1 for SSE2, 0 for neither */
+#ifndef OPT_TOK_SIMD
+#   if defined(__AVX2__)
+#       define OPT_TOK_SIMD 2
+#   elif defined(__SSE2__) || defined(_M_X64)
+#       define OPT_TOK_SIMD 1
+#   else
+#       define OPT_TOK_SIMD 0
+#   endif
+#endif
+
+#if OPT_TOK_SIMD
+#   include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define opt_tok_ctz(x) __builtin_ctzll(x)
+#else
+/** @brief Trailing zero bits of nonzero @p x */
+static int opt_tok_ctz(unsigned long long x)
+{
+    int n = 0;
+
+    for (; !(x & 1); x >>= 1) {
+        n++;
+    }
+    return n;
+}
+#endif
+
+
+/** @brief One bit per byte of a 64-byte block */
+struct opttokmask {
+    unsigned long long bs;      /* \ */
+    unsigned long long dq;      /* " */
+    unsigned long long sq;      /* ' */
+    unsigned long long ws;      /* Whitespace: space and \t to \r */
+};
+
+
+/** @brief Classify the 64 bytes at @p p */
+static void opt_tok_masks(const unsigned char *p, struct opttokmask *m)
+{
+#if OPT_TOK_SIMD == 2
+    const __m256i bs = _mm256_set1_epi8('\\'), dq = _mm256_set1_epi8('"');
+    const __m256i sq = _mm256_set1_epi8('\''), sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t'), four = _mm256_set1_epi8(4);
+    __m256i v, t;
+    unsigned long long w;
+    int i;
+
+    m->bs = m->dq = m->sq = m->ws = 0;
+    for (i = 0; i < 64; i += 32) {
+        v = _mm256_loadu_si256((const __m256i *)(const void *)(p + i));
+        /* \t to \r: v - '\t' is at most 4, unsigned */
+        t = _mm256_sub_epi8(v, tab);
+        t = _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t);
+        t = _mm256_or_si256(t, _mm256_cmpeq_epi8(v, sp));
+        w = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, bs));
+        m->bs |= w << i;
+        w = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, dq));
+        m->dq |= w << i;
+        w = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, sq));
+        m->sq |= w << i;
+        w = (unsigned)_mm256_movemask_epi8(t);
+        m->ws |= w << i;
+    }
+#elif OPT_TOK_SIMD == 1
+    const __m128i bs = _mm_set1_epi8('\\'), dq = _mm_set1_epi8('"');
+    const __m128i sq = _mm_set1_epi8('\''), sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t'), four = _mm_set1_epi8(4);
+    __m128i v, t;
+    unsigned long long w;
+    int i;
+
+    m->bs = m->dq = m->sq = m->ws = 0;
+    for (i = 0; i < 64; i += 16) {
+        v = _mm_loadu_si128((const __m128i *)(const void *)(p + i));
+        /* \t to \r: v - '\t' is at most 4, unsigned */
+        t = _mm_sub_epi8(v, tab);
+        t = _mm_cmpeq_epi8(_mm_min_epu8(t, four), t);
+        t = _mm_or_si128(t, _mm_cmpeq_epi8(v, sp));
+        w = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, bs));
+        m->bs |= w << i;
+        w = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dq));
+        m->dq |= w << i;
+        w = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, sq));
+        m->sq |= w << i;
+        w = (unsigned)_mm_movemask_epi8(t);
+        m->ws |= w << i;
+    }
+#else
+    /* Which mask each byte goes in, with 4 for none */
+    static const unsigned char cls[256] = {
+        4,4,4,4,4,4,4,4,4,3,3,3,3,3,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+        3,4,1,4,4,4,4,2,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+        4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,0,4,4,4,
+        4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+        4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+        4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+        4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+        4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4
+    };
+    unsigned long long b[5] = { 0, 0, 0, 0, 0 };
+    int i;
+
+    for (i = 0; i < 64; i++) {
+        b[cls[p[i]]] |= 1ull << i;
+    }
+    m->bs = b[0];
+    m->dq = b[1];
+    m->sq = b[2];
+    m->ws = b[3];
+#endif
+}
+
+
+/** @brief Each bit the XOR of itself and all the bits below it */
+static unsigned long long opt_tok_prefix_xor(unsigned long long x)
+{
+#if OPT_TOK_SIMD && defined(__PCLMUL__)
+    /* A carry-less multiply by all ones */
+    return (unsigned long long)_mm_cvtsi128_si64(
+        _mm_clmulepi64_si128(_mm_set_epi64x(0, (long long)x),
+                             _mm_set1_epi8(-1), 0));
+#else
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+#endif
+}
+
+
+/** @brief Bits @p from to @p to - 1 */
+static unsigned long long opt_tok_range(unsigned from, unsigned to)
+{
+    return (to < 64 ? (1ull << to) - 1 : ~0ull) & ~((1ull << from) - 1);
+}
+
+
+/** @brief The bytes escaped by \, given the bits of \ and whether the first
+ *      byte is escaped, which is updated for the next block. Runs of \
+ *      escape every other byte, so the odd runs escape the byte after them.
+ *      Adding the starts of the runs at odd bits to the runs carries through
+ *      each of those runs, which flips the parity of what it escapes
+ */
+static unsigned long long opt_tok_escaped(unsigned long long *carry,
+                                          unsigned long long  bs)
+{
+    const unsigned long long even = 0x5555555555555555ull;
+    unsigned long long follows, odd, seq;
+
+    bs &= ~*carry;
+    follows = bs << 1 | *carry;
+    odd = bs & ~even & ~follows;
+    seq = odd + bs;
+    *carry = seq < bs;
+    return (even ^ seq << 1) & follows;
+}
+
+
+/** @brief The bytes within quotes, given the unescaped quotes */
+static unsigned long long opt_tok_quoted(struct opttok     *tok,
+                                         unsigned long long dq,
+                                         unsigned long long sq)
+{
+    unsigned long long inq = 0, q, bit;
+    unsigned from = 0, i;
+
+    /* One kind of quote in play: each quote opens or closes */
+    if (!sq && tok->quote != '\'') {
+        inq = opt_tok_prefix_xor(dq) ^ (tok->quote ? ~0ull : 0);
+        tok->quote = inq >> 63 ? '"' : '\0';
+        return inq;
+    } else if (!dq && tok->quote != '"') {
+        inq = opt_tok_prefix_xor(sq) ^ (tok->quote ? ~0ull : 0);
+        tok->quote = inq >> 63 ? '\'' : '\0';
+        return inq;
+    }
+    /* Both: walk the quotes, in which the other kind is literal */
+    for (q = dq | sq; q; q &= q - 1) {
+        i = (unsigned)opt_tok_ctz(q);
+        bit = q & (0ull - q);
+        if (!tok->quote) {
+            tok->quote = dq & bit ? '"' : '\'';
+            from = i;
+        } else if ((tok->quote == '"') == !!(dq & bit)) {
+            inq |= opt_tok_range(from, i);
+            tok->quote = '\0';
+        }
+    }
+    return tok->quote ? inq | opt_tok_range(from, 64) : inq;
+}
+
+
+OPT_EXTERN_C
+size_t opt_tok_spans(struct opttok     *tok,
+                     const char        *p,
+                     size_t             len,
+                     struct opttokspan  span[],
+                     size_t             max)
+{
+    unsigned long long esc, word, special, start, end, prev, valid;
+    unsigned char tail[64];
+    struct opttokmask m;
+    size_t base, n = 0;
+    unsigned i, from;
+
+    /* A block ends at most 32 words, and the input one more */
+    while (tok->pos < len && max - n > 32) {
+        base = tok->pos;
+        valid = ~0ull;
+        if (len - base >= 64) {
+            opt_tok_masks((const unsigned char *)p + base, &m);
+            tok->pos += 64;
+        } else {
+            memset(tail, ' ', sizeof tail);
+            memcpy(tail, p + base, len - base);
+            opt_tok_masks(tail, &m);
+            valid = opt_tok_range(0, (unsigned)(len - base));
+            tok->pos = len;
+        }
+        esc = opt_tok_escaped(&tok->esc, m.bs);
+        word = ~(m.ws & ~esc & ~opt_tok_quoted(tok, m.dq & ~esc, m.sq & ~esc))
+             & valid;
+        special = m.bs | m.dq | m.sq;
+        prev = word << 1 | tok->word;
+        start = word & ~prev;
+        end = ~word & prev;
+        tok->word = word >> 63;
+        /* Starts and ends alternate. The first end closes the word that went
+         * on from before, if any, and the others the start before them */
+        if (prev & 1 && end) {
+            i = (unsigned)opt_tok_ctz(end);
+            end &= end - 1;
+            span[n].off = tok->start;
+            span[n].len = base + i - tok->start;
+            span[n++].flags = tok->dirty || special & opt_tok_range(0, i)
+                            ? 0 : OPT_TOK_PLAIN;
+        }
+        for (; end; end &= end - 1, start &= start - 1) {
+            from = (unsigned)opt_tok_ctz(start);
+            i = (unsigned)opt_tok_ctz(end);
+            span[n].off = base + from;
+            span[n].len = i - from;
+            span[n++].flags = special & opt_tok_range(from, i)
+                            ? 0 : OPT_TOK_PLAIN;
+        }
+        /* A word left open, new or not */
+        if (start) {
+            from = (unsigned)opt_tok_ctz(start);
+            tok->start = base + from;
+            tok->dirty = !!(special & opt_tok_range(from, 64));
+        } else if (tok->word) {
+            tok->dirty |= !!special;
+        }
+    }
+    /* The last word ends with the input */
+    if (tok->pos >= len && tok->word && n < max) {
+        span[n].off = tok->start;
+        span[n].len = len - tok->start;
+        span[n++].flags = tok->dirty ? 0 : OPT_TOK_PLAIN;
+        tok->word = 0;
+    }
+    return n;
+}
+
+
+OPT_EXTERN_C
+size_t opt_tok_unquote(char *out, const char *p, size_t len)
+{
+    const char *end = p + len;
+    char *w = out, quote = '\0';
+
+    while (p < end) {
+        if (*p == '\\' && p + 1 < end) {
+            *w++ = p[1];
+            p += 2;
+        } else if (quote) {
+            quote = *p == quote ? '\0' : quote;
+            if (quote) {
+                *w++ = *p;
+            }
+            p++;
+        } else if (*p == '\'' || *p == '"') {
+            quote = *p++;
+        } else {
+            *w++ = *p++;
+        }
+    }
+    return (size_t)(w - out);
+}
+
+#endif /* OPT_IMPLEMENTATION */
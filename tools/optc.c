@@ -0,0 +1,54 @@
+/** @file optc.c thin client for tools served by opt_serve.
+ *
+ *      cc -O2 -o optc tools/optc.c
+ *      ln -s optc tool
+ *      ./tool ARG...
+ *
+ *  The client connects to the server for its own name (see opt_srv_path, the
+ *  socket can be overridden with $OPT_SERVER), forwards its argv, working
+ *  directory, environment and standard descriptors, and exits with the
+ *  status of the request.
+ *
+ *  If the server cannot be reached and $OPT_SERVER_FALLBACK names an
+ *  executable, the client execs that instead with the same arguments, so a
+ *  tool keeps working while its server is down. A request that reached the
+ *  server but lost its status is not run again: the client exits with 127.
+ */
+#define _GNU_SOURCE 1
+
+#define OPT_IMPLEMENTATION 1
+#include "../opt_server.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+int main(int argc, char *argv[])
+{
+    const char *fallback = getenv("OPT_SERVER_FALLBACK");
+    char path[OPT_SRV_PATH_MAX];
+    int res;
+
+    if (opt_srv_path(path, sizeof path, argv[0])) {
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+        return 127;
+    }
+    res = opt_srv_call(path, argc, argv);
+    if (res >= 0) {
+        return res;
+    }
+    if (res == -2) {
+        /* It may have run, so neither retry nor fall back */
+        fprintf(stderr, "%s: %s: no status for the request: %s\n", argv[0],
+                path, strerror(errno));
+        return 127;
+    }
+    if (fallback && *fallback) {
+        execv(fallback, argv);
+    }
+    fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+    return 127;
+}
@@ -0,0 +1,262 @@
+/** @file optgen.c generate a sorted struct opttbl as constant data.
+ *
+ *  opt_parse sorts its table on every call. With a generated table there is no
+ *  sort, no stack buffers and, with OPT_FREESTANDING, no C library at all: the
+ *  index is emitted as const arrays of pointers into your option table, which
+ *  live in .rodata (or .data.rel.ro, in position-independent executables).
+ *
+ *  Put the option table in a header of its own, with prototypes for its
+ *  callbacks, e.g. tool_opts.h:
+ *
+ *      static const struct optspec tool_opts[] = { ... };
+ *
+ *  Then build the generator against it and run it:
+ *
+ *      cc -DOPTGEN_TABLE='"tool_opts.h"' -DOPTGEN_NAME=tool_opts \
+ *         -Wl,--unresolved-symbols=ignore-all -o optgen tools/optgen.c
+ *      ./optgen > tool_opts_tbl.h
+ *
+ *  The callbacks are never called, so the linker may leave them unresolved as
+ *  above. This defines tool_opts_tbl, for use in the tool as:
+ *
+ *      #include "tool_opts.h"
+ *      #include "tool_opts_tbl.h"
+ *      ...
+ *      opt_parse_tbl(&info, &tool_opts_tbl);
+ *
+ *  Regenerate whenever the table changes. opt_tbl_check will catch a stale
+ *  index in a test.
+ *
+ *  If the header also has a struct opthelp array for the table (see
+ *  opt_help.h), add -DOPTGEN_HELP=its_name to emit the formatted help as
+ *  tool_opts_help_text, ready for write(2) with its length
+ *  tool_opts_help_len. -DOPTGEN_HELP_WIDTH=N reflows it to N columns.
+ *
+ *  For a grammar (see opt_grammar.h), define -DOPTGEN_GRAMMAR=its_name
+ *  instead of, or as well as, OPTGEN_NAME. This emits the compiled automaton
+ *  as its_name_gram, for opt_gram_parse(&its_name_gram, ...). Its edges
+ *  refer to option names through string literals, and to options and slots
+ *  through the grammar itself.
+ */
+#define OPT_IMPLEMENTATION 1
+#include "../opt.h"
+#include "../opt_grammar.h"
+#include "../opt_help.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef OPTGEN_TABLE
+#   error "Define OPTGEN_TABLE as the quoted name of the table's header"
+#endif
+#if !defined(OPTGEN_NAME) && !defined(OPTGEN_GRAMMAR)
+#   error "Define OPTGEN_NAME as the name of the table"
+#endif
+
+#include OPTGEN_TABLE
+
+#ifndef OPTGEN_HELP_WIDTH
+#   define OPTGEN_HELP_WIDTH 0
+#endif
+
+#define OPTGEN_STR2(x) #x
+#define OPTGEN_STR(x) OPTGEN_STR2(x)
+
+
+#ifdef OPTGEN_NAME
+/** @brief Write one sorted index as a const array, or a null pointer macro if
+ *      it is empty (C has no empty arrays) */
+static void emit_index(const char                  *name,
+                       const char                  *kind,
+                       const struct opttbl         *tbl,
+                       const struct optspec *const *idx,
+                       unsigned                     n)
+{
+    unsigned i;
+
+    if (!n) {
+        printf("#define %s_%s ((const struct optspec *const *)0)\n\n",
+               name, kind);
+        return;
+    }
+    printf("static const struct optspec *const %s_%s[] = {\n", name, kind);
+    for (i = 0; i < n; i++) {
+        printf("    &%s[%u]%s", name, (unsigned)(idx[i] - tbl->opts),
+               i + 1 < n ? "," : " ");
+        if (idx == tbl->shrt) {
+            printf("    /* -%c */\n", idx[i]->shrt);
+        } else if (!strstr(idx[i]->lng, "*/")) {
+            printf("    /* --%s */\n", idx[i]->lng);
+        } else {
+            printf("\n");
+        }
+    }
+    printf("};\n\n");
+}
+#endif
+
+
+#ifdef OPTGEN_HELP
+/* The help table must run parallel to the option table */
+typedef char optgen_help_check[sizeof OPTGEN_HELP / sizeof *OPTGEN_HELP
+                               == sizeof OPTGEN_NAME / sizeof *OPTGEN_NAME
+                               ? 1 : -1];
+
+
+/** @brief Write the formatted help as a string literal, a line at a time */
+static int emit_help(const char *name, const struct optspec *opts,
+                     unsigned nopt)
+{
+    size_t len, i;
+    char *text;
+
+    len = opt_help_format(NULL, 0, nopt, opts, OPTGEN_HELP, OPTGEN_HELP_WIDTH);
+    if (!(text = (char *)malloc(len + 1))) {
+        return -1;
+    }
+    opt_help_format(text, len + 1, nopt, opts, OPTGEN_HELP, OPTGEN_HELP_WIDTH);
+    printf("#define %s_help_len %lu\n\n", name, (unsigned long)len);
+    printf("static const char %s_help_text[] =\n    \"", name);
+    for (i = 0; i < len; i++) {
+        switch (text[i]) {
+        case '\n':
+            printf(i + 1 < len ? "\\n\"\n    \"" : "\\n");
+            break;
+        case '"':
+        case '\\':
+            printf("\\%c", text[i]);
+            break;
+        default:
+            if ((unsigned char)text[i] < 0x20) {
+                printf("\\%03o", (unsigned char)text[i]);
+            } else {
+                putchar(text[i]);
+            }
+            break;
+        }
+    }
+    printf("\";\n");
+    free(text);
+    return 0;
+}
+#endif
+
+
+#ifdef OPTGEN_GRAMMAR
+/** @brief Write @p str as a string literal, or a null pointer */
+static void emit_str(const char *str)
+{
+    if (!str) {
+        printf("0");
+        return;
+    }
+    putchar('"');
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            printf("\\%c", *str);
+        } else if ((unsigned char)*str < 0x20) {
+            printf("\\%03o", (unsigned char)*str);
+        } else {
+            putchar(*str);
+        }
+    }
+    putchar('"');
+}
+
+
+/** @brief Write the grammar's compiled states and edges */
+static int emit_grammar(void)
+{
+    const char *name = OPTGEN_STR(OPTGEN_GRAMMAR);
+    const unsigned ncmd = sizeof OPTGEN_GRAMMAR / sizeof *OPTGEN_GRAMMAR;
+    const struct optgedge *e;
+    struct optgstate *states;
+    struct optgedge *edges;
+    struct optgram gram;
+    unsigned i, res;
+
+    states = (struct optgstate *)calloc(ncmd, sizeof *states);
+    edges = (struct optgedge *)calloc(opt_gram_nedge(ncmd, OPTGEN_GRAMMAR),
+                                      sizeof *edges);
+    if (!states || !edges) {
+        return -1;
+    }
+    if ((res = opt_gram_compile(&gram, ncmd, OPTGEN_GRAMMAR, states,
+                                edges))) {
+        fprintf(stderr, "optgen: %s[%u]: bad parent or repeated name\n",
+                name, res - 1);
+        return -1;
+    }
+    printf("static const struct optgstate %s_states[] = {\n", name);
+    for (i = 0; i < ncmd; i++) {
+        printf("    { %u, %u, %u, %u }%s\n", states[i].edge, states[i].nshrt,
+               states[i].nlng, states[i].nsub, i + 1 < ncmd ? "," : "");
+    }
+    printf("};\n\n");
+    /* With the terminator, so that it is never empty */
+    printf("static const struct optgedge %s_edges[] = {\n", name);
+    for (i = 0; i <= gram.nedge; i++) {
+        e = &edges[i];
+        printf("    { ");
+        emit_str(e->lng);
+        if (opt_gram_isgraph(e->shrt) && e->shrt != '\'' && e->shrt != '\\') {
+            printf(", '%c', %u, %u }", e->shrt, e->cmd, e->idx);
+        } else {
+            printf(", %d, %u, %u }", e->shrt, e->cmd, e->idx);
+        }
+        printf("%s\n", i < gram.nedge ? "," : "");
+    }
+    printf("};\n\n");
+    printf("static const struct optgram %s_gram = {\n", name);
+    printf("    %u, %u, %u, %s, %s_states, %s_edges\n", gram.ncmd, gram.nedge,
+           gram.maxslot, name, name, name);
+    printf("};\n");
+    free(states);
+    free(edges);
+    return 0;
+}
+#endif
+
+
+int main(void)
+{
+#ifdef OPTGEN_NAME
+    const char *name = OPTGEN_STR(OPTGEN_NAME);
+    const unsigned nopt = sizeof OPTGEN_NAME / sizeof *OPTGEN_NAME;
+    const struct optspec **shrt, **lng;
+    struct opttbl tbl;
+
+    shrt = (const struct optspec **)calloc(nopt + 1, sizeof *shrt);
+    lng = (const struct optspec **)calloc(nopt + 1, sizeof *lng);
+    if (!shrt || !lng) {
+        return EXIT_FAILURE;
+    }
+    opt_tbl_init(&tbl, nopt, OPTGEN_NAME, shrt, lng);
+#endif
+    printf("/* Generated by optgen from %s: do not edit */\n\n",
+           OPTGEN_TABLE);
+#ifdef OPTGEN_NAME
+    emit_index(name, "shrt", &tbl, tbl.shrt, tbl.nshrt);
+    emit_index(name, "lng", &tbl, tbl.lng, tbl.nlng);
+    printf("static const struct opttbl %s_tbl = {\n", name);
+    printf("    %u, %u, %u, %s, %s_shrt, %s_lng\n", tbl.nopt, tbl.nshrt,
+           tbl.nlng, name, name, name);
+    printf("};\n");
+#ifdef OPTGEN_HELP
+    printf("\n");
+    if (emit_help(name, OPTGEN_NAME, nopt)) {
+        return EXIT_FAILURE;
+    }
+#endif
+#endif
+#ifdef OPTGEN_GRAMMAR
+#ifdef OPTGEN_NAME
+    printf("\n");
+#endif
+    if (emit_grammar()) {
+        return EXIT_FAILURE;
+    }
+#endif
+    return ferror(stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
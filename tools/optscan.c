@@ -0,0 +1,258 @@
+/** @file optscan.c audit the options of running processes.
+ *
+ *  Put the registry in a header of its own, with the option tables of the
+ *  tools to look for (their callbacks are never called), e.g. fleet.h:
+ *
+ *      static unsigned long make_hist[sizeof make_opts / sizeof *make_opts
+ *                                     + 2];
+ *      static struct optscanent optscan_ents[] = {
+ *          { "make", sizeof make_opts / sizeof *make_opts, make_opts,
+ *            make_hist },
+ *          ...
+ *      };
+ *
+ *  Then build and run it:
+ *
+ *      cc -O2 -pthread -DOPTSCAN_TABLE='"fleet.h"' \
+ *         -Wl,--unresolved-symbols=ignore-all -o optscan tools/optscan.c
+ *      ./optscan [-j THREADS] [-r REPEAT] [-e]
+ *
+ *  By default one JSON line is written per option with a nonzero count in
+ *  some entry's histogram, followed by a summary line with the scan time.
+ *  With -e, one JSON line is written per matching process instead. With -r,
+ *  the host is scanned REPEAT times and the summary reports the median and
+ *  fastest scan.
+ */
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define OPT_IMPLEMENTATION 1
+#include "../opt_scan.h"
+
+#ifndef OPTSCAN_TABLE
+#   error "Define OPTSCAN_TABLE as the quoted name of the registry's header"
+#endif
+
+#include OPTSCAN_TABLE
+
+#define OPTSCAN_NENT (sizeof optscan_ents / sizeof *optscan_ents)
+
+
+/** @brief Command line of the scanner itself */
+static struct {
+    unsigned      nthread;
+    unsigned long repeat;
+    int           events;
+} cfg = { 0, 1, 0 };
+
+
+/** @brief Monotonic time in ns */
+static unsigned long long now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull
+         + (unsigned long long)ts.tv_nsec;
+}
+
+
+/** @brief Write @p pfx and @p str as a JSON string */
+static void json_str(const char *pfx, const char *str)
+{
+    const unsigned char *p = (const unsigned char *)str;
+
+    putchar_unlocked('"');
+    fputs(pfx, stdout);
+    for (; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            putchar_unlocked('\\');
+            putchar_unlocked(*p);
+        } else if (*p < 0x20) {
+            printf("\\u%04x", *p);
+        } else {
+            putchar_unlocked(*p);
+        }
+    }
+    putchar_unlocked('"');
+}
+
+
+/** @brief Write the name of an option as a JSON string */
+static void json_opt(char shrt, const char *lng)
+{
+    char str[2] = { 0 };
+
+    str[0] = shrt;
+    if (lng) {
+        json_str("--", lng);
+    } else {
+        json_str("-", str);
+    }
+}
+
+
+/** @brief Per-process event: one JSON line, written whole */
+static void scan_event(const struct optscanproc *proc, void *data)
+{
+    const struct optscanent *ent = &optscan_ents[proc->ent];
+    const struct optscanhit *hit;
+    unsigned i, j;
+
+    (void)data;
+    flockfile(stdout);
+    printf("{\"pid\":%ld,\"tool\":", proc->pid);
+    json_str("", ent->name);
+    fputs(",\"opts\":[", stdout);
+    for (i = 0; i < proc->nhit; i++) {
+        hit = &proc->hits[i];
+        fputs(i ? ",{\"opt\":" : "{\"opt\":", stdout);
+        if (hit->idx >= 0) {
+            json_opt(ent->opts[hit->idx].shrt, ent->opts[hit->idx].lng);
+        } else {
+            json_opt(hit->shrt, hit->lng);
+            fputs(",\"unknown\":true", stdout);
+        }
+        for (j = 0; j < hit->count; j++) {
+            fputs(j ? "," : ",\"args\":[", stdout);
+            json_str("", hit->args[j]);
+        }
+        fputs(hit->count ? "]}" : "}", stdout);
+    }
+    printf("],\"positional\":%u}\n", proc->npos);
+    funlockfile(stdout);
+}
+
+
+static int cfg_threads(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    if (count) {
+        cfg.nthread = (unsigned)strtoul(args[0], NULL, 10);
+    }
+    return !count;
+}
+
+
+static int cfg_repeat(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    if (count) {
+        cfg.repeat = strtoul(args[0], NULL, 10);
+    }
+    return !count || !cfg.repeat;
+}
+
+
+static int cfg_events(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)count;
+    (void)args;
+    (void)data;
+    cfg.events = 1;
+    return 0;
+}
+
+
+static int cfg_error(int type, char shrt, char *lng, void *data)
+{
+    (void)data;
+    if (type) {
+        fprintf(stderr, "optscan: unknown option --%s\n", lng);
+    } else {
+        fprintf(stderr, "optscan: unknown option -%c\n", shrt);
+    }
+    return 1;
+}
+
+
+static int cfg_positional(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)args;
+    (void)data;
+    return count != 0;
+}
+
+
+static const struct optspec cfg_opts[] = {
+    { 'j', "threads", 1, cfg_threads },
+    { 'r', "repeat",  1, cfg_repeat  },
+    { 'e', "events",  0, cfg_events  }
+};
+
+
+static int ull_cmp(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct optinfo info = {
+        0, NULL, OPT_FIRST_SKIP, OPT_END_ALLOW, cfg_error, cfg_positional, NULL
+    };
+    struct optscan scan;
+    unsigned long long *lat;
+    unsigned long r;
+    unsigned e, i;
+
+    info.argc = argc;
+    info.argv = argv;
+    if (opt_parse(&info, sizeof cfg_opts / sizeof *cfg_opts, cfg_opts)) {
+        fprintf(stderr, "usage: %s [-j THREADS] [-r REPEAT] [-e]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!(lat = (unsigned long long *)calloc(cfg.repeat, sizeof *lat))) {
+        return EXIT_FAILURE;
+    }
+    memset(&scan, 0, sizeof scan);
+    scan.nent = OPTSCAN_NENT;
+    scan.ents = optscan_ents;
+    scan.nthread = cfg.nthread;
+    scan.func = cfg.events ? scan_event : NULL;
+    for (r = 0; r < cfg.repeat; r++) {
+        lat[r] = now();
+        if (opt_scan(&scan)) {
+            perror("optscan");
+            return EXIT_FAILURE;
+        }
+        lat[r] = now() - lat[r];
+    }
+    for (e = 0; !cfg.events && e < OPTSCAN_NENT; e++) {
+        for (i = 0; optscan_ents[e].hist && i <= optscan_ents[e].nopt; i++) {
+            if (!optscan_ents[e].hist[i]) {
+                continue;
+            }
+            fputs("{\"tool\":", stdout);
+            json_str("", optscan_ents[e].name);
+            fputs(",\"opt\":", stdout);
+            if (i < optscan_ents[e].nopt) {
+                json_opt(optscan_ents[e].opts[i].shrt,
+                         optscan_ents[e].opts[i].lng);
+            } else {
+                fputs("null", stdout);
+            }
+            printf(",\"count\":%lu,\"procs\":%lu}\n", optscan_ents[e].hist[i],
+                   optscan_ents[e].hist[optscan_ents[e].nopt + 1]);
+        }
+    }
+    qsort(lat, cfg.repeat, sizeof *lat, ull_cmp);
+    printf("{\"scans\":%lu,\"procs\":%lu,\"matched\":%lu,\"p50_us\":%.1f"
+           ",\"min_us\":%.1f}\n", cfg.repeat, scan.nproc / cfg.repeat,
+           scan.nmatch / cfg.repeat, lat[(cfg.repeat - 1) / 2] / 1e3,
+           lat[0] / 1e3);
+    free(lat);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,352 @@
+/** @file optstat.c option usage statistics from command logs.
+ *
+ *  Put the tool's option table in a header of its own, e.g. make_opts.h:
+ *
+ *      #define OPTSTAT_NAME "make"
+ *      static const struct optspec optstat_opts[] = { ... };
+ *
+ *  Leave OPTSTAT_NAME undefined to count every command against the table.
+ *  Then build and run it:
+ *
+ *      cc -O2 -pthread -DOPTSTAT_TABLE='"make_opts.h"' \
+ *         -Wl,--unresolved-symbols=ignore-all -o optstat tools/optstat.c
+ *      ./optstat [-j THREADS] [-k TOPK] [-w WIDTH] [-p PAIRS] [-o PREFIX] \
+ *                LOG...
+ *
+ *  Each LOG is mapped and counted with opt_ls_run. The output is JSON lines:
+ *  one per option used, with its count and most frequent values, then the
+ *  PAIRS (default 10) options most often used together, then a summary with
+ *  the throughput overall and per thread.
+ *
+ *  With -o, every value is also kept in columns (see opt_logstat.h), which
+ *  are written as raw native-endian arrays to PREFIX.line (uint64),
+ *  PREFIX.opt and PREFIX.arg (int32), PREFIX.off (int64, one more than the
+ *  rows) and PREFIX.val (bytes), e.g. for numpy.fromfile. Lines count from
+ *  zero across all the LOGs.
+ */
+#define _GNU_SOURCE 1
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OPT_IMPLEMENTATION 1
+#include "../opt_logstat.h"
+
+#ifndef OPTSTAT_TABLE
+#   error "Define OPTSTAT_TABLE as the quoted name of the table's header"
+#endif
+
+#include OPTSTAT_TABLE
+
+#ifndef OPTSTAT_NAME
+#   define OPTSTAT_NAME NULL
+#endif
+
+#define OPTSTAT_NOPT (sizeof optstat_opts / sizeof *optstat_opts)
+
+
+/** @brief Command line of the tool itself */
+static struct {
+    struct optlsconf conf;
+    unsigned         npair;
+    const char      *prefix;
+    unsigned         nlog;
+    char           **log;
+} cfg = {
+    { OPTSTAT_NAME, OPTSTAT_NOPT, optstat_opts, 0, 0, 0, 0 }, 10, NULL, 0, NULL
+};
+
+
+/** @brief Monotonic time in ns */
+static unsigned long long now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull
+         + (unsigned long long)ts.tv_nsec;
+}
+
+
+/** @brief Write @p pfx and @p str as a JSON string */
+static void json_str(const char *pfx, const char *str)
+{
+    const unsigned char *p = (const unsigned char *)str;
+
+    putchar('"');
+    fputs(pfx, stdout);
+    for (; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            putchar('\\');
+            putchar(*p);
+        } else if (*p < 0x20) {
+            printf("\\u%04x", *p);
+        } else {
+            putchar(*p);
+        }
+    }
+    putchar('"');
+}
+
+
+/** @brief Write the name of option @p idx as a JSON string */
+static void json_opt(unsigned idx)
+{
+    char str[2] = { 0 };
+
+    str[0] = optstat_opts[idx].shrt;
+    if (optstat_opts[idx].lng) {
+        json_str("--", optstat_opts[idx].lng);
+    } else {
+        json_str("-", str);
+    }
+}
+
+
+/** @brief Map and count one log */
+static int count_log(struct optlsstat *st, const char *path)
+{
+    struct stat sb;
+    void *map;
+    int fd, res;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &sb)) {
+        return -1;
+    }
+    if (!sb.st_size) {
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    madvise(map, (size_t)sb.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+    res = opt_ls_run(st, (const char *)map, (size_t)sb.st_size);
+    munmap(map, (size_t)sb.st_size);
+    return res;
+}
+
+
+/** @brief Write the options most often used together */
+static void report_pairs(const struct optlsstat *st)
+{
+    unsigned long long best, *co = st->co;
+    unsigned n, i, j, bi = 0, bj = 0, nopt = st->nopt;
+    unsigned long long *used;
+
+    if (!(used = (unsigned long long *)calloc((size_t)nopt * nopt + 1,
+                                              sizeof *used))) {
+        return;
+    }
+    for (n = 0; n < cfg.npair; n++) {
+        best = 0;
+        for (i = 0; i < nopt; i++) {
+            for (j = i + 1; j < nopt; j++) {
+                if (co[i * nopt + j] > best && !used[i * nopt + j]) {
+                    best = co[i * nopt + j];
+                    bi = i;
+                    bj = j;
+                }
+            }
+        }
+        if (!best) {
+            break;
+        }
+        used[bi * nopt + bj] = 1;
+        fputs("{\"pair\":[", stdout);
+        json_opt(bi);
+        putchar(',');
+        json_opt(bj);
+        printf("],\"cmds\":%llu,\"support\":%.4f}\n", best,
+               st->cmds ? (double)best / st->cmds : 0.0);
+    }
+    free(used);
+}
+
+
+/** @brief Write @p n elements of @p size bytes to PREFIX.@p ext */
+static int write_col(const char *ext, const void *col, size_t size, size_t n)
+{
+    char path[4096];
+    FILE *fp;
+    int res;
+
+    snprintf(path, sizeof path, "%s.%s", cfg.prefix, ext);
+    if (!(fp = fopen(path, "wb"))) {
+        return -1;
+    }
+    res = n && fwrite(col, size, n, fp) != n;
+    return fclose(fp) | res ? -1 : 0;
+}
+
+
+/** @brief Write the columns */
+static int write_cols(const struct optlscols *c)
+{
+    static const long long none = 0;
+
+    return write_col("line", c->line, sizeof *c->line, c->n)
+         | write_col("opt", c->opt, sizeof *c->opt, c->n)
+         | write_col("arg", c->arg, sizeof *c->arg, c->n)
+         | write_col("off", c->off ? c->off : &none, sizeof *c->off, c->n + 1)
+         | write_col("val", c->val, 1, c->n ? (size_t)c->off[c->n] : 0);
+}
+
+
+static int cfg_uint(unsigned *dst, unsigned count, char *args[])
+{
+    if (count) {
+        *dst = (unsigned)strtoul(args[0], NULL, 10);
+    }
+    return !count;
+}
+
+
+static int cfg_threads(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    return cfg_uint(&cfg.conf.nthread, count, args);
+}
+
+
+static int cfg_topk(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    return cfg_uint(&cfg.conf.topk, count, args);
+}
+
+
+static int cfg_width(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    return cfg_uint(&cfg.conf.width, count, args);
+}
+
+
+static int cfg_pairs(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    return cfg_uint(&cfg.npair, count, args);
+}
+
+
+static int cfg_prefix(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    if (count) {
+        cfg.prefix = args[0];
+        cfg.conf.flags |= OPT_LS_COLS;
+    }
+    return !count;
+}
+
+
+static int cfg_error(int type, char shrt, char *lng, void *data)
+{
+    (void)data;
+    if (type) {
+        fprintf(stderr, "optstat: unknown option --%s\n", lng);
+    } else {
+        fprintf(stderr, "optstat: unknown option -%c\n", shrt);
+    }
+    return 1;
+}
+
+
+static int cfg_positional(int idx, unsigned count, char *args[], void *data)
+{
+    (void)idx;
+    (void)data;
+    cfg.nlog = count;
+    cfg.log = args;
+    return !count;
+}
+
+
+static const struct optspec cfg_opts[] = {
+    { 'j', "threads", 1, cfg_threads },
+    { 'k', "topk",    1, cfg_topk    },
+    { 'w', "width",   1, cfg_width   },
+    { 'p', "pairs",   1, cfg_pairs   },
+    { 'o', "columns", 1, cfg_prefix  }
+};
+
+
+int main(int argc, char *argv[])
+{
+    struct optinfo info = {
+        0, NULL, OPT_FIRST_SKIP, OPT_END_ALLOW, cfg_error, cfg_positional, NULL
+    };
+    struct optlsstat st;
+    const struct optlsval *top;
+    unsigned long long t0, t1;
+    unsigned i, j;
+    double sec;
+
+    info.argc = argc;
+    info.argv = argv;
+    if (opt_parse(&info, sizeof cfg_opts / sizeof *cfg_opts, cfg_opts)
+     || !cfg.nlog) {
+        fprintf(stderr, "usage: %s [-j THREADS] [-k TOPK] [-w WIDTH] "
+                "[-p PAIRS] [-o PREFIX] LOG...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!cfg.conf.nthread) {
+        cfg.conf.nthread = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (opt_ls_init(&st, &cfg.conf)) {
+        perror("optstat");
+        return EXIT_FAILURE;
+    }
+    t0 = now();
+    for (i = 0; i < cfg.nlog; i++) {
+        if (count_log(&st, cfg.log[i])) {
+            fprintf(stderr, "optstat: %s: %s\n", cfg.log[i], strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    t1 = now();
+    for (i = 0; i < st.nopt; i++) {
+        if (!st.freq[i]) {
+            continue;
+        }
+        fputs("{\"opt\":", stdout);
+        json_opt(i);
+        printf(",\"count\":%llu,\"cmds\":%llu,\"top\":[", st.freq[i],
+               st.co[(size_t)i * st.nopt + i]);
+        top = st.top + (size_t)i * st.topk;
+        for (j = 0; j < st.topk && top[j].count; j++) {
+            fputs(j ? ",{\"val\":" : "{\"val\":", stdout);
+            json_str("", top[j].val);
+            printf(",\"count\":%llu,\"err\":%llu}", top[j].count, top[j].err);
+        }
+        fputs("]}\n", stdout);
+    }
+    report_pairs(&st);
+    if (cfg.prefix && write_cols(&st.cols)) {
+        fprintf(stderr, "optstat: %s: %s\n", cfg.prefix, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    sec = (t1 - t0) / 1e9;
+    printf("{\"bytes\":%llu,\"lines\":%llu,\"cmds\":%llu,\"unknown\":%llu"
+           ",\"threads\":%u,\"seconds\":%.3f,\"gb_per_s\":%.2f"
+           ",\"gb_per_s_per_thread\":%.2f}\n", st.bytes, st.lines, st.cmds,
+           st.unknown, cfg.conf.nthread, sec, st.bytes / 1e9 / sec,
+           st.bytes / 1e9 / sec / cfg.conf.nthread);
+    opt_ls_free(&st);
+    return EXIT_SUCCESS;
+}